@@ -1,22 +1,53 @@
 cbuffer PerFrameCB {
     // Number of frames accumulated in gLastFrame.
     uint gNumFramesAccum;
+    // Weights of gLastFrame and the new frame: their numbers of samples per pixel.
+    float gAccumulatedWeight;
+    float gFrameWeight;
 }
 
 // The accumulation texture.
 Texture2D<float4> gLastFrame;
 
+// The compensation term of the accumulation texture (see main()).
+Texture2D<float4> gLastCompensation;
+
 // The new frame, as produced by the previous pass, the RayTracedAmbientOcclusionPass.
 Texture2D<float4> gCurFrame;
 
-float4 main(float2 texC : TEXCOORD, float4 pos : SV_POSITION) : SV_Target0 {
+struct AccumulationOutput {
+    float4 average : SV_Target0;
+    float4 compensation : SV_Target1;
+};
+
+AccumulationOutput main(float2 texC : TEXCOORD, float4 pos : SV_POSITION) {
     uint2 pixelPosition = (uint2) pos.xy;
     float4 curColor = gCurFrame[pixelPosition];
+    AccumulationOutput output;
+
+    if (gNumFramesAccum == 0) {
+        // Neither the accumulated value nor its compensation term are valid.
+        output.average = curColor;
+        output.compensation = float4(0.0f, 0.0f, 0.0f, 0.0f);
+        return output;
+    }
+
     float4 prevColor = gLastFrame[pixelPosition];
 
     // A weighted average of the accumulated pixel color and the new frame's.
     // The new frame is supplied by the previous pass, the RayTracedAmbientOcclusionPass.
-    // The weight of the accumulated color is the number of accumulated frames, whereas
-    // the weight of the new frame's color is just 1. At the time of invocation.
-    return (gNumFramesAccum*prevColor + curColor) / (gNumFramesAccum + 1);
-}
\ No newline at end of file
+    // The weight of the accumulated color is the number of samples per pixel accumulated so far,
+    // whereas the weight of the new frame's color is its own number of samples per pixel (1 per
+    // frame unless the integrator takes more).
+    //
+    // The average is updated incrementally, average += (new - average) * w / (W + w). After thousands
+    // of frames the increment is so much smaller than the average that most of its bits are lost
+    // when they're added. Kahan summation carries the lost bits over to the next frame in the
+    // compensation term. precise keeps the compiler from simplifying the compensation term to 0.
+    precise float4 increment = (curColor - prevColor) * (gFrameWeight / (gAccumulatedWeight + gFrameWeight)) - gLastCompensation[pixelPosition];
+    precise float4 average = prevColor + increment;
+    precise float4 compensation = (average - prevColor) - increment;
+    output.compensation = compensation;
+    output.average = average;
+    return output;
+}
@@ -1,5 +1,161 @@
+// Per-triangle opacity states, so that most candidate hits are accepted or ignored without
+// interpolating texture coordinates and fetching the base color texture.
+//
+// The first time a triangle is alpha tested, its state is baked from the mip level of the base
+// color texture at which its texture coordinates' bounding box (widened by a texel for bilinear
+// filtering) covers at most 2x2 texels. Mips average their texels, so if those texels' alpha is
+// exactly 1 every texel under the triangle is opaque, and if it's exactly 0 every texel is
+// transparent. Anything in between is unknown and falls back to the alpha test at every hit.
+//
+// States are kept in two OPACITY_STATES_WIDTH x OPACITY_STATES_HEIGHT R32Uint textures, hashed by
+// (InstanceIndex(), PrimitiveIndex()); Falcor gives every mesh instance its own top-level
+// instance. A slot stores the exact key, instance + 1 in gOpacityStateKeys and
+// primitive << 2 | state in gOpacityStates, so a collision only costs an alpha test. The first
+// writer claims a slot with an atomic on its key; later triangles hashed to it are never cached.
+// The cache is only used when both textures are bound.
+
+// Must match kOpacityStatesWidth and kOpacityStatesHeight of every pass that binds the textures;
+// each of them creates its own.
+#define OPACITY_STATES_WIDTH 2048
+#define OPACITY_STATES_HEIGHT 1024
+
+#define OPACITY_STATE_PENDING 0
+#define OPACITY_STATE_OPAQUE 1
+#define OPACITY_STATE_TRANSPARENT 2
+#define OPACITY_STATE_UNKNOWN 3
+
+RWTexture2D<uint> gOpacityStateKeys;
+RWTexture2D<uint> gOpacityStates;
+
+// [0] candidate hits resolved from their triangle's state, [1] alpha tests run. Only bound on the
+// frames the statistics are collected.
+RWTexture2D<uint> gOpacityStats;
+
+bool opacityStatesBound() {
+    uint keyWidth, keyHeight;
+    gOpacityStateKeys.GetDimensions(keyWidth, keyHeight);
+    uint width, height;
+    gOpacityStates.GetDimensions(width, height);
+    return keyWidth != 0 && width != 0;
+}
+
+void countOpacityStat(uint index) {
+    uint width, height;
+    gOpacityStats.GetDimensions(width, height);
+    if (width != 0) {
+        InterlockedAdd(gOpacityStats[uint2(index, 0)], 1);
+    }
+}
+
+uint2 opacityStateTexel(uint instance, uint primitive) {
+    // Wang-style integer mix of both indices.
+    uint h = instance * 0x9e3779b9u ^ (primitive + 0x7f4a7c15u);
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35u;
+    h ^= h >> 16;
+    h %= OPACITY_STATES_WIDTH * OPACITY_STATES_HEIGHT;
+    return uint2(h % OPACITY_STATES_WIDTH, h / OPACITY_STATES_WIDTH);
+}
+
+float2 vertexTexCoord(uint primId, float2 barycentrics) {
+    BuiltInTriangleIntersectionAttributes attributes;
+    attributes.barycentrics = barycentrics;
+    return getVertexAttributes(primId, attributes).texC;
+}
+
+uint bakeOpacityState(uint primId) {
+    // Untextured materials have the same alpha everywhere.
+    if (EXTRACT_DIFFUSE_TYPE(gMaterial.flags) != ChannelTypeTexture) {
+        return gMaterial.baseColor.a < gMaterial.alphaThreshold ? OPACITY_STATE_TRANSPARENT : OPACITY_STATE_OPAQUE;
+    }
+
+    uint width, height, mipCount;
+    gMaterial.resources.baseColor.GetDimensions(0, width, height, mipCount);
+    // Only power-of-two textures have mips that average every texel of the level below.
+    if ((width & (width - 1)) != 0 || (height & (height - 1)) != 0) {
+        return OPACITY_STATE_UNKNOWN;
+    }
+
+    float2 uv0 = vertexTexCoord(primId, float2(0.0f, 0.0f));
+    float2 uv1 = vertexTexCoord(primId, float2(1.0f, 0.0f));
+    float2 uv2 = vertexTexCoord(primId, float2(0.0f, 1.0f));
+    float2 uvMin = min(uv0, min(uv1, uv2));
+    float2 uvMax = max(uv0, max(uv1, uv2));
+
+    // Coordinates outside [0,1] read different texels depending on the addressing mode; only the
+    // last level, which covers all of them, is conservative then.
+    uint level = mipCount - 1;
+    if (all(uvMin >= 0.0f) && all(uvMax <= 1.0f)) {
+        float2 extent = (uvMax - uvMin) * float2(width, height) + 1.0f;
+        level = min(uint(ceil(log2(max(extent.x, extent.y)))), mipCount - 1);
+    }
+
+    uint2 levelSize = max(uint2(width, height) >> level, uint2(1, 1));
+    int2 texelMin = int2(floor(uvMin * levelSize - 0.5f));
+    int2 texelMax = int2(floor(uvMax * levelSize + 0.5f));
+
+    bool allOpaque = true;
+    bool allTransparent = true;
+    for (int y = texelMin.y; y <= texelMax.y; y++) {
+        for (int x = texelMin.x; x <= texelMax.x; x++) {
+            uint2 texel = uint2(clamp(int2(x, y), int2(0, 0), int2(levelSize) - 1));
+            float alpha = gMaterial.resources.baseColor.Load(int3(texel, level)).a;
+            allOpaque = allOpaque && (alpha == 1.0f);
+            allTransparent = allTransparent && (alpha == 0.0f);
+        }
+    }
+
+    if (allOpaque && gMaterial.alphaThreshold <= 1.0f) {
+        return OPACITY_STATE_OPAQUE;
+    }
+    if (allTransparent && gMaterial.alphaThreshold > 0.0f) {
+        return OPACITY_STATE_TRANSPARENT;
+    }
+    return OPACITY_STATE_UNKNOWN;
+}
+
+// The cached state of the triangle, baking it on the first visit.
+uint opacityState(uint primId) {
+    uint2 texel = opacityStateTexel(InstanceIndex(), primId);
+    uint instanceKey = InstanceIndex() + 1;
+    uint key = gOpacityStateKeys[texel];
+    uint entry = gOpacityStates[texel];
+
+    if (key == instanceKey && (entry >> 2) == primId && (entry & 3) != OPACITY_STATE_PENDING) {
+        return entry & 3;
+    }
+    if (key != 0) {
+        // Taken by another triangle, or still being baked.
+        return OPACITY_STATE_UNKNOWN;
+    }
+
+    uint previous;
+    InterlockedCompareExchange(gOpacityStateKeys[texel], 0, instanceKey, previous);
+    uint state = bakeOpacityState(primId);
+    if (previous == 0) {
+        gOpacityStates[texel] = (primId << 2) | state;
+    }
+    return state;
+}
+
 // attributes are the attributes of the current hit/intersection.
 bool alphaTestFails(BuiltInTriangleIntersectionAttributes attributes) {
+    // Only masked materials are alpha tested; skip the texture fetch for everything else.
+    if (EXTRACT_ALPHA_MODE(gMaterial.flags) != AlphaModeMask) {
+        return false;
+    }
+
+    if (opacityStatesBound()) {
+        uint state = opacityState(PrimitiveIndex());
+        if (state != OPACITY_STATE_UNKNOWN) {
+            countOpacityStat(0);
+            return state == OPACITY_STATE_TRANSPARENT;
+        }
+    }
+    countOpacityStat(1);
+
     // PrimitiveIndex() is an object introspection intrinsic that returns
     // the identifier of the current primitive.
     VertexOut vsOut = getVertexAttributes(PrimitiveIndex(), attributes);
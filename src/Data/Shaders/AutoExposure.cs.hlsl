@@ -0,0 +1,56 @@
+#include "ToneMapping.hlsli"
+
+cbuffer ExposureCB {
+    uint gPixelCount;
+    float gMinLogLuminance;
+    float gLogLuminanceRange;
+    // Seconds since the last frame.
+    float gDeltaTime;
+    // Higher is faster; the adapted luminance covers 1 - exp(-gAdaptationSpeed * gDeltaTime) of the
+    // way to the luminance of the current frame.
+    float gAdaptationSpeed;
+    // When set, the adapted luminance jumps to that of the current frame (first frame, scene change).
+    bool gResetAdaptation;
+}
+
+// Filled by the histogram shader; cleared here for the next frame.
+RWBuffer<uint> gHistogram;
+
+// 1x1. The average scene luminance the eye has adapted to so far.
+RWTexture2D<float> gAdaptedLuminance;
+
+groupshared float gsWeightedBins[HISTOGRAM_BIN_COUNT];
+
+// A single thread group of HISTOGRAM_BIN_COUNT threads reduces the histogram to the mean log2
+// luminance of the frame (a geometric mean of its luminance, so a few very bright pixels don't
+// darken the whole frame).
+[numthreads(16, 16, 1)]
+void main(uint groupIndex : SV_GroupIndex) {
+    uint count = gHistogram[groupIndex];
+    gsWeightedBins[groupIndex] = float(count) * float(groupIndex);
+    gHistogram[groupIndex] = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    // Tree reduction of the weighted bins.
+    [unroll]
+    for (uint stride = HISTOGRAM_BIN_COUNT / 2; stride > 0; stride >>= 1) {
+        if (groupIndex < stride) {
+            gsWeightedBins[groupIndex] += gsWeightedBins[groupIndex + stride];
+        }
+        GroupMemoryBarrierWithGroupSync();
+    }
+
+    if (groupIndex == 0) {
+        // Thread 0 holds the count of bin 0, the black pixels, which don't vote.
+        float votingPixels = max(float(gPixelCount) - float(count), 1.0f);
+        float meanBin = gsWeightedBins[0] / votingPixels;
+        float frameLuminance = exp2(binToLogLuminance(meanBin, gMinLogLuminance, gLogLuminanceRange));
+
+        float adapted = frameLuminance;
+        if (!gResetAdaptation) {
+            float previous = gAdaptedLuminance[uint2(0, 0)];
+            adapted = previous + (frameLuminance - previous) * (1.0f - exp(-gDeltaTime * gAdaptationSpeed));
+        }
+        gAdaptedLuminance[uint2(0, 0)] = adapted;
+    }
+}
@@ -1,3 +1,22 @@
+// The BxDFs a BSDF is composed of are chosen at compile time. BSDF_COMPONENTS is a mask of the
+// BSDF_HAS_* bits below; every shader that includes this file is specialized for one mask (see the
+// PathTracing*.rt.hlsl permutations). Components outside the mask are compiled out of f, Sample_f
+// and Pdf, and a BSDF with a single component doesn't branch on its composition at all.
+//
+// A BSDF with several components picks the one to sample with a probability proportional to its
+// reflectance (see ComponentProbabilities), so that a black component of the mask, say the mirror
+// of a matte material, is never sampled and doesn't waste the path's sample.
+#define BSDF_HAS_DIFFUSE 1
+#define BSDF_HAS_SPECULAR 2
+#define BSDF_HAS_GLOSSY 4
+
+#ifndef BSDF_COMPONENTS
+// Ashikhmin-Shirley only: its diffuse and glossy terms already cover the materials of the scenes.
+#define BSDF_COMPONENTS BSDF_HAS_GLOSSY
+#endif
+
+#define BSDF_NUM_COMPONENTS ((BSDF_COMPONENTS & 1) + ((BSDF_COMPONENTS >> 1) & 1) + ((BSDF_COMPONENTS >> 2) & 1))
+
 struct BSDF {
     // Geometric normal.
     float3 ng;
@@ -12,23 +31,20 @@ struct BSDF {
     // Secondary tangent.
     float3 ts;
 
-    bool hasDiffuseBRDF = false;
+#if BSDF_COMPONENTS & BSDF_HAS_DIFFUSE
     LambertianBRDF diffuseBRDF;
+#endif
 
-    bool hasSpecularBRDF = false;
+#if BSDF_COMPONENTS & BSDF_HAS_SPECULAR
     SpecularBRDF specularBRDF;
+#endif
 
-    bool hasAshikhminShirleyBRDF = false;
+#if BSDF_COMPONENTS & BSDF_HAS_GLOSSY
     AshikhminShirleyBRDF ashikhminShirleyBRDF;
-
-    int nBxDFs = 0;
+#endif
 
     int NumComponents() {
-        int num = 0;
-        if (hasDiffuseBRDF) num++;
-        if (hasSpecularBRDF) num++;
-        if (hasAshikhminShirleyBRDF) num++;
-        return num;
+        return BSDF_NUM_COMPONENTS;
     }
 
     // Change of coordinate from world space to shading space.
@@ -49,6 +65,63 @@ struct BSDF {
         );
     }
 
+    // Sum of all the BRDFs, for directions on the same hemisphere (in shading space).
+    float3 SumBRDFs(float3 wo, float3 wi) {
+        float3 f = float3(0.f);
+#if BSDF_COMPONENTS & BSDF_HAS_DIFFUSE
+        f += diffuseBRDF.f(wo, wi);
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_SPECULAR
+        f += specularBRDF.f(wo, wi);
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_GLOSSY
+        f += ashikhminShirleyBRDF.f(wo, wi);
+#endif
+        return f;
+    }
+
+    // Type of the k-th component, in the order diffuse, specular, glossy.
+    int ComponentType(int k) {
+        int i = 0;
+#if BSDF_COMPONENTS & BSDF_HAS_DIFFUSE
+        if (k == i++) return BRDF_DIFFUSE;
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_SPECULAR
+        if (k == i++) return BRDF_SPECULAR;
+#endif
+        return BRDF_GLOSSY;
+    }
+
+    // Probability of sampling the diffuse (x), specular (y) and glossy (z) component: the luminance
+    // of its reflectance relative to the others'. 0 for components outside the mask, and for all of
+    // them if the BSDF is black.
+    float3 ComponentProbabilities() {
+        float3 weights = float3(0.f);
+#if BSDF_COMPONENTS & BSDF_HAS_DIFFUSE
+        weights.x = luminance(diffuseBRDF.R);
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_SPECULAR
+        weights.y = luminance(specularBRDF.R);
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_GLOSSY
+        weights.z = luminance(ashikhminShirleyBRDF.Rd + ashikhminShirleyBRDF.Rs);
+#endif
+        float sum = weights.x + weights.y + weights.z;
+        return sum > 0.f ? weights / sum : float3(0.f);
+    }
+
+    // The PDF of the non-specular components, weighted by their probabilities.
+    float NonSpecularPdf(float3 wo, float3 wi, float3 probabilities) {
+        float pdf = 0.f;
+#if BSDF_COMPONENTS & BSDF_HAS_DIFFUSE
+        pdf += probabilities.x * diffuseBRDF.Pdf(wo, wi);
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_GLOSSY
+        pdf += probabilities.z * ashikhminShirleyBRDF.Pdf(wo, wi);
+#endif
+        return pdf;
+    }
+
     float3 f(float3 woW, float3 wiW, float2 pixelIndex) {
         float3 wi = WorldToLocal(wiW);
         float3 wo = WorldToLocal(woW);
@@ -57,21 +130,12 @@ struct BSDF {
         // opposite hemispheres.
         bool reflect = dot(wiW, ng) * dot(woW, ng) > 0;
 
-        float3 f = float3(0.f);
-
         // Evaluate only the BRDFs when incident and outgoing direction vectors are on the same hemisphere.
         // TODO: evaluate only the BTDFs when they are on opposite hemispheres.
-        if (reflect && hasDiffuseBRDF) {
-            f += diffuseBRDF.f(wo, wi);
-        }
-        if (reflect && hasSpecularBRDF) {
-            f += specularBRDF.f(wo, wi);
-        }
-        if (reflect && hasAshikhminShirleyBRDF) {
-            f += ashikhminShirleyBRDF.f(wo, wi);
+        if (!reflect) {
+            return float3(0.f);
         }
-
-        return f;
+        return SumBRDFs(wo, wi);
     }
 
     float3 Sample_f(
@@ -82,30 +146,45 @@ struct BSDF {
         inout float sampledType,
         float2 pixelIndex
     ) {
-        // TODO: determine matching components based on input type requested.
-        int matchingComps = NumComponents();
+#if BSDF_NUM_COMPONENTS == 0
+        pdf = 0.f;
+        sampledType = BXDF_NONE;
+        return float3(0.f);
+#else
         int bxdfType;
         float2 uRemapped = u;
-        if (matchingComps == 0) {
+#if BSDF_NUM_COMPONENTS == 1
+        bxdfType = ComponentType(0);
+#else
+        // Choose one of the components with a probability proportional to its reflectance.
+        float3 probabilities = ComponentProbabilities();
+        if (all(probabilities == 0.f)) {
             pdf = 0.f;
             sampledType = BXDF_NONE;
             return float3(0.f);
-        } else if (matchingComps == 1) {
-            if (hasAshikhminShirleyBRDF) {
-                bxdfType = BRDF_GLOSSY;
-            } else {
-                bxdfType = hasDiffuseBRDF ? BRDF_DIFFUSE : BRDF_SPECULAR;
-            }
+        }
+        // The last component with a nonzero probability also takes what rounding leaves past the
+        // sum of the probabilities.
+        float cdfBefore;
+        float selectionPdf;
+        if (u.x < probabilities.x || (probabilities.y == 0.f && probabilities.z == 0.f)) {
+            bxdfType = BRDF_DIFFUSE;
+            cdfBefore = 0.f;
+            selectionPdf = probabilities.x;
+        } else if (u.x < probabilities.x + probabilities.y || probabilities.z == 0.f) {
+            bxdfType = BRDF_SPECULAR;
+            cdfBefore = probabilities.x;
+            selectionPdf = probabilities.y;
         } else {
-            // Choose one of the matching component BxDFs uniformly at random. Call it k.
-            int kthMatchingComp = min((int) floor(u.x * matchingComps), matchingComps - 1);
-            bxdfType = kthMatchingComp == 0 ? BRDF_DIFFUSE : BRDF_SPECULAR;
-            // The 2D sample u will be used for sampling the chosen BxDF, but the first of
-            // its components, u[0], has already been used (for sampling the set of matching
-            // BxDFs). Remap it to [0,1).
-            // TODO: explain.
-            uRemapped = float2(min(u.x * matchingComps - kthMatchingComp, ONE_MINUS_EPSILON), u.y);
+            bxdfType = BRDF_GLOSSY;
+            cdfBefore = probabilities.x + probabilities.y;
+            selectionPdf = probabilities.z;
         }
+        // The 2D sample u will be used for sampling the chosen BxDF, but the first of
+        // its components, u[0], has already been used (for choosing the BxDF). Remap the
+        // part of [0,1) that chose it back to [0,1).
+        uRemapped = float2(min((u.x - cdfBefore) / selectionPdf, ONE_MINUS_EPSILON), u.y);
+#endif
 
         // Sample chosen BxDF. We don't care about the returned radiometric spectrum f, only
         // about wi and pdf. The BSDF's radiometric spectrum corresponding to wi is computed
@@ -118,128 +197,127 @@ struct BSDF {
         pdf = 0;
         sampledType = (float) bxdfType;
         float3 f = float3(0.f);
+#if BSDF_COMPONENTS & BSDF_HAS_GLOSSY
         if (bxdfType == BRDF_GLOSSY) {
             f = ashikhminShirleyBRDF.Sample_f(wo, wi, uRemapped, pdf);
-        } else if (bxdfType == BRDF_DIFFUSE) {
+        }
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_DIFFUSE
+        if (bxdfType == BRDF_DIFFUSE) {
             f = diffuseBRDF.Sample_f(wo, wi, uRemapped, pdf);
         }
-        else {
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_SPECULAR
+        if (bxdfType == BRDF_SPECULAR) {
             f = specularBRDF.Sample_f(wo, wi, pdf);
         }
+#endif
         if (pdf == 0) {
             sampledType = BXDF_NONE;
             return float3(0.f);
         }
         wiW = LocalToWorld(wi);
 
+#if BSDF_NUM_COMPONENTS > 1
         // At this point, pdf stores the probability with which wi was obtained after
         // sampling the chosen BxDF. But when we chose this BxDF at random, we were actually
-        // sampling the overall set of directions represented by all the matching BxDFs. So
-        // wi wasn't really sampled from the chosen BxDFs's distribution, it was sampled from
-        // the overall distribution of the matching BxDFs, whose PDF is the average of all the
-        // PDFs.
+        // sampling the overall set of directions represented by all the BxDFs. So wi wasn't
+        // really sampled from the chosen BxDFs's distribution, it was sampled from the overall
+        // distribution of the BxDFs, whose PDF is the average of all the PDFs weighted by the
+        // probabilities of choosing them.
         //
-        // Compute average PDF, except in the specular case: a specular BxDF has a delta
-        // distribution of directions, that is, a given wo will always be mapped to a unique wi
-        // with probability 1 (pdf = 1 here already).
-        if (bxdfType != BRDF_SPECULAR && matchingComps > 1) {
-            // TODO: revisit when we have more than 1 non-specular BxDFs.
-
-            // Add only the pdf of non-specular BxDFs that aren't bxdfType (pdf already stores
-            // the pdf of the selected bxdfType).
-            pdf += specularBRDF.Pdf(wo, wi);
-        }
-        if (matchingComps > 1) {
-            pdf /= matchingComps;
+        // Except in the specular case: a specular BxDF has a delta distribution of directions,
+        // that is, a given wo will always be mapped to a unique wi with probability 1 (pdf = 1
+        // here already), which no other BxDF samples.
+        if (bxdfType != BRDF_SPECULAR) {
+            pdf = NonSpecularPdf(wo, wi, probabilities);
+        } else {
+            pdf *= selectionPdf;
         }
+#endif
 
         // Compute value of BSDF for sampled direction.
         if (bxdfType != BRDF_SPECULAR) {
-            // TODO: revisit when we have more than 1 non-specular BxDFs.
-
             bool reflect = dot(wiW, ng) * dot(woW, ng) > 0;
-
-            f = 0.0f;
-
-            if (reflect && hasDiffuseBRDF) {
-                f += diffuseBRDF.f(wo, wi);
-            }
-            if (reflect && hasSpecularBRDF) {
-                f += specularBRDF.f(wo, wi);
-            }
-            if (reflect && hasAshikhminShirleyBRDF) {
-                f += ashikhminShirleyBRDF.f(wo, wi);
-            }
+            f = reflect ? SumBRDFs(wo, wi) : float3(0.f);
         }
 
         return f;
+#endif
     }
 
     float Pdf(float3 woW, float3 wiW) {
-        if (nBxDFs == 0) {
-            return 0.f;
-        }
-
+#if BSDF_NUM_COMPONENTS == 0
+        return 0.f;
+#else
         float3 wi = WorldToLocal(wiW);
         float3 wo = WorldToLocal(woW);
         if (wo.z == 0) {
             return 0.f;
         }
 
+#if BSDF_NUM_COMPONENTS == 1
         float pdf = 0.f;
-        // TODO: determine matching components using input requested type.
-        int matchingComps = nBxDFs;
-        if (hasDiffuseBRDF) {
-            pdf += diffuseBRDF.Pdf(wo, wi);
-        }
-        if (hasSpecularBRDF) {
-            pdf += specularBRDF.Pdf(wo, wi);
-        }
-        if (hasAshikhminShirleyBRDF) {
-            pdf += ashikhminShirleyBRDF.Pdf(wo, wi);
-        }
-
-        // The probability of sampling wi for a given wo is the average of the PDFs of all 
-        // the BxDFs that match the input flags.
-        return matchingComps > 0 ? pdf / matchingComps : 0.f;
+#if BSDF_COMPONENTS & BSDF_HAS_DIFFUSE
+        pdf += diffuseBRDF.Pdf(wo, wi);
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_SPECULAR
+        pdf += specularBRDF.Pdf(wo, wi);
+#endif
+#if BSDF_COMPONENTS & BSDF_HAS_GLOSSY
+        pdf += ashikhminShirleyBRDF.Pdf(wo, wi);
+#endif
+        return pdf;
+#else
+        // The probability of sampling wi for a given wo is the average of the PDFs of all the
+        // BxDFs, weighted by the probabilities of choosing them. The specular PDF is 0 for any
+        // wi that was given rather than sampled.
+        return NonSpecularPdf(wo, wi, ComponentProbabilities());
+#endif
+#endif
     }
 };
 
+// Sets up the BSDF of a surface point from its normals and material parameters. Every component of
+// the BSDF_COMPONENTS configuration is set up, even if its reflectance is black, so that all the
+// BSDFs of a kernel have the same composition; black components are never sampled.
+void InitializeBSDF(
+    inout BSDF bsdf,
+    float3 ns,
+    float3 ng,
+    float3 diffuse,
+    float3 specular,
+    float roughness
+) {
+    bsdf.ns = ns;
+    bsdf.ng = ng;
+    bsdf.ss = float3(0.f);
+    bsdf.ts = float3(0.f);
+    CoordinateSystem(bsdf.ns, bsdf.ss, bsdf.ts);
+
+#if BSDF_COMPONENTS & BSDF_HAS_DIFFUSE
+    bsdf.diffuseBRDF.R = diffuse;
+#endif
+
+#if BSDF_COMPONENTS & BSDF_HAS_SPECULAR
+    bsdf.specularBRDF.R = specular;
+#endif
+
+#if BSDF_COMPONENTS & BSDF_HAS_GLOSSY
+    bsdf.ashikhminShirleyBRDF.Rd = diffuse;
+    bsdf.ashikhminShirleyBRDF.Rs = specular;
+    bsdf.ashikhminShirleyBRDF.sn = ns;
+    bsdf.ashikhminShirleyBRDF.roughness = roughness;
+    bsdf.ashikhminShirleyBRDF.distribution.alphaX = bsdf.ashikhminShirleyBRDF.distribution.RoughnessToAlpha(roughness);
+    bsdf.ashikhminShirleyBRDF.distribution.alphaY = bsdf.ashikhminShirleyBRDF.distribution.RoughnessToAlpha(roughness);
+#endif
+}
+
 // Creates the BSDF at the surface-ray intersection point.
 void ComputeScatteringFunctions(
     inout Interaction it,
     ShadingData shadingData,
     bool allowMultipleLobes
 ) {
-    it.bsdf.ns = it.shadingNormal;
-    it.bsdf.ng = it.n;
-    it.bsdf.ss = float3(0.f);
-    it.bsdf.ts = float3(0.f);
-    CoordinateSystem(it.bsdf.ns, it.bsdf.ss, it.bsdf.ts);
-
-    it.bsdf.hasDiffuseBRDF = false;
-    if (!IsBlack(shadingData.diffuse)) {
-        it.bsdf.hasDiffuseBRDF = true;
-        it.bsdf.diffuseBRDF.R = shadingData.diffuse;
-        it.bsdf.nBxDFs++;
-    }
-
-    it.bsdf.hasSpecularBRDF = false;
-    if (!IsBlack(shadingData.specular)) {
-        it.bsdf.hasSpecularBRDF = true;
-        it.bsdf.specularBRDF.R = shadingData.specular;
-        it.bsdf.nBxDFs++;
-    }
-
-    it.bsdf.hasAshikhminShirleyBRDF = true;
-    it.bsdf.ashikhminShirleyBRDF.Rd = shadingData.diffuse;
-    it.bsdf.ashikhminShirleyBRDF.Rs = shadingData.specular;
-    it.bsdf.ashikhminShirleyBRDF.sn = shadingData.N;
-    it.bsdf.ashikhminShirleyBRDF.roughness = shadingData.roughness;
-    it.bsdf.ashikhminShirleyBRDF.distribution.alphaX = it.bsdf.ashikhminShirleyBRDF.distribution.RoughnessToAlpha(shadingData.roughness);
-    it.bsdf.ashikhminShirleyBRDF.distribution.alphaY = it.bsdf.ashikhminShirleyBRDF.distribution.RoughnessToAlpha(shadingData.roughness);
-    // TODO: disabling these so that only AshikhminShirleyBRDF is used. 
-    it.bsdf.hasDiffuseBRDF = false;
-    it.bsdf.hasSpecularBRDF = false;
-    it.bsdf.nBxDFs++;
+    InitializeBSDF(it.bsdf, it.shadingNormal, it.n, shadingData.diffuse, shadingData.specular, shadingData.roughness);
 }
\ No newline at end of file
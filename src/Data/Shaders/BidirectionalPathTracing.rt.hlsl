@@ -0,0 +1,56 @@
+#include "HostDeviceSharedMacros.h"
+#include "HostDeviceData.h"
+import Raytracing;
+import ShaderCommon;
+import Shading;     
+import Lights;
+import BRDF;
+#include "Constants.hlsli"
+#include "Spectrum.hlsli"
+#include "Geometry.hlsli"
+#include "Reflection.hlsli"
+#include "AlphaTesting.hlsli"
+#include "PRNG.hlsli"
+#include "Sampling.hlsli"
+#include "RayCones.hlsli"
+#include "FresnelEquations.hlsli"
+#include "Distributions/Distribution.hlsli"
+#include "BxDFs/BxDF.hlsli"
+#include "BSDF.hlsli"
+#include "Light.hlsli"
+#include "Integrators/Bidirectional.hlsli"
+
+// Radiance of the camera subpaths; BidirectionalResolve.ps.hlsl adds the light tracing splats.
+RWTexture2D<float4> gOutput;
+
+cbuffer RayGenCB {
+    // Bounding sphere of the scene.
+    float3 gSceneCenter;
+    float gSceneRadius;
+    // The pixel's samples of this frame are gFirstSampleIndex to gFirstSampleIndex + gSamplesPerPixel - 1.
+    // Every random number of the camera and light subpaths is addressed by (pixel, sample, bounce,
+    // dimension).
+    uint gFirstSampleIndex;
+    uint gSamplesPerPixel;
+    uint gMaxDepth;
+}
+
+[shader("raygeneration")]
+void BidirectionalPathTracingRayGen() {
+    uint2 pixelIndex = DispatchRaysIndex().xy;
+    uint2 pixelCount = DispatchRaysDimensions().xy;
+
+    // Every pixel traces a camera subpath and a light subpath; the light subpath's contributions to
+    // the camera go to whichever pixels they project to.
+    BidirectionalPathIntegrator integrator;
+    integrator.maxDepth = gMaxDepth;
+    integrator.sceneCenter = gSceneCenter;
+    integrator.sceneRadius = gSceneRadius;
+    integrator.splatWeight = 1.0f / float(max(gSamplesPerPixel, 1));
+
+    float3 sum = float3(0.0f, 0.0f, 0.0f);
+    for (uint i = 0; i < gSamplesPerPixel; i++) {
+        sum += integrator.Li(pixelIndex, pixelCount, gFirstSampleIndex + i);
+    }
+    gOutput[pixelIndex] = float4(sum / float(max(gSamplesPerPixel, 1)), 1.0f);
+}
\ No newline at end of file
@@ -0,0 +1,19 @@
+// Must match BDPT_SPLAT_SCALE in Integrators/Bidirectional.hlsli.
+#define SPLAT_SCALE 65536.0f
+
+// Radiance of the camera subpaths.
+Texture2D<float4> gCameraPaths;
+
+// Light tracing contributions of all the frame's samples, already weighted by 1 / samples per
+// pixel, in fixed point: 3 texels per pixel (r, g, b).
+Texture2D<uint> gLightSplats;
+
+float4 main(float2 texC : TEXCOORD, float4 pos : SV_POSITION) : SV_Target0 {
+    uint2 pixelPosition = (uint2) pos.xy;
+    uint3 splat = uint3(
+        gLightSplats[uint2(3 * pixelPosition.x, pixelPosition.y)],
+        gLightSplats[uint2(3 * pixelPosition.x + 1, pixelPosition.y)],
+        gLightSplats[uint2(3 * pixelPosition.x + 2, pixelPosition.y)]
+    );
+    return float4(gCameraPaths[pixelPosition].rgb + float3(splat) / SPLAT_SCALE, 1.0f);
+}
\ No newline at end of file
@@ -16,6 +16,8 @@ import BRDF;
 #include "Distributions/GGXNormalDistribution.hlsli"
 #include "BxDFs/BxDF.hlsli"
 #include "Light.hlsli"
+#include "VisibilityCache.hlsli"
+#include "ShadowMaps.hlsli"
 #include "Integrator.hlsli"
 #include "Integrators/Direct.hlsli"
 
@@ -35,8 +37,8 @@ void DirectLightingRayGen() {
     uint2 pixelIndex = DispatchRaysIndex().xy;
     uint2 pixelCount = DispatchRaysDimensions().xy;
 
-    uint frameCount = gFrameCount;
-    uint randSeed = initRand(pixelIndex.x + pixelIndex.y * pixelCount.x, frameCount, 16);
+    // One sample per pixel per frame; see SampleCoordinates.
+    uint sampleIndex = gFrameCount;
 
     // Reconstruct the primary ray used to populate the G-Buffer.
 	RayDesc primaryRay;
@@ -52,7 +54,7 @@ void DirectLightingRayGen() {
 
     DirectLightingIntegrator integrator;
 	integrator.maxDepth = gMaxBounces;
-    float3 L = integrator.Li(primaryRay, randSeed, pixelIndex, 0);
+    float3 L = integrator.Li(primaryRay, sampleIndex, pixelIndex, 0);
     
     gOutput[pixelIndex] = float4(L, 1.0f);
 }
\ No newline at end of file
@@ -15,7 +15,16 @@ import Lights;
 #include "Shadows.hlsli"
 #include "Lighting.hlsli"
 #include "Microfacet.hlsli"
-#include "Integrators/Direct.hlsli"
+
+// Indirect lighting rates. A pixel traces its indirect ray only on the frames its rate selects;
+// the upsampling pass reconstructs it from its neighbors on the others.
+#define INDIRECT_RATE_FULL 0
+#define INDIRECT_RATE_CHECKERBOARD 1
+#define INDIRECT_RATE_QUARTER 2
+#define INDIRECT_RATE_ADAPTIVE 3
+
+// Side of the square tiles over which the adaptive rate is chosen.
+#define INDIRECT_RATE_TILE_SIZE 8
 
 shared cbuffer GlobalCB {
     float gMinT;
@@ -24,6 +33,14 @@ shared cbuffer GlobalCB {
     bool gDoDirectGI;
     uint gMaxDepth;
     float gEmitMult;
+    uint gIndirectRate;
+    // Relative luminance contrast of a tile's reconstructed indirect lighting above which it's
+    // traced at full rate, and above which it's traced at checkerboard rate.
+    float gFullRateContrast;
+    float gHalfRateContrast;
+    // Perceptual roughness (sqrt of GGX alpha) from which the specular lobe reads the prefiltered
+    // environment instead of tracing; above 1, it always traces.
+    float gPrefilteredRoughness;
 }
 
 shared Texture2D<float4> gPos;
@@ -33,7 +50,220 @@ shared Texture2D<float4> gSpecMatl;
 shared Texture2D<float4> gExtraMatl;
 shared Texture2D<float4> gEnvMap;
 shared Texture2D<float4> gEmissive;
+
+// Direct lighting, emission and background.
 shared RWTexture2D<float4> gOutput;
+// Indirect lighting divided by the pixel's reflectance; alpha is 1 for the pixels that traced it
+// this frame and 0 for the ones left to the upsampling pass.
+shared RWTexture2D<float4> gIndirectOutput;
+// Last frame's reconstructed (demodulated) indirect lighting; drives the adaptive rate.
+shared Texture2D<float4> gLastIndirect;
+
+// Split-sum GGX reflection of the environment (see EnvironmentMapSidecar): the environment
+// convolved with the GGX lobe, one perceptual roughness per mip, and the scale and bias of F0,
+// indexed by (NdotV, perceptual roughness).
+shared Texture2D<float4> gPrefilteredEnvMap;
+shared Texture2D<float2> gEnvBRDFLut;
+shared SamplerState gEnvSampler;
+shared SamplerState gLutSampler;
+
+// From http://cwyman.org/code/dxrTutors/tutors/Tutor14/tutorial14.md.html.
+float probabilityToSampleDiffuse(float3 difColor, float3 specColor) {
+	float lumDiffuse = max(0.01f, luminance(difColor.rgb));
+	float lumSpecular = max(0.01f, luminance(specColor.rgb));
+	return lumDiffuse / (lumDiffuse + lumSpecular);
+}
+
+// Lambertian plus GGX reflection of one randomly chosen light.
+float3 ggxDirect(inout uint randSeed, float3 hit, float3 N, float3 V, float3 dif, float3 spec, float rough) {
+	int lightToSample = min(int(nextRand(randSeed) * gLightsCount), gLightsCount - 1);
+
+	float distToLight;
+	float3 lightIntensity;
+	float3 L;
+	getLightData(lightToSample, hit, L, lightIntensity, distToLight);
+
+	float NdotL = saturate(dot(N, L));
+	float NdotV = saturate(dot(N, V));
+	if (NdotL <= 0.0f || NdotV <= 0.0f) {
+		return float3(0, 0, 0);
+	}
+
+	float3 H = normalize(V + L);
+	float NdotH = saturate(dot(N, H));
+	float LdotH = saturate(dot(L, H));
+
+	// The light was chosen with probability 1/gLightsCount.
+	float shadowMult = float(gLightsCount) * shootShadowRay(hit, L, gMinT, distToLight);
+
+	float D = ggxNormalDistribution(NdotH, rough);
+	float G = ggxSchlickMaskingTerm(NdotL, NdotV, rough);
+	float3 F = schlickFresnel(spec, LdotH);
+	// The NdotL of the denominator cancels out with the cosine of the rendering equation.
+	float3 ggxTerm = D * G * F / (4.0f * NdotV);
+
+	return shadowMult * lightIntensity * (ggxTerm + NdotL * dif / M_PI);
+}
+
+// Environment light reflected by the GGX lobe toward V, without tracing. Ignores occlusion by the
+// scene, which is what limits it to rough lobes: their reflection is a blur of a wide solid angle,
+// where missing occlusion is much less visible than in a sharp one.
+float3 prefilteredSpecular(float3 N, float3 V, float3 spec, float rough) {
+	uint width, height, levelCount;
+	gPrefilteredEnvMap.GetDimensions(0, width, height, levelCount);
+
+	float perceptualRoughness = sqrt(rough);
+	float NdotV = saturate(dot(N, V));
+	float3 R = reflect(-V, N);
+
+	float3 prefiltered = gPrefilteredEnvMap.SampleLevel(gEnvSampler, WorldToLatitudeLongitude(R), perceptualRoughness * (levelCount - 1)).rgb;
+	float2 scaleBias = gEnvBRDFLut.SampleLevel(gLutSampler, float2(NdotV, perceptualRoughness), 0.0f);
+	return prefiltered * (spec * scaleBias.x + scaleBias.y);
+}
+
+struct IndirectRayPayload {
+	float3 color;
+	uint randSeed;
+	uint rayDepth;
+};
+
+float3 shootIndirectRay(float3 origin, float3 direction, float minT, inout uint randSeed, uint rayDepth) {
+	RayDesc ray;
+	ray.Origin = origin;
+	ray.Direction = direction;
+	ray.TMin = minT;
+	ray.TMax = 1.0e+38f;
+
+	IndirectRayPayload payload;
+	payload.color = float3(0, 0, 0);
+	payload.randSeed = randSeed;
+	payload.rayDepth = rayDepth + 1;
+
+	TraceRay(gRtScene, 0, 0xFF, STANDARD_RAY_HIT_GROUP, hitProgramCount, STANDARD_RAY_HIT_GROUP, ray, payload);
+
+	randSeed = payload.randSeed;
+	return payload.color;
+}
+
+// One bounce of indirect lighting: either a cosine-weighted diffuse sample or a GGX microfacet
+// sample, chosen in proportion to the luminance of the diffuse and specular colors.
+float3 ggxIndirect(inout uint randSeed, float3 hit, float3 N, float3 noNormalN, float3 V, float3 dif, float3 spec, float rough, uint rayDepth) {
+	float probDiffuse = probabilityToSampleDiffuse(dif, spec);
+
+	if (nextRand(randSeed) < probDiffuse) {
+		float3 L = getCosHemisphereSample(randSeed, noNormalN);
+		float3 bounceColor = shootIndirectRay(hit, L, gMinT, randSeed, rayDepth);
+
+		// The cosine and 1/pi of the Lambertian BRDF cancel out with the pdf.
+		return bounceColor * dif / probDiffuse;
+	}
+
+	// Rough lobes take their whole expected contribution from the prefiltered environment.
+	if (sqrt(rough) >= gPrefilteredRoughness) {
+		return prefilteredSpecular(N, V, spec, rough) / (1.0f - probDiffuse);
+	}
+
+	float3 H = getGGXMicrofacet(randSeed, rough, N);
+	float3 L = normalize(2.0f * dot(V, H) * H - V);
+
+	float NdotL = saturate(dot(N, L));
+	float NdotV = saturate(dot(N, V));
+	float NdotH = saturate(dot(N, H));
+	float LdotH = saturate(dot(L, H));
+	if (NdotL <= 0.0f || NdotV <= 0.0f) {
+		return float3(0, 0, 0);
+	}
+
+	float3 bounceColor = shootIndirectRay(hit, L, gMinT, randSeed, rayDepth);
+
+	float D = ggxNormalDistribution(NdotH, rough);
+	float G = ggxSchlickMaskingTerm(NdotL, NdotV, rough);
+	float3 F = schlickFresnel(spec, LdotH);
+	float3 ggxTerm = D * G * F / (4.0f * NdotL * NdotV);
+	float ggxProb = D * NdotH / (4.0f * LdotH);
+
+	return NdotL * bounceColor * ggxTerm / (ggxProb * (1.0f - probDiffuse));
+}
+
+[shader("miss")]
+void IndirectMiss(inout IndirectRayPayload payload) {
+	float2 envMapDimensions;
+	gEnvMap.GetDimensions(envMapDimensions.x, envMapDimensions.y);
+
+	float2 uv = WorldToLatitudeLongitude(WorldRayDirection());
+
+	payload.color = gEnvMap[uint2(uv * envMapDimensions)].rgb;
+}
+
+[shader("anyhit")]
+void IndirectAnyHit(inout IndirectRayPayload payload, BuiltInTriangleIntersectionAttributes attributes) {
+	if (alphaTestFails(attributes)) {
+		IgnoreHit();
+	}
+}
+
+[shader("closesthit")]
+void IndirectClosestHit(inout IndirectRayPayload payload, BuiltInTriangleIntersectionAttributes attributes) {
+	ShadingData shadeData = getShadingData(PrimitiveIndex(), attributes);
+
+	float3 V = -WorldRayDirection();
+	float3 N = shadeData.N;
+	if (dot(N, V) <= 0.0f) {
+		N = -N;
+	}
+
+	payload.color = gEmitMult * shadeData.emissive.rgb;
+	payload.color += ggxDirect(payload.randSeed, shadeData.posW, N, V, shadeData.diffuse, shadeData.specular, shadeData.roughness);
+
+	if (payload.rayDepth < gMaxDepth) {
+		payload.color += ggxIndirect(payload.randSeed, shadeData.posW, N, N, V, shadeData.diffuse, shadeData.specular, shadeData.roughness, payload.rayDepth);
+	}
+}
+
+// What the indirect lighting is divided by before upsampling, so that texture detail isn't
+// interpolated across pixels.
+float3 indirectReflectance(float3 dif, float3 spec) {
+	return max(dif + spec, float3(0.01f, 0.01f, 0.01f));
+}
+
+// Rate of the tile that contains the pixel, from the luminance contrast of last frame's indirect
+// lighting over it. Every pixel of the tile reads the same texels, so they all agree.
+uint adaptiveIndirectRate(uint2 pixelIndex, uint2 pixelCount) {
+	uint2 tileOrigin = (pixelIndex / INDIRECT_RATE_TILE_SIZE) * INDIRECT_RATE_TILE_SIZE;
+	uint2 tileMax = min(tileOrigin + (INDIRECT_RATE_TILE_SIZE - 1), pixelCount - 1);
+
+	float lum[5] = {
+		luminance(gLastIndirect[tileOrigin].rgb),
+		luminance(gLastIndirect[uint2(tileMax.x, tileOrigin.y)].rgb),
+		luminance(gLastIndirect[uint2(tileOrigin.x, tileMax.y)].rgb),
+		luminance(gLastIndirect[tileMax].rgb),
+		luminance(gLastIndirect[(tileOrigin + tileMax) / 2].rgb)
+	};
+
+	float minLum = lum[0];
+	float maxLum = lum[0];
+	for (int i = 1; i < 5; i++) {
+		minLum = min(minLum, lum[i]);
+		maxLum = max(maxLum, lum[i]);
+	}
+
+	float contrast = (maxLum - minLum) / (maxLum + 0.05f);
+	if (contrast > gFullRateContrast) {
+		return INDIRECT_RATE_FULL;
+	}
+	return contrast > gHalfRateContrast ? INDIRECT_RATE_CHECKERBOARD : INDIRECT_RATE_QUARTER;
+}
+
+// The traced pixels rotate from frame to frame so that accumulation covers all of them.
+bool tracesIndirect(uint2 pixelIndex, uint rate) {
+	if (rate == INDIRECT_RATE_CHECKERBOARD) {
+		return ((pixelIndex.x + pixelIndex.y + gFrameCount) & 1) == 0;
+	}
+	if (rate == INDIRECT_RATE_QUARTER) {
+		return all((pixelIndex & 1) == uint2(gFrameCount & 1, (gFrameCount >> 1) & 1));
+	}
+	return true;
+}
 
 [shader("raygeneration")]
 void GGXGIRayGen() {
@@ -57,7 +287,6 @@ void GGXGIRayGen() {
     if (dot(worldNorm.xyz, V) <= 0.0f) {
         worldNorm.xyz = -worldNorm.xyz;
     }
-	float NdotV = dot(worldNorm.xyz, V);
 
     float3 noMapN = normalize(extraData.yzw);
 	if (dot(noMapN, V) <= 0.0f) {
@@ -66,16 +295,13 @@ void GGXGIRayGen() {
 
     // If not, assign background color to pixel.
     float3 pixelColor = pixelContainsGeometry ? float3(0, 0, 0) : difMatlColor.rgb;
+    float4 indirect = float4(0, 0, 0, 1);
     if (pixelContainsGeometry) {
         pixelColor = gEmitMult * gEmissive[pixelIndex].rgb;
 
         if (gDoDirectGI) {
-            DirectLightingIntegrator integrator;
-            RayDesc ray;
-            pixelColor += integrator.Li(
-                ray,
+            pixelColor += ggxDirect(
                 randSeed,
-                pixelIndex,
                 worldPos.xyz,
                 worldNorm.xyz,
                 V,
@@ -85,8 +311,9 @@ void GGXGIRayGen() {
             );
         }
 
-        if (gDoIndirectGI && gMaxDepth > 0) {
-            pixelColor += ggxIndirect(
+        uint rate = gIndirectRate == INDIRECT_RATE_ADAPTIVE ? adaptiveIndirectRate(pixelIndex, pixelCount) : gIndirectRate;
+        if (gDoIndirectGI && gMaxDepth > 0 && tracesIndirect(pixelIndex, rate)) {
+            indirect.rgb = ggxIndirect(
                 randSeed,
                 worldPos.xyz,
                 worldNorm.xyz,
@@ -96,12 +323,18 @@ void GGXGIRayGen() {
                 specMatlColor.rgb,
                 roughness, 
                 0
-            );
+            ) / indirectReflectance(difMatlColor.rgb, specMatlColor.rgb);
+        } else if (gDoIndirectGI && gMaxDepth > 0) {
+            indirect.a = 0.0f;
         }
     }    
 
     // NaN's and other invalid values?
     bool isNaN = any(isnan(pixelColor));
+    if (any(isnan(indirect.rgb))) {
+        indirect.rgb = float3(0, 0, 0);
+    }
 
     gOutput[pixelIndex] = float4(isNaN ? float3(0, 0, 0) : pixelColor, 1.0f);
+    gIndirectOutput[pixelIndex] = indirect;
 }
\ No newline at end of file
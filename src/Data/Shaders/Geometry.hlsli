@@ -72,6 +72,31 @@ void decodeNormals(float4 encodedNormals, out float3 geometryNormal, out float3
 	shadingNormal = decodeNormalOctahedron(encodedNormals.zw);
 }
 
+float2 encodeNormalOctahedron(float3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	return n.z >= 0.0f ? n.xy : octWrap(n.xy);
+}
+
+// A unit vector in 32 bits: its octahedral coordinates as two 16-bit snorms, as in VertexCompression.
+uint packDirection(float3 d) {
+	int2 q = int2(round(clamp(encodeNormalOctahedron(d), -1.0f, 1.0f) * 32767.0f));
+	return (uint(q.x) & 0xFFFF) | (uint(q.y) << 16);
+}
+
+float3 unpackDirection(uint packed) {
+	int2 q = int2(int(packed << 16) >> 16, int(packed) >> 16);
+	return decodeNormalOctahedron(max(float2(q) / 32767.0f, -1.0f));
+}
+
+// Three halves in 64 bits.
+uint2 packHalf3(float3 v) {
+	return uint2(f32tof16(v.x) | (f32tof16(v.y) << 16), f32tof16(v.z));
+}
+
+float3 unpackHalf3(uint2 packed) {
+	return float3(f16tof32(packed.x), f16tof32(packed.x >> 16), f16tof32(packed.y));
+}
+
 // Flip u so that it lies in the same hemisphere as v.
 float3 FaceForward(float3 u, float3 v) {
 	return (dot(u, v) < 0.f) ? -u : u;
@@ -0,0 +1,111 @@
+cbuffer UpsampleCB {
+    float3 gCameraPos;
+    // Width, in units of the distance to the camera, of the falloff of a neighbor's weight with its
+    // distance to the tangent plane of the pixel.
+    float gPlaneDistanceScale;
+    // Exponent of the cosine between normals.
+    float gNormalPower;
+    // Whether to accumulate gUpsampleStats this frame.
+    bool gCollectStats;
+}
+
+// Direct lighting, emission and background.
+Texture2D<float4> gDirect;
+// Demodulated indirect lighting; alpha is 1 for the pixels that traced it this frame.
+Texture2D<float4> gIndirect;
+
+// G-Buffer.
+Texture2D<float4> gPos;
+Texture2D<float4> gNorm;
+Texture2D<float4> gDiffuseMatl;
+Texture2D<float4> gSpecMatl;
+
+// [0] pixels that traced indirect lighting, [1] pixels with geometry, [2] sum of the relative
+// reconstruction errors in 1/1024ths, [3] number of errors summed.
+RWTexture2D<uint> gUpsampleStats;
+
+// Neighbors considered on each side. A 5x5 window contains traced pixels at every rate.
+#define UPSAMPLE_RADIUS 2
+
+struct UpsampleOutput {
+    float4 color : SV_Target0;
+    // Reconstructed demodulated indirect lighting; the next frame's adaptive rate reads it.
+    float4 indirect : SV_Target1;
+};
+
+float luminance(float3 rgb) {
+    return dot(rgb, float3(0.2126f, 0.7152f, 0.0722f));
+}
+
+// Joint bilateral filter over the traced neighbors, guided by the G-Buffer: a neighbor counts less
+// the farther it is in screen space, the farther it is from the pixel's tangent plane and the more
+// its normal differs.
+float3 reconstructIndirect(int2 pixel, int2 size, float3 P, float3 N, bool excludeCenter) {
+    float planeSigma = max(gPlaneDistanceScale * length(gCameraPos - P), 1e-4f);
+
+    float3 sum = float3(0, 0, 0);
+    float weightSum = 0.0f;
+    for (int y = -UPSAMPLE_RADIUS; y <= UPSAMPLE_RADIUS; y++) {
+        for (int x = -UPSAMPLE_RADIUS; x <= UPSAMPLE_RADIUS; x++) {
+            int2 q = pixel + int2(x, y);
+            if ((excludeCenter && x == 0 && y == 0) || any(q < 0) || any(q >= size)) {
+                continue;
+            }
+
+            float4 indirect = gIndirect[q];
+            float4 Pq = gPos[q];
+            if (indirect.a == 0.0f || Pq.w == 0.0f) {
+                continue;
+            }
+
+            float spatialWeight = exp(-0.5f * float(x * x + y * y));
+            float planeWeight = exp(-abs(dot(N, Pq.xyz - P)) / planeSigma);
+            float normalWeight = pow(saturate(dot(N, gNorm[q].xyz)), gNormalPower);
+            float weight = spatialWeight * planeWeight * normalWeight;
+
+            sum += weight * indirect.rgb;
+            weightSum += weight;
+        }
+    }
+
+    return weightSum > 0.0f ? sum / weightSum : float3(0, 0, 0);
+}
+
+UpsampleOutput main(float2 texC : TEXCOORD, float4 pos : SV_POSITION) {
+    int2 pixel = int2(pos.xy);
+    int2 size;
+    gIndirect.GetDimensions(size.x, size.y);
+
+    UpsampleOutput output;
+    output.color = gDirect[pixel];
+    output.indirect = float4(0, 0, 0, 1);
+
+    float4 P = gPos[pixel];
+    if (P.w == 0.0f) {
+        return output;
+    }
+
+    float3 N = gNorm[pixel].xyz;
+    float4 indirect = gIndirect[pixel];
+    bool traced = (indirect.a != 0.0f);
+    float3 demodulated = traced ? indirect.rgb : reconstructIndirect(pixel, size, P.xyz, N, false);
+
+    if (gCollectStats) {
+        InterlockedAdd(gUpsampleStats[uint2(1, 0)], 1);
+        if (traced) {
+            InterlockedAdd(gUpsampleStats[uint2(0, 0)], 1);
+
+            // Leave-one-out: how far the filter lands from a value it actually knows.
+            float3 predicted = reconstructIndirect(pixel, size, P.xyz, N, true);
+            float actual = luminance(indirect.rgb);
+            float error = min(abs(luminance(predicted) - actual) / (actual + 0.01f), 4.0f);
+            InterlockedAdd(gUpsampleStats[uint2(2, 0)], uint(error * 1024.0f));
+            InterlockedAdd(gUpsampleStats[uint2(3, 0)], 1);
+        }
+    }
+
+    float3 reflectance = max(gDiffuseMatl[pixel].rgb + gSpecMatl[pixel].rgb, float3(0.01f, 0.01f, 0.01f));
+    output.color.rgb += demodulated * reflectance;
+    output.indirect = float4(demodulated, 1.0f);
+    return output;
+}
\ No newline at end of file
@@ -5,7 +5,8 @@ float3 EstimateDirect(
     float2 uLight,
     ShadingData shadingData,
     float brdfProbability,
-    bool handleMedia
+    bool handleMedia,
+    bool cacheVisibility
 ) {
     // Radiance.
     float3 Ld = float3(0.0f);
@@ -45,6 +46,14 @@ float3 EstimateDirect(
             // Compute effect of visibility for light source sample.
             if (handleMedia) {
                 // TODO: handle media.
+            } else if (gShadowMode != SHADOW_MODE_RAYS && lightNum == gShadowMapLight) {
+                // The directional light may be resolved from its shadow maps instead (ShadowMaps.hlsli).
+                Li *= directionalLightVisibility(visibility, it);
+            } else if (cacheVisibility && IsDeltaLight(light) && lightNum < VISIBILITY_CACHE_MAX_LIGHTS) {
+                // Visibility of delta lights from a primary hit is reused once the pixel's footprint agrees on it.
+                if (!cachedUnoccluded(visibility, uint2(it.pixelIndex), lightNum)) {
+                    Li = float3(0.f);
+                }
             } else if (!visibility.Unoccluded()) {
                 // The light source doesn't illuminate the surface from the sampled direction.
                 Li = float3(0.f);
@@ -79,19 +88,21 @@ float3 EstimateDirect(
 float3 UniformSampleOneLight(
     Interaction it,
     ShadingData shadingData,
-    uint randSeed,
+    SampleCoordinates sampleCoordinates,
     float brdfProbability,
-    bool handleMedia
+    bool handleMedia,
+    // Whether it is a primary hit whose light visibility goes through the VisibilityCache.
+    bool cacheVisibility
 ) {
     // Randomly choose single light to sample.
     int nLights = gLightsCount;
     if (nLights == 0) {
         return float3(0.f, 0.f, 0.f);
     }
-    int lightNum = min(int(nextRand(randSeed) * nLights), nLights - 1);
+    int lightNum = min(int(sampleDimension(sampleCoordinates, RNG_DIM_LIGHT_SELECTION) * nLights), nLights - 1);
 
-    float2 uLight = float2(nextRand(randSeed), nextRand(randSeed));
-    float2 uScattering = float2(nextRand(randSeed), nextRand(randSeed));
+    float2 uLight = sampleDimension2D(sampleCoordinates, RNG_DIM_LIGHT_SAMPLE);
+    float2 uScattering = sampleDimension2D(sampleCoordinates, RNG_DIM_LIGHT_SCATTERING);
 
-    return nLights * EstimateDirect(it, uScattering, lightNum, uLight, shadingData, brdfProbability, handleMedia);
+    return nLights * EstimateDirect(it, uScattering, lightNum, uLight, shadingData, brdfProbability, handleMedia, cacheVisibility);
 }
\ No newline at end of file
@@ -0,0 +1,703 @@
+Texture2D<float4> gEnvMap;
+
+// Light tracing contributions (the t = 1 strategy) land on arbitrary pixels, so threads accumulate
+// them atomically, in fixed point: 3 texels per pixel (r, g, b) of a (3 * width) x height R32Uint
+// texture, scaled by BDPT_SPLAT_SCALE and rounded. BidirectionalResolve.ps.hlsl decodes them.
+RWTexture2D<uint> gLightSplats;
+#define BDPT_SPLAT_SCALE 65536.0f
+// A single splat is clamped to BDPT_MAX_SPLAT before it's weighted by 1 / samples per pixel, so a
+// texel, which holds up to 65536, only overflows once a pixel gets 256 full splats per sample.
+#define BDPT_MAX_SPLAT 256.0f
+
+// Longest camera and light subpaths, in vertices. A camera subpath of maxDepth + 2 vertices has to
+// fit; must match BidirectionalPathTracingPass::kMaxDepth.
+#define BDPT_MAX_PATH_VERTICES 6
+
+// Light subpaths draw their random numbers from bounces offset by this much, so that they're
+// independent of the camera subpath of the same sample.
+#define BDPT_LIGHT_BOUNCE_OFFSET 32
+
+#define BDPT_VERTEX_CAMERA 0
+#define BDPT_VERTEX_LIGHT 1
+#define BDPT_VERTEX_SURFACE 2
+
+// What the hit shaders return: the surface at the hit, for the ray generation shader to build a
+// vertex out of it. 56 bytes.
+struct BDPTRayPayload {
+    float3 hitPoint;
+    // packDirection. Both face the origin of the ray.
+    uint geometricNormal;
+    uint shadingNormal;
+    // packHalf3.
+    uint2 diffuse;
+    uint2 specular;
+    float roughness;
+    // On a miss, the radiance of the environment.
+    float3 radiance;
+    bool hit;
+};
+
+void traceBDPTRay(RayDesc ray, inout BDPTRayPayload payload) {
+    payload.hit = false;
+
+    // Back faces aren't culled: light subpaths enter rooms through them, and shadow rays don't cull
+    // them either.
+    TraceRay(
+        gRtScene,
+        RAY_FLAG_NONE,
+        0xFF,
+        STANDARD_RAY_HIT_GROUP,
+        hitProgramCount,
+        STANDARD_RAY_HIT_GROUP,
+        ray,
+        payload,
+    );
+}
+
+[shader("closesthit")]
+void BDPTClosestHit(inout BDPTRayPayload payload, BuiltInTriangleIntersectionAttributes attributes) {
+    VertexOut vsOut = getVertexAttributes(PrimitiveIndex(), attributes);
+
+    // Camera and light subpaths share vertices and have no common ray footprint; the material is
+    // sampled at the finest mip level.
+    ShadingData shadingData = prepareShadingData(vsOut, gMaterial, WorldRayOrigin(), 0.0f);
+
+    // Surfaces are two-sided: both normals are flipped to the side the ray came from.
+    float3 ng = normalize(vsOut.normalW);
+    if (dot(ng, WorldRayDirection()) > 0.0f) {
+        ng = -ng;
+    }
+    float3 ns = dot(shadingData.N, ng) < 0.0f ? -shadingData.N : shadingData.N;
+
+    payload.hitPoint = shadingData.posW;
+    payload.geometricNormal = packDirection(ng);
+    payload.shadingNormal = packDirection(ns);
+    payload.diffuse = packHalf3(shadingData.diffuse);
+    payload.specular = packHalf3(shadingData.specular);
+    payload.roughness = shadingData.roughness;
+    payload.hit = true;
+}
+
+[shader("anyhit")]
+void BDPTAnyHit(inout BDPTRayPayload payload, BuiltInTriangleIntersectionAttributes attributes) {
+    if (alphaTestFails(attributes)) {
+        IgnoreHit();
+    }
+}
+
+[shader("miss")]
+void BDPTMiss(inout BDPTRayPayload payload) {
+    float2 envMapDimensions;
+    gEnvMap.GetDimensions(envMapDimensions.x, envMapDimensions.y);
+
+    float2 uv = WorldToLatitudeLongitude(WorldRayDirection());
+    payload.radiance = gEnvMap[uint2(uv * envMapDimensions)].rgb;
+    payload.hit = false;
+}
+
+// A vertex of a camera or light subpath (PBRT's Vertex).
+struct BDPTVertex {
+    // BDPT_VERTEX_*.
+    uint type;
+    // The direction that leaves the vertex was sampled from a delta distribution (a specular BxDF);
+    // it can't be connected to.
+    bool delta;
+    float3 p;
+    // Surface: geometric and shading normals. Directional light: the direction of emission. 0
+    // otherwise.
+    float3 ng;
+    float3 ns;
+    // Surface: direction to the previous vertex of the subpath.
+    float3 wo;
+    // Throughput of the subpath from its first vertex up to this one.
+    float3 beta;
+    // Density of sampling this vertex from the previous one of its subpath (pdfFwd) and from the
+    // next one, as if the subpath had been sampled in the other direction (pdfRev). Area measure,
+    // except for directional light vertices, which are sampled by solid angle.
+    float pdfFwd;
+    float pdfRev;
+    // Surface: the material at the vertex.
+    float3 diffuse;
+    float3 specular;
+    float roughness;
+    // Light: index into gLights.
+    uint lightIndex;
+};
+
+BDPTVertex emptyVertex(uint type) {
+    BDPTVertex v;
+    v.type = type;
+    v.delta = false;
+    v.p = float3(0.0f, 0.0f, 0.0f);
+    v.ng = float3(0.0f, 0.0f, 0.0f);
+    v.ns = float3(0.0f, 0.0f, 0.0f);
+    v.wo = float3(0.0f, 0.0f, 0.0f);
+    v.beta = float3(0.0f, 0.0f, 0.0f);
+    v.pdfFwd = 0.0f;
+    v.pdfRev = 0.0f;
+    v.diffuse = float3(0.0f, 0.0f, 0.0f);
+    v.specular = float3(0.0f, 0.0f, 0.0f);
+    v.roughness = 0.0f;
+    v.lightIndex = 0;
+    return v;
+}
+
+bool isOnSurface(BDPTVertex v) {
+    return v.type == BDPT_VERTEX_SURFACE;
+}
+
+bool isInfiniteLight(BDPTVertex v) {
+    return v.type == BDPT_VERTEX_LIGHT && gLights[v.lightIndex].type == LightDirectional;
+}
+
+// Whether a connection can be made to the vertex. Directional lights are reached only by light
+// sampling (s = 1), and surfaces only if their BSDF has a component that isn't specular.
+bool isConnectible(BDPTVertex v) {
+    if (v.type == BDPT_VERTEX_LIGHT) {
+        return !isInfiniteLight(v);
+    }
+    if (v.type == BDPT_VERTEX_SURFACE) {
+        return (BSDF_COMPONENTS & (BSDF_HAS_DIFFUSE | BSDF_HAS_GLOSSY)) != 0;
+    }
+    return true;
+}
+
+BSDF vertexBSDF(BDPTVertex v) {
+    BSDF bsdf;
+    InitializeBSDF(bsdf, v.ns, v.ng, v.diffuse, v.specular, v.roughness);
+    return bsdf;
+}
+
+// BSDF of surface vertex v for the directions to the previous vertex of its subpath and to next.
+float3 vertexF(BDPTVertex v, BDPTVertex next) {
+    float3 wi = next.p - v.p;
+    if (dot(wi, wi) == 0.0f) {
+        return float3(0.0f, 0.0f, 0.0f);
+    }
+    BSDF bsdf = vertexBSDF(v);
+    return bsdf.f(v.wo, normalize(wi), float2(0.0f, 0.0f));
+}
+
+// Flips n to the side of the surface that w points to.
+float3 faceToward(float3 n, float3 w) {
+    return dot(n, w) < 0.0f ? -n : n;
+}
+
+// Traces a shadow ray between two vertices; the ends on surfaces are offset toward each other.
+bool unoccluded(BDPTVertex a, BDPTVertex b) {
+    float3 p0 = isOnSurface(a) ? offsetRayOrigin(a.p, faceToward(a.ng, b.p - a.p)) : a.p;
+    float3 p1 = isOnSurface(b) ? offsetRayOrigin(b.p, faceToward(b.ng, a.p - b.p)) : b.p;
+
+    RayDesc shadowRay;
+    shadowRay.Origin = p0;
+    shadowRay.Direction = normalize(p1 - p0);
+    shadowRay.TMin = 0.0f;
+    shadowRay.TMax = distance(p0, p1);
+
+    SurfaceInteraction si;
+    spawnShadowRay(shadowRay, si);
+    return !si.hit;
+}
+
+// Area of the image plane of the pinhole camera at unit distance from it.
+float imagePlaneArea() {
+    return 4.0f * length(gCamera.cameraU) * length(gCamera.cameraV) / dot(gCamera.cameraW, gCamera.cameraW);
+}
+
+// Importance emitted by the pinhole camera along direction w (normalized), and the point of the
+// image, in [0,1]^2, that w goes through. 0 when w misses the image.
+float cameraWe(float3 w, out float2 raster) {
+    raster = float2(-1.0f, -1.0f);
+
+    float3 W = gCamera.cameraW;
+    float cosTheta = dot(w, normalize(W));
+    if (cosTheta <= 0.0f) {
+        return 0.0f;
+    }
+
+    // Where w crosses the image plane, relative to its center, in units of cameraU and cameraV. The
+    // inverse of the mapping of the camera rays (see generateCameraSubpath).
+    float3 q = w * (dot(W, W) / dot(w, W)) - W;
+    float2 ndc = float2(dot(q, gCamera.cameraU) / dot(gCamera.cameraU, gCamera.cameraU), dot(q, gCamera.cameraV) / dot(gCamera.cameraV, gCamera.cameraV));
+    if (abs(ndc.x) > 1.0f || abs(ndc.y) > 1.0f) {
+        return 0.0f;
+    }
+    raster = float2(ndc.x + 1.0f, 1.0f - ndc.y) * 0.5f;
+
+    float cos2Theta = cosTheta * cosTheta;
+    return 1.0f / (imagePlaneArea() * cos2Theta * cos2Theta);
+}
+
+// Solid angle density of the camera ray along w.
+float cameraPdfDir(float3 w) {
+    float2 raster;
+    if (cameraWe(w, raster) == 0.0f) {
+        return 0.0f;
+    }
+    float cosTheta = dot(w, normalize(gCamera.cameraW));
+    return 1.0f / (imagePlaneArea() * cosTheta * cosTheta * cosTheta);
+}
+
+// Returns 1 for 0, so that ratios of densities of delta distributions (0 by convention) cancel out.
+float remap0(float f) {
+    return f != 0.0f ? f : 1.0f;
+}
+
+// BidirectionalPathIntegrator samples a camera subpath and a light subpath per pixel and connects
+// every prefix of one to every prefix of the other (Veach, "Robust Monte Carlo Methods for Light
+// Transport Simulation", and PBRT-v3 16.3). The strategy (s, t) takes s vertices of the light
+// subpath and t of the camera subpath; every path length is sampled by all of its strategies, and
+// they're combined with the balance heuristic.
+//
+// - t = 1 (light tracing) connects a light subpath vertex to the camera; its contribution goes to
+//   the pixel it projects to, through gLightSplats.
+// - s = 1 samples a light from a camera subpath vertex, like the unidirectional path tracer's next
+//   event estimation.
+// - s = 0 is a camera subpath that escapes to the environment. All the lights are delta lights,
+//   which no camera subpath can hit, and no light subpath starts on the environment, so this is
+//   the only strategy for the environment and its weight is 1.
+//
+// The camera is a pinhole: depth of field isn't modeled.
+struct BidirectionalPathIntegrator {
+    // Longest path, in bounces (vertices - 2).
+    uint maxDepth;
+    // Weight of the light tracing splats, 1 / samples per pixel of the frame.
+    float splatWeight;
+    // Bounding sphere of the scene; light subpaths of directional lights start on a disk of its radius.
+    float3 sceneCenter;
+    float sceneRadius;
+
+    // Point densities are converted to area densities at next: the solid angle density of the
+    // direction from v to next times the Jacobian |cos(theta)| / r^2.
+    float convertDensity(BDPTVertex v, float pdf, BDPTVertex next) {
+        if (isInfiniteLight(next)) {
+            return pdf;
+        }
+        float3 w = next.p - v.p;
+        float dist2 = dot(w, w);
+        if (dist2 == 0.0f) {
+            return 0.0f;
+        }
+        float invDist2 = 1.0f / dist2;
+        if (isOnSurface(next)) {
+            pdf *= abs(dot(next.ng, w * sqrt(invDist2)));
+        }
+        return pdf * invDist2;
+    }
+
+    // Density of next as the second vertex of a light subpath that starts at light vertex v.
+    float pdfLight(BDPTVertex v, BDPTVertex next) {
+        LightData light = gLights[v.lightIndex];
+        float3 w;
+        float pdf;
+        if (light.type == LightDirectional) {
+            w = normalize(light.dirW);
+            pdf = 1.0f / (M_PI * sceneRadius * sceneRadius);
+        } else {
+            w = next.p - v.p;
+            float invDist2 = 1.0f / dot(w, w);
+            w *= sqrt(invDist2);
+            pdf = invDist2 / (4.0f * M_PI);
+        }
+        if (isOnSurface(next)) {
+            pdf *= abs(dot(next.ng, w));
+        }
+        return pdf;
+    }
+
+    // Density of sampling next from v, given the vertex before v (unused by the endpoints of a
+    // subpath).
+    float pdf(BDPTVertex v, BDPTVertex prev, BDPTVertex next) {
+        if (v.type == BDPT_VERTEX_LIGHT) {
+            return pdfLight(v, next);
+        }
+
+        float3 wn = next.p - v.p;
+        if (dot(wn, wn) == 0.0f) {
+            return 0.0f;
+        }
+        wn = normalize(wn);
+
+        float pdfDir;
+        if (v.type == BDPT_VERTEX_CAMERA) {
+            pdfDir = cameraPdfDir(wn);
+        } else {
+            BSDF bsdf = vertexBSDF(v);
+            pdfDir = bsdf.Pdf(normalize(prev.p - v.p), wn);
+        }
+        return convertDensity(v, pdfDir, next);
+    }
+
+    // Extends path, whose first vertex is set, along ray. Surface vertices are sampled from their
+    // BSDFs until the path has maxVertices. Returns the number of vertices. A camera subpath that
+    // escapes adds the environment to L.
+    uint randomWalk(
+        inout BDPTVertex path[BDPT_MAX_PATH_VERTICES],
+        RayDesc ray,
+        float3 beta,
+        float pdfDir,
+        uint maxVertices,
+        bool cameraSubpath,
+        uint2 pixelIndex,
+        uint sampleIndex,
+        inout float3 L
+    ) {
+        uint bounceOffset = cameraSubpath ? 0 : BDPT_LIGHT_BOUNCE_OFFSET;
+        uint count = 1;
+        float pdfFwd = pdfDir;
+        while (count < maxVertices) {
+            BDPTRayPayload payload;
+            traceBDPTRay(ray, payload);
+            if (!payload.hit) {
+                if (cameraSubpath) {
+                    L += beta * payload.radiance;
+                }
+                break;
+            }
+
+            BDPTVertex prev = path[count - 1];
+            BDPTVertex v = emptyVertex(BDPT_VERTEX_SURFACE);
+            v.p = payload.hitPoint;
+            v.ng = unpackDirection(payload.geometricNormal);
+            v.ns = unpackDirection(payload.shadingNormal);
+            v.wo = -ray.Direction;
+            v.beta = beta;
+            v.diffuse = unpackHalf3(payload.diffuse);
+            v.specular = unpackHalf3(payload.specular);
+            v.roughness = payload.roughness;
+            v.pdfFwd = convertDensity(prev, pdfFwd, v);
+            path[count] = v;
+            count++;
+            if (count == maxVertices) {
+                break;
+            }
+
+            // The ith vertex of a subpath draws its random numbers from bounce i (plus the offset of
+            // light subpaths).
+            SampleCoordinates sampleCoordinates = makeSampleCoordinates(pixelIndex, sampleIndex, bounceOffset + count - 1);
+            BSDF bsdf = vertexBSDF(v);
+            float3 wi = float3(0.0f, 0.0f, 0.0f);
+            float bsdfPdf = 0.0f;
+            float bxdfType = BXDF_NONE;
+            float3 f = bsdf.Sample_f(v.wo, wi, sampleDimension2D(sampleCoordinates, RNG_DIM_BSDF), bsdfPdf, bxdfType, float2(pixelIndex));
+            if (IsBlack(f) || bsdfPdf == 0.0f) {
+                break;
+            }
+            beta *= f * abs(dot(wi, v.ns)) / bsdfPdf;
+            pdfFwd = bsdfPdf;
+            float pdfRev = bsdf.Pdf(wi, v.wo);
+            if (int(bxdfType) == BRDF_SPECULAR) {
+                path[count - 1].delta = true;
+                pdfFwd = 0.0f;
+                pdfRev = 0.0f;
+            }
+            path[count - 2].pdfRev = convertDensity(v, pdfRev, prev);
+
+            ray.Origin = offsetRayOrigin(v.p, faceToward(v.ng, wi));
+            ray.Direction = wi;
+            ray.TMin = 0.0f;
+            ray.TMax = 1e+38f;
+        }
+        return count;
+    }
+
+    uint generateCameraSubpath(
+        inout BDPTVertex path[BDPT_MAX_PATH_VERTICES],
+        uint2 pixelIndex,
+        uint2 pixelCount,
+        uint sampleIndex,
+        uint maxVertices,
+        inout float3 L
+    ) {
+        // A random point of the pixel, mapped to [-1,1]x[1,-1] like the G-Buffer's primary rays. Each
+        // sample goes through its own point, the same box filter as the light tracing splats.
+        SampleCoordinates sampleCoordinates = makeSampleCoordinates(pixelIndex, sampleIndex, 0);
+        float2 pixelOffset = sampleDimension2D(sampleCoordinates, RNG_DIM_LENS);
+        float2 pixelCenter = (pixelIndex + pixelOffset) / pixelCount;
+        float2 ndc = float2(2, -2) * pixelCenter + float2(-1, 1);
+
+        RayDesc ray;
+        ray.Origin = gCamera.posW;
+        ray.Direction = normalize(ndc.x * gCamera.cameraU + ndc.y * gCamera.cameraV + gCamera.cameraW);
+        ray.TMin = 0.0f;
+        ray.TMax = 1e+38f;
+
+        BDPTVertex camera = emptyVertex(BDPT_VERTEX_CAMERA);
+        camera.p = gCamera.posW;
+        camera.beta = float3(1.0f, 1.0f, 1.0f);
+        path[0] = camera;
+
+        // The throughput of the camera ray, We * cos(theta) / pdfDir, is 1 for a pinhole.
+        return randomWalk(path, ray, camera.beta, cameraPdfDir(ray.Direction), maxVertices, true, pixelIndex, sampleIndex, L);
+    }
+
+    uint generateLightSubpath(
+        inout BDPTVertex path[BDPT_MAX_PATH_VERTICES],
+        uint2 pixelIndex,
+        uint sampleIndex,
+        uint maxVertices
+    ) {
+        if (gLightsCount == 0 || maxVertices == 0) {
+            return 0;
+        }
+
+        // Lights are chosen uniformly.
+        SampleCoordinates sampleCoordinates = makeSampleCoordinates(pixelIndex, sampleIndex, BDPT_LIGHT_BOUNCE_OFFSET);
+        uint lightIndex = min(uint(sampleDimension(sampleCoordinates, RNG_DIM_LIGHT_SELECTION) * gLightsCount), gLightsCount - 1);
+        float lightPdf = 1.0f / float(gLightsCount);
+        LightData light = gLights[lightIndex];
+
+        BDPTVertex v = emptyVertex(BDPT_VERTEX_LIGHT);
+        v.lightIndex = lightIndex;
+        v.beta = light.intensity;
+
+        RayDesc ray;
+        ray.TMin = 0.0f;
+        ray.TMax = 1e+38f;
+        float pdfPos;
+        float pdfDir;
+        if (light.type == LightDirectional) {
+            // Parallel rays from a disk that covers the scene's bounding sphere, perpendicular to the
+            // light's direction.
+            float3 d = normalize(light.dirW);
+            float3 t1 = float3(0.0f, 0.0f, 0.0f);
+            float3 t2 = float3(0.0f, 0.0f, 0.0f);
+            CoordinateSystem(d, t1, t2);
+            float2 disk = ConcentricSampleDisk(sampleDimension2D(sampleCoordinates, RNG_DIM_LIGHT_SAMPLE));
+            ray.Origin = sceneCenter + sceneRadius * (disk.x * t1 + disk.y * t2 - d);
+            ray.Direction = d;
+            pdfPos = 1.0f / (M_PI * sceneRadius * sceneRadius);
+            pdfDir = 1.0f;
+            v.ng = d;
+        } else {
+            // Point lights emit uniformly in all directions.
+            ray.Origin = light.posW;
+            ray.Direction = UniformSampleSphere(sampleDimension2D(sampleCoordinates, RNG_DIM_LIGHT_SCATTERING));
+            pdfPos = 1.0f;
+            pdfDir = 1.0f / (4.0f * M_PI);
+        }
+        v.p = ray.Origin;
+        v.pdfFwd = pdfPos * lightPdf;
+        path[0] = v;
+
+        // Both kinds of lights emit along the sampled direction, so the cosine at the light is 1.
+        float3 beta = light.intensity / (lightPdf * pdfPos * pdfDir);
+        float3 unused = float3(0.0f, 0.0f, 0.0f);
+        uint count = randomWalk(path, ray, beta, pdfDir, maxVertices, false, pixelIndex, sampleIndex, unused);
+
+        // The second vertex of a directional light subpath is sampled by the area of the disk.
+        if (light.type == LightDirectional && count > 1) {
+            path[1].pdfFwd = pdfPos * abs(dot(ray.Direction, path[1].ng));
+        }
+        return count;
+    }
+
+    // Balance heuristic weight of strategy (s, t) relative to all the strategies that sample a path
+    // of the same length (PBRT's MISWeight). sampled replaces the endpoint of a subpath of 1 vertex,
+    // which was sampled for the connection.
+    //
+    // The vertices at both sides of the connection get the densities of the reverse direction of
+    // the new edge; they're restored afterwards.
+    float misWeight(
+        inout BDPTVertex lightPath[BDPT_MAX_PATH_VERTICES],
+        inout BDPTVertex cameraPath[BDPT_MAX_PATH_VERTICES],
+        BDPTVertex sampled,
+        uint s,
+        uint t
+    ) {
+        if (s + t == 2) {
+            return 1.0f;
+        }
+
+        BDPTVertex savedPt = cameraPath[t - 1];
+        BDPTVertex savedPtMinus = cameraPath[max(t, 2) - 2];
+        BDPTVertex savedQs = lightPath[s - 1];
+        BDPTVertex savedQsMinus = lightPath[max(s, 2) - 2];
+
+        if (t == 1) {
+            cameraPath[0] = sampled;
+        } else if (s == 1) {
+            lightPath[0] = sampled;
+        }
+        BDPTVertex pt = cameraPath[t - 1];
+        BDPTVertex qs = lightPath[s - 1];
+        BDPTVertex ptMinus = cameraPath[max(t, 2) - 2];
+        BDPTVertex qsMinus = lightPath[max(s, 2) - 2];
+
+        cameraPath[t - 1].delta = false;
+        lightPath[s - 1].delta = false;
+        cameraPath[t - 1].pdfRev = pdf(qs, qsMinus, pt);
+        if (t > 1) {
+            cameraPath[t - 2].pdfRev = pdf(pt, qs, ptMinus);
+        }
+        lightPath[s - 1].pdfRev = pdf(pt, ptMinus, qs);
+        if (s > 1) {
+            lightPath[s - 2].pdfRev = pdf(qs, pt, qsMinus);
+        }
+
+        // Ratios of the densities of the other strategies to this one's, one vertex at a time.
+        float sumRi = 0.0f;
+        float ri = 1.0f;
+        for (int i = int(t) - 1; i > 0; i--) {
+            ri *= remap0(cameraPath[i].pdfRev) / remap0(cameraPath[i].pdfFwd);
+            if (!cameraPath[i].delta && !cameraPath[i - 1].delta) {
+                sumRi += ri;
+            }
+        }
+        ri = 1.0f;
+        for (int j = int(s) - 1; j >= 0; j--) {
+            ri *= remap0(lightPath[j].pdfRev) / remap0(lightPath[j].pdfFwd);
+            // All the lights are delta lights: strategies that hit them (s = 0) don't exist.
+            bool deltaLightVertex = j > 0 ? lightPath[j - 1].delta : true;
+            if (!lightPath[j].delta && !deltaLightVertex) {
+                sumRi += ri;
+            }
+        }
+
+        lightPath[max(s, 2) - 2] = savedQsMinus;
+        lightPath[s - 1] = savedQs;
+        cameraPath[max(t, 2) - 2] = savedPtMinus;
+        cameraPath[t - 1] = savedPt;
+
+        return 1.0f / (1.0f + sumRi);
+    }
+
+    // Weighted contribution of strategy (s, t), s >= 1 and t >= 1 (PBRT's ConnectBDPT). For t = 1,
+    // raster is the point of the image the light subpath vertex projects to.
+    float3 connect(
+        inout BDPTVertex lightPath[BDPT_MAX_PATH_VERTICES],
+        inout BDPTVertex cameraPath[BDPT_MAX_PATH_VERTICES],
+        uint s,
+        uint t,
+        uint2 pixelIndex,
+        uint sampleIndex,
+        out float2 raster
+    ) {
+        raster = float2(-1.0f, -1.0f);
+        float3 L = float3(0.0f, 0.0f, 0.0f);
+        BDPTVertex sampled = emptyVertex(BDPT_VERTEX_CAMERA);
+
+        if (t == 1) {
+            // Connect the light subpath to the pinhole.
+            BDPTVertex qs = lightPath[s - 1];
+            if (!isConnectible(qs)) {
+                return L;
+            }
+            float3 toCamera = gCamera.posW - qs.p;
+            float dist2 = dot(toCamera, toCamera);
+            float3 wi = toCamera / sqrt(dist2);
+            float We = cameraWe(-wi, raster);
+            // Solid angle density of the pinhole seen from qs, as a lens of area 1 facing cameraW.
+            float cameraPdf = dist2 / abs(dot(normalize(gCamera.cameraW), wi));
+            if (We == 0.0f || cameraPdf == 0.0f) {
+                return L;
+            }
+            sampled.p = gCamera.posW;
+            sampled.beta = float3(We, We, We) / cameraPdf;
+
+            L = qs.beta * vertexF(qs, sampled) * sampled.beta;
+            if (isOnSurface(qs)) {
+                L *= abs(dot(wi, qs.ns));
+            }
+            if (!IsBlack(L) && !unoccluded(qs, sampled)) {
+                L = float3(0.0f, 0.0f, 0.0f);
+            }
+        } else if (s == 1) {
+            // Sample a light from the camera subpath.
+            BDPTVertex pt = cameraPath[t - 1];
+            if (!isConnectible(pt)) {
+                return L;
+            }
+            SampleCoordinates sampleCoordinates = makeSampleCoordinates(pixelIndex, sampleIndex, t - 1);
+            uint lightIndex = min(uint(sampleDimension(sampleCoordinates, RNG_DIM_LIGHT_SELECTION) * gLightsCount), gLightsCount - 1);
+            float lightPdf = 1.0f / float(gLightsCount);
+            LightData light = gLights[lightIndex];
+
+            sampled = emptyVertex(BDPT_VERTEX_LIGHT);
+            sampled.lightIndex = lightIndex;
+            float3 wi;
+            float3 Li;
+            if (light.type == LightDirectional) {
+                // Like Sample_Li, a point along the light's direction outside the scene.
+                wi = -normalize(light.dirW);
+                Li = light.intensity;
+                sampled.p = pt.p + wi * (2.0f * sceneRadius);
+                sampled.ng = -wi;
+            } else {
+                float3 toLight = light.posW - pt.p;
+                float dist2 = dot(toLight, toLight);
+                wi = toLight / sqrt(dist2);
+                Li = light.intensity / dist2;
+                sampled.p = light.posW;
+            }
+            // Delta lights are sampled with probability 1.
+            sampled.beta = Li / lightPdf;
+            sampled.pdfFwd = lightPdf;
+
+            L = pt.beta * vertexF(pt, sampled) * sampled.beta * abs(dot(wi, pt.ns));
+            if (!IsBlack(L) && !unoccluded(pt, sampled)) {
+                L = float3(0.0f, 0.0f, 0.0f);
+            }
+        } else {
+            BDPTVertex qs = lightPath[s - 1];
+            BDPTVertex pt = cameraPath[t - 1];
+            if (!isConnectible(qs) || !isConnectible(pt)) {
+                return L;
+            }
+            L = qs.beta * vertexF(qs, pt) * vertexF(pt, qs) * pt.beta;
+            if (!IsBlack(L)) {
+                // The geometric term, including visibility.
+                float3 d = qs.p - pt.p;
+                float g = 1.0f / dot(d, d);
+                d *= sqrt(g);
+                g *= abs(dot(qs.ns, d)) * abs(dot(pt.ns, d));
+                L *= unoccluded(qs, pt) ? g : 0.0f;
+            }
+        }
+
+        if (IsBlack(L)) {
+            return L;
+        }
+        return L * misWeight(lightPath, cameraPath, sampled, s, t);
+    }
+
+    // Adds a light tracing contribution to the pixel that contains raster.
+    void splat(float2 raster, uint2 pixelCount, float3 L) {
+        if (IsBlack(L) || any(isnan(L)) || raster.x < 0.0f) {
+            return;
+        }
+        uint2 pixel = min(uint2(raster * pixelCount), pixelCount - 1);
+        uint3 value = uint3(min(L, BDPT_MAX_SPLAT) * (splatWeight * BDPT_SPLAT_SCALE) + 0.5f);
+        InterlockedAdd(gLightSplats[uint2(3 * pixel.x, pixel.y)], value.r);
+        InterlockedAdd(gLightSplats[uint2(3 * pixel.x + 1, pixel.y)], value.g);
+        InterlockedAdd(gLightSplats[uint2(3 * pixel.x + 2, pixel.y)], value.b);
+    }
+
+    // Radiance of the pixel's camera subpath, with every strategy but light tracing; light tracing
+    // is splatted.
+    float3 Li(uint2 pixelIndex, uint2 pixelCount, uint sampleIndex) {
+        BDPTVertex cameraPath[BDPT_MAX_PATH_VERTICES];
+        BDPTVertex lightPath[BDPT_MAX_PATH_VERTICES];
+
+        float3 L = float3(0.0f, 0.0f, 0.0f);
+        uint cameraVertices = generateCameraSubpath(cameraPath, pixelIndex, pixelCount, sampleIndex, min(maxDepth + 2, BDPT_MAX_PATH_VERTICES), L);
+        uint lightVertices = generateLightSubpath(lightPath, pixelIndex, sampleIndex, min(maxDepth + 1, BDPT_MAX_PATH_VERTICES));
+
+        for (uint t = 1; t <= cameraVertices; t++) {
+            for (uint s = 1; s <= lightVertices; s++) {
+                if ((s == 1 && t == 1) || s + t - 2 > maxDepth) {
+                    continue;
+                }
+
+                float2 raster;
+                float3 Lpath = connect(lightPath, cameraPath, s, t, pixelIndex, sampleIndex, raster);
+                if (t == 1) {
+                    splat(raster, pixelCount, Lpath);
+                } else {
+                    L += Lpath;
+                }
+            }
+        }
+        return L;
+    }
+};
\ No newline at end of file
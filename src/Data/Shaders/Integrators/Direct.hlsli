@@ -1,5 +1,7 @@
 struct DLRayPayload {
-    uint randSeed;
+    // Coordinates of the random numbers of the hit, along with pixelIndex.
+    uint sampleIndex;
+    uint depth;
     float3 shadingNormal;
     float3 normal;
     float3 hitPoint;
@@ -17,9 +19,10 @@ RWTexture2D<float3> gBRDFProbability;
 
 Texture2D<float4> gEnvMap;
 
-void spawnRay(RayDesc ray, inout SurfaceInteraction si, uint randSeed, uint2 pixelIndex) {
+void spawnRay(RayDesc ray, inout SurfaceInteraction si, uint sampleIndex, int depth, uint2 pixelIndex) {
     DLRayPayload payload;
-    payload.randSeed = randSeed;
+    payload.sampleIndex = sampleIndex;
+    payload.depth = depth;
     payload.pixelIndex = pixelIndex;
     payload.hit = false;
 
@@ -54,7 +57,8 @@ void spawnRay(RayDesc ray, inout SurfaceInteraction si, uint randSeed, uint2 pix
 [shader("closesthit")]
 void DLClosestHit(inout DLRayPayload payload, BuiltInTriangleIntersectionAttributes attributes) {
     VertexOut vsOut = getVertexAttributes(PrimitiveIndex(), attributes);
-    ShadingData shadingData = prepareShadingData(vsOut, gMaterial, gCamera.posW, 0);
+    // The view vector points back along the ray, to the camera of the pixel's view for primary hits.
+    ShadingData shadingData = prepareShadingData(vsOut, gMaterial, WorldRayOrigin(), 0);
 
     Interaction it;
     it.p = shadingData.posW;
@@ -63,10 +67,19 @@ void DLClosestHit(inout DLRayPayload payload, BuiltInTriangleIntersectionAttribu
     // TODO: when implementing participating media, determine whether this is surface or medium.
     it.isSurfaceInteraction = true;
     it.wo = -normalize(WorldRayDirection());
+    it.pixelIndex = payload.pixelIndex;
     // TODO: handle media.
     bool handleMedia = false;
 	float brdfProbability = getBRDFProbability(gMaterial, shadingData.V, it.shadingNormal);
-    float3 L = UniformSampleOneLight(it, shadingData, payload.randSeed, brdfProbability, handleMedia);
+    // Only the primary hit, which stays within the pixel's footprint while the camera stays put, goes
+    // through the visibility cache.
+    bool cacheVisibility = false;
+    if (gUseVisibilityCache && payload.depth == 0) {
+        cacheVisibility = validateVisibilityCache(payload.pixelIndex, it.p, it.n, WorldRayOrigin());
+    }
+
+    SampleCoordinates sampleCoordinates = makeSampleCoordinates(payload.pixelIndex, payload.sampleIndex, payload.depth);
+    float3 L = UniformSampleOneLight(it, shadingData, sampleCoordinates, brdfProbability, handleMedia, cacheVisibility);
     gDirectL[payload.pixelIndex] = L;
     gBRDFProbability[payload.pixelIndex] = float3(brdfProbability, brdfProbability, brdfProbability);
 
@@ -98,10 +111,10 @@ void DLMiss(inout DLRayPayload payload) {
     payload.hit = false;
 }
 
-float3 Li2(RayDesc ray, uint randSeed, uint2 pixelIndex, int depth, int maxDepth) {
+float3 Li2(RayDesc ray, uint sampleIndex, uint2 pixelIndex, int depth, int maxDepth) {
     float3 L = float3(0.f);
     SurfaceInteraction si;
-    spawnRay(ray, si, randSeed, pixelIndex);
+    spawnRay(ray, si, sampleIndex, depth, pixelIndex);
     if (!si.hasHit()) {
         if (depth == 0) {
             L += si.Le;
@@ -116,10 +129,10 @@ float3 Li2(RayDesc ray, uint randSeed, uint2 pixelIndex, int depth, int maxDepth
     return L;
 }
 
-float3 Li1(RayDesc ray, uint randSeed, uint2 pixelIndex, int depth, int maxDepth) {
+float3 Li1(RayDesc ray, uint sampleIndex, uint2 pixelIndex, int depth, int maxDepth) {
     float3 L = float3(0.f);
     SurfaceInteraction si;
-    spawnRay(ray, si, randSeed, pixelIndex);
+    spawnRay(ray, si, sampleIndex, depth, pixelIndex);
     if (!si.hasHit()) {
         if (depth == 0) {
             L += si.Le;
@@ -131,8 +144,8 @@ float3 Li1(RayDesc ray, uint randSeed, uint2 pixelIndex, int depth, int maxDepth
     if (gLightsCount > 0) {
         L += si.directL;
     }
-    if (depth+1 < maxDepth && nextRand(randSeed) < si.brdfProbability*si.brdfProbability) {
-        L += SpecularReflect2(ray, si, randSeed, pixelIndex, depth, maxDepth);
+    if (depth+1 < maxDepth && sampleDimension(makeSampleCoordinates(pixelIndex, sampleIndex, depth), RNG_DIM_SPECULAR_SELECTION) < si.brdfProbability*si.brdfProbability) {
+        L += SpecularReflect2(ray, si, sampleIndex, pixelIndex, depth, maxDepth);
     }
     return L;
 }
@@ -141,7 +154,7 @@ float3 SpecularReflect2(
     // TODO: should be RayDifferential.
     RayDesc ray,
     SurfaceInteraction si,
-    uint randSeed,
+    uint sampleIndex,
     uint2 pixelIndex,
     int depth,
     int maxDepth
@@ -162,7 +175,7 @@ float3 SpecularReflect2(
         rd.Direction = wi;
         rd.TMin = 0.0f;
         rd.TMax = 1e+38f;
-        return f * Li2(rd, randSeed, pixelIndex, depth+1, maxDepth) * abs(dot(wi, ns)) / pdf;
+        return f * Li2(rd, sampleIndex, pixelIndex, depth+1, maxDepth) * abs(dot(wi, ns)) / pdf;
         // return float3(0.f, 0.f, 0.f);
     } else {
         return float3(0.f, 0.f, 0.f);
@@ -173,7 +186,7 @@ float3 SpecularReflect(
     // TODO: should be RayDifferential.
     RayDesc ray,
     SurfaceInteraction si,
-    uint randSeed,
+    uint sampleIndex,
     uint2 pixelIndex,
     int depth,
     int maxDepth
@@ -201,9 +214,9 @@ float3 SpecularReflect(
         // BRDF f and the incident radiance Li gives the fraction of incident light that will get
         // reflected. The AbsDot(wi, ns) = cos(wi, ns) factor places the area differential on the
         // surface (the area differential dA is originally perpendicular to the wi solid angle).
-        // return f * Li(rd, randSeed, pixelIndex, depth+1, maxDepth) * abs(dot(wi, ns)) / pdf;
-        // return f * Li1(rd, randSeed, pixelIndex, depth+1, maxDepth) * abs(dot(wi, ns)) / pdf;
-        return f * Li1(rd, randSeed, pixelIndex, depth+1, maxDepth) * abs(dot(wi, ns)) / pdf;
+        // return f * Li(rd, sampleIndex, pixelIndex, depth+1, maxDepth) * abs(dot(wi, ns)) / pdf;
+        // return f * Li1(rd, sampleIndex, pixelIndex, depth+1, maxDepth) * abs(dot(wi, ns)) / pdf;
+        return f * Li1(rd, sampleIndex, pixelIndex, depth+1, maxDepth) * abs(dot(wi, ns)) / pdf;
         return float3(0.f, 0.f, 0.f);
     } else {
         return float3(0.f, 0.f, 0.f);
@@ -213,12 +226,12 @@ float3 SpecularReflect(
 struct DirectLightingIntegrator {
 	int maxDepth;
 
-	float3 Li(RayDesc ray, uint randSeed, uint2 pixelIndex, int depth) {
+	float3 Li(RayDesc ray, uint sampleIndex, uint2 pixelIndex, int depth) {
 		// Radiance.
         float3 L = float3(0.f);
 
 		SurfaceInteraction si;
-		spawnRay(ray, si, randSeed, pixelIndex);
+		spawnRay(ray, si, sampleIndex, depth, pixelIndex);
 		if (!si.hasHit()) {
             // The ray escapes the scene bounds without having hit anything. Add
             // radiance emitted by environment lights. Light::Le is implemented
@@ -239,7 +252,7 @@ struct DirectLightingIntegrator {
 			L += si.directL;
 		}
 
-		if (depth+1 < maxDepth && nextRand(randSeed) < si.brdfProbability*si.brdfProbability) {
+		if (depth+1 < maxDepth && sampleDimension(makeSampleCoordinates(pixelIndex, sampleIndex, depth), RNG_DIM_SPECULAR_SELECTION) < si.brdfProbability*si.brdfProbability) {
 			// Trace rays recursively for specular reflection and transmission. In general, the direct
 			// lighting integrator estimates incident radiance using samples from light sources that
 			// illuminate the surface directly. But in order for a surface with a (perfect) specular
@@ -248,7 +261,7 @@ struct DirectLightingIntegrator {
 			// toward the intersection point.
 
 			// TODO: call SpecularTransmit.
-            L += SpecularReflect(ray, si, randSeed, pixelIndex, depth, maxDepth);
+            L += SpecularReflect(ray, si, sampleIndex, pixelIndex, depth, maxDepth);
 		}
 
         return L;
@@ -1,25 +1,57 @@
-RWTexture2D<float3> gDirectL;
 RWTexture2D<float3> gLe;
-RWTexture2D<float3> gWo;
-RWTexture2D<float3> gWi;
-RWTexture2D<float4> gBRDF;
-RWTexture2D<float2> gPDF;
 Texture2D<float4> gEnvMap;
 
+// Bits of PTRayPayload.flags.
+#define PT_PAYLOAD_BOUNCE_MASK 0xFFu
+#define PT_PAYLOAD_LIGHT_SAMPLES_SHIFT 8
+#define PT_PAYLOAD_LIGHT_SAMPLES_MASK 0xFFu
+// BXDF_NONE, BRDF_DIFFUSE, BRDF_SPECULAR or BRDF_GLOSSY.
+#define PT_PAYLOAD_BXDF_TYPE_SHIFT 16
+#define PT_PAYLOAD_BXDF_TYPE_MASK 0x3u
+#define PT_PAYLOAD_HIT 0x40000u
+
+// Everything the hit shaders return travels in the payload, packed into 60 bytes; nothing goes
+// through per-pixel textures.
 struct PTRayPayload {
-    uint randSeed;
-    float3 shadingNormal;
-    float3 normal;
+    // Coordinates of the random numbers of the hit, along with the pixel index.
+    uint sampleIndex;
+    // Pixel index, x in the low 16 bits.
+    uint pixel;
+    // Bounce, number of light samples to take at the hit (more than one above the weight window), the
+    // type of the BxDF sampled there and whether there was a hit; see PT_PAYLOAD_*.
+    uint flags;
+    // In full precision; the next ray starts there.
     float3 hitPoint;
-    uint2 pixelIndex;
+    // packDirection.
+    uint shadingNormal;
+    uint wi;
+    // f * |cos(theta)| / pdf of wi, the factor of the throughput at the hit, as halves (packHalf3).
+    // 0 ends the path.
+    uint2 weight;
+    // Direct lighting at the hit or, on a miss, the radiance of the environment.
+    float3 radiance;
+    // Footprint of the ray. On the way in, the cone at the origin of the ray; on the way out,
+    // the cone of the ray that extends the path from the hit point.
+    RayCone cone;
+};
+
+// A hit of PathIntegrator, unpacked from its PTRayPayload.
+struct PathVertex {
     bool hit;
+    float3 p;
+    float3 shadingNormal;
+    float3 wi;
+    float3 weight;
+    uint bxdfType;
+    float3 radiance;
 };
 
-void spawnRay(RayDesc ray, inout SurfaceInteraction si, uint randSeed, uint2 pixelIndex) {
+void spawnRay(RayDesc ray, out PathVertex v, uint sampleIndex, uint bounce, uint lightSampleCount, uint2 pixelIndex, inout RayCone cone) {
     PTRayPayload payload;
-    payload.randSeed = randSeed;
-    payload.pixelIndex = pixelIndex;
-    payload.hit = false;
+    payload.sampleIndex = sampleIndex;
+    payload.pixel = pixelIndex.x | (pixelIndex.y << 16);
+    payload.flags = min(bounce, PT_PAYLOAD_BOUNCE_MASK) | (min(lightSampleCount, PT_PAYLOAD_LIGHT_SAMPLES_MASK) << PT_PAYLOAD_LIGHT_SAMPLES_SHIFT);
+    payload.cone = cone;
 
     TraceRay(
         gRtScene,
@@ -33,27 +65,31 @@ void spawnRay(RayDesc ray, inout SurfaceInteraction si, uint randSeed, uint2 pix
         payload,
     );
 
-    si.hit = payload.hit;
-    if (si.hit) {
-        si.p = payload.hitPoint;
-        si.n = payload.normal;
-        si.shadingNormal = payload.shadingNormal;
-        si.wo = gWo[pixelIndex];
-        si.wi = gWi[pixelIndex];
-        si.brdf = gBRDF[pixelIndex].rgb;
-        si.brdfType = gBRDF[pixelIndex].a;
-        si.brdfProbability = gPDF[pixelIndex].y;
-        si.pdf = gPDF[pixelIndex].x;
-        si.directL = gDirectL[pixelIndex].xyz;
-    } else {
-        si.Le = gDirectL[pixelIndex].xyz;
+    v.hit = (payload.flags & PT_PAYLOAD_HIT) != 0;
+    v.radiance = payload.radiance;
+    cone = payload.cone;
+    if (v.hit) {
+        v.p = payload.hitPoint;
+        v.shadingNormal = unpackDirection(payload.shadingNormal);
+        v.wi = unpackDirection(payload.wi);
+        v.weight = unpackHalf3(payload.weight);
+        v.bxdfType = (payload.flags >> PT_PAYLOAD_BXDF_TYPE_SHIFT) & PT_PAYLOAD_BXDF_TYPE_MASK;
     }
 }
 
 [shader("closesthit")]
 void PTClosestHit(inout PTRayPayload payload, BuiltInTriangleIntersectionAttributes attributes) {
     VertexOut vsOut = getVertexAttributes(PrimitiveIndex(), attributes);
-    ShadingData shadingData = prepareShadingData(vsOut, gMaterial, gCamera.posW, 0);
+    uint2 pixelIndex = uint2(payload.pixel & 0xFFFF, payload.pixel >> 16);
+    uint bounce = payload.flags & PT_PAYLOAD_BOUNCE_MASK;
+    uint lightSampleCount = (payload.flags >> PT_PAYLOAD_LIGHT_SAMPLES_SHIFT) & PT_PAYLOAD_LIGHT_SAMPLES_MASK;
+
+    // Sample the material textures at the mip level that matches the footprint of the ray.
+    RayCone coneAtHit = propagateRayCone(payload.cone, 0.0f, RayTCurrent());
+    float lod = computeTextureLOD(coneAtHit, WorldRayDirection(), vsOut.normalW, PrimitiveIndex(), materialTextureDimensions());
+    // The view vector points back along the ray: to the camera of the pixel's view for primary hits,
+    // to the previous vertex for the rest.
+    ShadingData shadingData = prepareShadingData(vsOut, gMaterial, WorldRayOrigin(), lod);
 
     Interaction it;
     it.p = shadingData.posW;
@@ -62,7 +98,7 @@ void PTClosestHit(inout PTRayPayload payload, BuiltInTriangleIntersectionAttribu
     // TODO: when implementing participating media, determine whether this is surface or medium.
     it.isSurfaceInteraction = true;
     it.wo = -normalize(WorldRayDirection());
-    it.pixelIndex = payload.pixelIndex;
+    it.pixelIndex = pixelIndex;
 
     // Prepare BSDFs.
     ComputeScatteringFunctions(it, shadingData, true);
@@ -72,11 +108,29 @@ void PTClosestHit(inout PTRayPayload payload, BuiltInTriangleIntersectionAttribu
     bool handleMedia = false;
     // TODO: remove; not actually using brdfProbability. 
     float brdfProbability = getBRDFProbability(gMaterial, shadingData.V, it.shadingNormal);
+
+    // Only the primary hit, which stays within the pixel's footprint while the camera stays put, goes
+    // through the visibility cache.
+    bool cacheVisibility = false;
+    if (gUseVisibilityCache && bounce == 0) {
+        cacheVisibility = validateVisibilityCache(pixelIndex, it.p, it.n, WorldRayOrigin());
+    }
+
+    // Light sampling and BSDF sampling draw from different dimensions of this vertex.
+    SampleCoordinates sampleCoordinates = makeSampleCoordinates(pixelIndex, payload.sampleIndex, bounce);
+
     // Place the i+1th vertex of the path at a light source by sampling a point on one of them.
     // Compute the radiance contribution of the ith vertex (the current intersection) as a resut
     // of direct lighting from the chosen light source.
-    float3 L = UniformSampleOneLight(it, shadingData, payload.randSeed, brdfProbability, handleMedia);
-    gDirectL[payload.pixelIndex] = L;
+    //
+    // Above the weight window, several light samples are averaged.
+    float3 L = float3(0.0f, 0.0f, 0.0f);
+    for (uint lightSample = 0; lightSample < lightSampleCount; lightSample++) {
+        SampleCoordinates lightSampleCoordinates = sampleCoordinates;
+        lightSampleCoordinates.dimensionOffset = lightSample * RNG_DIM_SPLIT_STRIDE;
+        L += UniformSampleOneLight(it, shadingData, lightSampleCoordinates, brdfProbability, handleMedia, cacheVisibility);
+    }
+    payload.radiance = L / float(max(lightSampleCount, 1));
 
     // Sample the BSDF at the ith vertex to obtain a direction in which to extend the current path
     // of length i to obtain the next path of length i+i.
@@ -84,28 +138,38 @@ void PTClosestHit(inout PTRayPayload payload, BuiltInTriangleIntersectionAttribu
     float3 f = it.bsdf.Sample_f(
         it.wo,
         it.wi,
-        float2(nextRand(payload.randSeed), nextRand(payload.randSeed)),
+        sampleDimension2D(sampleCoordinates, RNG_DIM_BSDF),
         it.pdf,
         bxdfType,
-        payload.pixelIndex
+        pixelIndex
     );
-    gBRDF[payload.pixelIndex] = float4(f, bxdfType);
-    gWo[payload.pixelIndex] = it.wo;
-    gWi[payload.pixelIndex] = it.wi;
-    gPDF[payload.pixelIndex].x = it.pdf;
-    gPDF[payload.pixelIndex].y = brdfProbability;
 
-    payload.hitPoint = vsOut.posW;
-    payload.normal = vsOut.normalW;
-    payload.shadingNormal = shadingData.N;
+    // The throughput factor of the vertex. The |cos(wi, shadingNormal)| factor is the one from the
+    // energy balance form of the LTE and computes the component of irradiance that is perpendicular
+    // to the surface at the hit. Clamped to the largest half.
+    float3 weight = float3(0.0f, 0.0f, 0.0f);
+    if (!IsBlack(f) && it.pdf > 0.0f) {
+        weight = min(f * abs(dot(it.wi, shadingData.N)) / it.pdf, 65504.0f);
+    }
 
-    payload.hit = true;
+    payload.hitPoint = vsOut.posW;
+    payload.shadingNormal = packDirection(shadingData.N);
+    payload.wi = packDirection(it.wi);
+    payload.weight = packHalf3(weight);
+    payload.flags |= PT_PAYLOAD_HIT | ((uint(bxdfType) & PT_PAYLOAD_BXDF_TYPE_MASK) << PT_PAYLOAD_BXDF_TYPE_SHIFT);
+
+    // The cone of the ray that extends the path starts at the hit point and is widened by the
+    // roughness of the surface. A cone with no spread angle (texture LOD disabled) stays that way.
+    payload.cone = coneAtHit;
+    if (payload.cone.spreadAngle > 0.0f) {
+        payload.cone.spreadAngle += roughnessSpreadAngle(shadingData.linearRoughness);
+    }
 
     // Used to detect shading model used by the fscene.
     // if (EXTRACT_SHADING_MODEL(gMaterial.flags) == ShadingModelMetalRough) {
-    //     gLe[payload.pixelIndex] = float3(1.0f, 0.0f, 0.0f);
+    //     gLe[pixelIndex] = float3(1.0f, 0.0f, 0.0f);
     // } else {
-    //     gLe[payload.pixelIndex] = float3(0.0f, 1.0f, 0.0f);
+    //     gLe[pixelIndex] = float3(0.0f, 1.0f, 0.0f);
     // }
 }
 
@@ -122,11 +186,16 @@ void PTMiss(inout PTRayPayload payload) {
 	gEnvMap.GetDimensions(envMapDimensions.x, envMapDimensions.y);
 
 	float2 uv = WorldToLatitudeLongitude(WorldRayDirection());
-    gDirectL[payload.pixelIndex] = gEnvMap[uint2(uv * envMapDimensions)].rgb;
-
-    payload.hit = false;
+    payload.radiance = gEnvMap[uint2(uv * envMapDimensions)].rgb;
 }
 
+// Must match UnidirectionalPathTracingPass::RouletteMode.
+#define ROULETTE_THROUGHPUT 0
+#define ROULETTE_EFFICIENCY 1
+
+// Number of path vertices whose outgoing radiance is fed back to the radiance cache.
+#define MAX_CACHED_VERTICES 16
+
 // PathIntegrator evaluates the path integral form of the light transport equation, or LTE (its other
 // forms, the energy balance form and its surface (3-point) form are much more difficult to
 // evaluate).
@@ -144,7 +213,27 @@ void PTMiss(inout PTRayPayload payload) {
 struct PathIntegrator {
     int maxDepth;
 
-	float3 Li(RayDesc ray, uint randSeed, uint2 pixelIndex) {
+    // ROULETTE_THROUGHPUT: classic Russian roulette on the green channel of the throughput, after
+    // gMinBouncesBeforeRussianRoulette bounces.
+    //
+    // ROULETTE_EFFICIENCY: weight-window roulette in the spirit of Vorba and Krivanek's Adjoint-Driven
+    // Russian Roulette and Splitting (2016). The expected contribution of continuing the path, its
+    // throughput times the radiance cached near the vertex, is compared to the estimate of the pixel:
+    // below the window, the path survives with a probability proportional to it; above the window,
+    // the next vertex takes several light samples (taken by the closest hit shader). This is not the
+    // paper's splitting: the path itself isn't duplicated, since the loop carries a single ray and
+    // throughput, so only direct lighting at that vertex gets the extra samples and indirect
+    // lighting above the window keeps the variance of a single path.
+    uint rouletteMode;
+
+    // Ratio of the upper to the lower bound of the weight window.
+    float weightWindowSize;
+
+    uint maxLightSamples;
+
+    float cacheCellSize;
+
+	float3 Li(RayDesc ray, uint sampleIndex, uint2 pixelIndex, RayCone cone, float pixelEstimate) {
 		// Radiance.
         float3 L = float3(0.f);
 
@@ -172,13 +261,25 @@ struct PathIntegrator {
 
         bool specularBounce = false;
 
+        // Set above the weight window; applies to the next vertex only.
+        uint lightSampleCount = 1;
+
+        // For feeding the radiance cache once the path is done: the cell of each vertex, the
+        // luminance of L before the vertex added anything to it, and the luminance of the
+        // throughput up to the vertex.
+        uint vertexCells[MAX_CACHED_VERTICES];
+        float vertexLBefore[MAX_CACHED_VERTICES];
+        float vertexBeta[MAX_CACHED_VERTICES];
+        uint cachedVertexCount = 0;
+
         for (int bounces = 0; ; ++bounces) {
             // Find next path vertex and accumulate contribution.
 
             // Intersect ray with scene to find next path vertex.
-            SurfaceInteraction si;
-            spawnRay(ray, si, randSeed, pixelIndex);
-            bool foundIntersection = si.hasHit();
+            PathVertex si;
+            spawnRay(ray, si, sampleIndex, bounces, lightSampleCount, pixelIndex, cone);
+            bool foundIntersection = si.hit;
+            lightSampleCount = 1;
 
             // Possibly add emitted light at intersection.
             if (bounces == 0 || specularBounce) {
@@ -195,7 +296,7 @@ struct PathIntegrator {
                     // The camera ray escaped out into the environment. Add the radiance contributions of
                     // infinite area lights (environment maps).
                     // TODO: sample environment map.
-                    L += beta * si.Le;
+                    L += beta * si.radiance;
                 }
             }
 
@@ -207,36 +308,63 @@ struct PathIntegrator {
             
             // TODO: handle media boundaries that don't have BSDFs.
 
+            uint cell = 0;
+            if (rouletteMode == ROULETTE_EFFICIENCY) {
+                cell = radianceCacheCell(si.p, cacheCellSize);
+            }
+            if (rouletteMode == ROULETTE_EFFICIENCY && cachedVertexCount < MAX_CACHED_VERTICES) {
+                vertexCells[cachedVertexCount] = cell;
+                vertexLBefore[cachedVertexCount] = luminance(L);
+                vertexBeta[cachedVertexCount] = luminance(beta);
+                cachedVertexCount++;
+            }
+
             // Place the i+1th vertex of the path at a light source by sampling a point on one of them.
             // Compute the radiance contribution of the ith vertex (the current intersection) as a resut
             // of direct lighting from the chosen light source.
-            L += beta * si.directL;
+            L += beta * si.radiance;
 
             // Sample the BSDF at the ith vertex to obtain a direction in which to extend the current path
             // of length i to obtain the next path of length i+i.
-            float3 wo = si.wo;
-            float3 wi = si.wi;
-            float pdf = si.pdf;
-            float3 f = si.brdf;
-            if (IsBlack(f) || pdf == 0.0f) {
+            // Add throughput weight at current vertex, f * |cos(wi, si.shadingNormal)| / pdf; computed
+            // by the closest hit shader.
+            if (IsBlack(si.weight)) {
                 break;
             }
+            // The cached radiance of the vertex is its outgoing radiance, which already includes its
+            // BSDF; the expected contribution of the rest of the path multiplies it by the throughput
+            // up to the vertex, not past it.
+            float3 betaAtVertex = beta;
+            beta *= si.weight;
 
-            // Add throughput weight at current vertex. The |cos(wi, si.shadingNormal)| factor is the one from the
-            // energy balance form of the LTE and computes the component of irradiance that is perpendicular to
-            // the surface at point si.p.
-            beta *= f * abs(dot(wi, si.shadingNormal)) / pdf;
-
-            specularBounce = si.brdfType == BRDF_SPECULAR;
+            specularBounce = si.bxdfType == BRDF_SPECULAR;
 
             // CPBRT spawns the ray here, but here we do it at the beginning of the loop.
             ray.Origin = offsetRayOrigin(si.p, si.shadingNormal);
-            ray.Direction = wi;
+            ray.Direction = si.wi;
 
             // Terminate path probabilistically via Russian Roulette.
-            if (bounces > gMinBouncesBeforeRussianRoulette) {
+            float cachedRadiance = rouletteMode == ROULETTE_EFFICIENCY ? lookupRadianceCache(cell) : -1.0f;
+            if (cachedRadiance >= 0.0f && pixelEstimate > 0.0f) {
+                // Expected contribution of the rest of the path relative to the pixel's value. The
+                // window is centered on 1, a path that contributes about as much as an average path.
+                float ratio = luminance(betaAtVertex) * cachedRadiance / pixelEstimate;
+                float lowerBound = 2.0f / (1.0f + weightWindowSize);
+                float upperBound = weightWindowSize * lowerBound;
+
+                if (ratio < lowerBound) {
+                    float survivalProbability = max(ratio / lowerBound, 0.02f);
+                    if (sampleDimension(makeSampleCoordinates(pixelIndex, sampleIndex, bounces), RNG_DIM_RUSSIAN_ROULETTE) >= survivalProbability) {
+                        break;
+                    }
+                    beta /= survivalProbability;
+                } else if (ratio > upperBound) {
+                    lightSampleCount = min(uint(ceil(ratio / upperBound)), maxLightSamples);
+                }
+            } else if (bounces > gMinBouncesBeforeRussianRoulette) {
+                // No cached radiance yet (or ROULETTE_THROUGHPUT).
                 float q = max(0.05, 1 - beta.y);
-                if (nextRand(randSeed) < q) {
+                if (sampleDimension(makeSampleCoordinates(pixelIndex, sampleIndex, bounces), RNG_DIM_RUSSIAN_ROULETTE) < q) {
                     break;
                 }
                 beta /= 1 - q;
@@ -267,6 +395,15 @@ struct PathIntegrator {
             }
         }
 
+        // Outgoing radiance of each vertex toward the previous one: everything collected from it
+        // on, undone from the throughput that reached it.
+        float pathL = luminance(L);
+        for (uint v = 0; v < cachedVertexCount; v++) {
+            if (vertexBeta[v] > 0.0f) {
+                addToRadianceCache(vertexCells[v], (pathL - vertexLBefore[v]) / vertexBeta[v]);
+            }
+        }
+
         return L;
 	}
 };
\ No newline at end of file
@@ -0,0 +1,35 @@
+#include "ToneMapping.hlsli"
+
+cbuffer HistogramCB {
+    uint2 gInputSize;
+    float gMinLogLuminance;
+    float gInvLogLuminanceRange;
+}
+
+// The HDR frame.
+Texture2D<float4> gInput;
+
+// HISTOGRAM_BIN_COUNT counters. The exposure shader clears them after reading them.
+RWBuffer<uint> gHistogram;
+
+// Each thread group bins a 16x16 tile into its own histogram in group shared memory, so that the
+// atomics on the global histogram go down from one per pixel to one per bin per tile.
+groupshared uint gsTileHistogram[HISTOGRAM_BIN_COUNT];
+
+[numthreads(16, 16, 1)]
+void main(uint3 dispatchThreadId : SV_DispatchThreadID, uint groupIndex : SV_GroupIndex) {
+    // 256 threads per group, one per bin.
+    gsTileHistogram[groupIndex] = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    if (all(dispatchThreadId.xy < gInputSize)) {
+        float lum = luminance(gInput[dispatchThreadId.xy].rgb);
+        InterlockedAdd(gsTileHistogram[luminanceToBin(lum, gMinLogLuminance, gInvLogLuminanceRange)], 1);
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    uint count = gsTileHistogram[groupIndex];
+    if (count > 0) {
+        InterlockedAdd(gHistogram[groupIndex], count);
+    }
+}
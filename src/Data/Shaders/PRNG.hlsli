@@ -16,4 +16,80 @@ uint initRand(uint val0, uint val1, uint backoff = 16) {
 float nextRand(inout uint s) {
 	s = (1664525u * s + 1013904223u);
 	return float(s & 0x00FFFFFF) / float(0x01000000);
-}
\ No newline at end of file
+}
+
+// Counter-based generator. Where initRand/nextRand produce a sequence whose nth number depends on
+// how many numbers were drawn before it, a counter-based generator hashes the coordinates of the
+// number it's asked for: the pixel, the sample of that pixel, the vertex of the path (bounce) and
+// the dimension of the sample at that vertex. The same coordinates always give the same number,
+// regardless of the order in which they're requested or how the work is split across threads,
+// dispatches, tiles or machines.
+
+// Jarzynski and Olano, Hash Functions for GPU Rendering, JCGT 2020.
+uint4 pcg4d(uint4 v) {
+    v = v * 1664525u + 1013904223u;
+
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+
+    v ^= v >> 16u;
+
+    v.x += v.y * v.w;
+    v.y += v.z * v.x;
+    v.z += v.x * v.y;
+    v.w += v.y * v.z;
+
+    return v;
+}
+
+// Dimensions of the random numbers consumed at a path vertex. 2D samples take two consecutive
+// dimensions. New consumers get new dimensions; reusing one correlates the samples.
+#define RNG_DIM_LENS 0
+#define RNG_DIM_LIGHT_SELECTION 2
+#define RNG_DIM_LIGHT_SAMPLE 3
+#define RNG_DIM_LIGHT_SCATTERING 5
+#define RNG_DIM_BSDF 7
+#define RNG_DIM_RUSSIAN_ROULETTE 9
+#define RNG_DIM_SPECULAR_SELECTION 10
+
+// Repeated samples of the same quantity at the same vertex (e.g. several light samples) offset
+// their dimensions by multiples of this.
+#define RNG_DIM_SPLIT_STRIDE 16
+
+// Everything but the dimension of a random number.
+struct SampleCoordinates {
+    uint2 pixel;
+    // For one sample per pixel per frame, the frame count.
+    uint sampleIndex;
+    // Path vertex: 0 for the camera and the primary hit, i for the ith bounce.
+    uint bounce;
+    // Added to every dimension; see RNG_DIM_SPLIT_STRIDE.
+    uint dimensionOffset;
+};
+
+SampleCoordinates makeSampleCoordinates(uint2 pixel, uint sampleIndex, uint bounce) {
+    SampleCoordinates coordinates;
+    coordinates.pixel = pixel;
+    coordinates.sampleIndex = sampleIndex;
+    coordinates.bounce = bounce;
+    coordinates.dimensionOffset = 0;
+    return coordinates;
+}
+
+uint4 hashSampleCoordinates(SampleCoordinates coordinates, uint dimension) {
+    // 16 bits for the bounce and 16 for the dimension are more than enough for either.
+    dimension += coordinates.dimensionOffset;
+    return pcg4d(uint4(coordinates.pixel, coordinates.sampleIndex, (coordinates.bounce << 16) | (dimension & 0xFFFF)));
+}
+
+// Uniform in [0,1). 24 bits, like nextRand.
+float sampleDimension(SampleCoordinates coordinates, uint dimension) {
+    return float(hashSampleCoordinates(coordinates, dimension).x >> 8) / float(0x01000000);
+}
+
+// Dimensions dimension and dimension + 1.
+float2 sampleDimension2D(SampleCoordinates coordinates, uint dimension) {
+    return float2(sampleDimension(coordinates, dimension), sampleDimension(coordinates, dimension + 1));
+}
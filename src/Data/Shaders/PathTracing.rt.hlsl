@@ -12,27 +12,45 @@ import BRDF;
 #include "AlphaTesting.hlsli"
 #include "PRNG.hlsli"
 #include "Sampling.hlsli"
+#include "RayCones.hlsli"
 #include "FresnelEquations.hlsli"
 #include "Distributions/Distribution.hlsli"
 #include "BxDFs/BxDF.hlsli"
 #include "BSDF.hlsli"
 #include "Light.hlsli"
+#include "VisibilityCache.hlsli"
+#include "ShadowMaps.hlsli"
 #include "Integrator.hlsli"
+#include "RadianceCache.hlsli"
 #include "Integrators/Path.hlsli"
 
 Texture2D<float4> gWsPos;
 Texture2D<float4> gWsNorm;
 Texture2D<float4> gWsShadingNorm;
+Texture2D<float4> gRayCone;
 RWTexture2D<float4> gRayOriginOnLens;
 RWTexture2D<float4> gPrimaryRayDirection;
 RWTexture2D<float4> gOutput;
 
+// Running statistics of the luminance of the pixel's samples: mean, mean of the squares and the
+// number of samples (capped, so old samples fade out).
+RWTexture2D<float4> gPixelEstimate;
+
 cbuffer RayGenCB {
-    uint gFrameCount;
+    // The pixel's samples of this frame are gFirstSampleIndex to gFirstSampleIndex + gSamplesPerPixel - 1.
+    uint gFirstSampleIndex;
+    uint gSamplesPerPixel;
     uint gMaxBounces;
     uint gMinBouncesBeforeRussianRoulette;
     float gTMin;
     float gTMax;
+    uint gRouletteMode;
+    float gWeightWindowSize;
+    uint gMaxLightSamples;
+    float gCacheCellSize;
+    // Discards gPixelEstimate (camera moved, scene changed).
+    bool gResetPixelEstimate;
+    uint gMaxPixelEstimateSamples;
 }
 
 [shader("raygeneration")]
@@ -40,9 +58,6 @@ void PathTracingRayGen() {
     uint2 pixelIndex = DispatchRaysIndex().xy;
     uint2 pixelCount = DispatchRaysDimensions().xy;
 
-    uint frameCount = gFrameCount;
-    uint randSeed = initRand(pixelIndex.x + pixelIndex.y * pixelCount.x, frameCount, 16);
-
     // Reconstruct the primary ray used to populate the G-Buffer.
 	RayDesc primaryRay;
 	primaryRay.Origin = gRayOriginOnLens[pixelIndex].xyz;
@@ -54,9 +69,35 @@ void PathTracingRayGen() {
 	primaryRay.TMin = 0.0f;
 	primaryRay.TMax = 1e+38f;
 
+    // Continue the cone of the primary ray traced by the G-Buffer pass. Its spread angle is 0 when
+    // texture LOD is disabled.
+    RayCone cone;
+    cone.width = 0.0f;
+    cone.spreadAngle = gRayCone[pixelIndex].y;
+
+    float4 estimate = gResetPixelEstimate ? float4(0.0f, 0.0f, 0.0f, 0.0f) : gPixelEstimate[pixelIndex];
+
     PathIntegrator integrator;
     integrator.maxDepth = gMaxBounces;
-    float3 L = integrator.Li(primaryRay, randSeed, pixelIndex);
+    integrator.rouletteMode = gRouletteMode;
+    integrator.weightWindowSize = gWeightWindowSize;
+    integrator.maxLightSamples = gMaxLightSamples;
+    integrator.cacheCellSize = gCacheCellSize;
+
+    // gSamplesPerPixel paths per frame, all from the primary hit of the G-Buffer. Every random
+    // number of a path is addressed by (pixel, sample, bounce, dimension); see SampleCoordinates.
+    float3 sum = float3(0.0f, 0.0f, 0.0f);
+    for (uint i = 0; i < gSamplesPerPixel; i++) {
+        float3 L = integrator.Li(primaryRay, gFirstSampleIndex + i, pixelIndex, cone, estimate.z > 0.0f ? estimate.x : -1.0f);
+        sum += L;
+
+        float lum = luminance(L);
+        float n = min(estimate.z, float(gMaxPixelEstimateSamples));
+        estimate.x = (n * estimate.x + lum) / (n + 1.0f);
+        estimate.y = (n * estimate.y + lum * lum) / (n + 1.0f);
+        estimate.z = n + 1.0f;
+    }
 
-    gOutput[pixelIndex] = float4(L, 1.0f);
+    gOutput[pixelIndex] = float4(sum / float(max(gSamplesPerPixel, 1)), 1.0f);
+    gPixelEstimate[pixelIndex] = estimate;
 }
\ No newline at end of file
@@ -0,0 +1,3 @@
+// PathTracing.rt.hlsl specialized for a BSDF made of all the BxDFs (see BSDF.hlsli).
+#define BSDF_COMPONENTS (BSDF_HAS_DIFFUSE | BSDF_HAS_SPECULAR | BSDF_HAS_GLOSSY)
+#include "PathTracing.rt.hlsl"
\ No newline at end of file
@@ -0,0 +1,3 @@
+// PathTracing.rt.hlsl specialized for a BSDF made of the Lambertian BRDF only (see BSDF.hlsli).
+#define BSDF_COMPONENTS BSDF_HAS_DIFFUSE
+#include "PathTracing.rt.hlsl"
\ No newline at end of file
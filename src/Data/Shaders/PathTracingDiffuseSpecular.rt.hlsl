@@ -0,0 +1,3 @@
+// PathTracing.rt.hlsl specialized for a BSDF made of Lambertian and perfectly specular BRDFs (see BSDF.hlsli).
+#define BSDF_COMPONENTS (BSDF_HAS_DIFFUSE | BSDF_HAS_SPECULAR)
+#include "PathTracing.rt.hlsl"
\ No newline at end of file
@@ -0,0 +1,47 @@
+// First half of the rasterized pinhole G-Buffer: writes the primary ray of every pixel and, for the
+// pixels no geometry will cover, the background that PrimaryMiss would have written. The
+// rasterized geometry overwrites MaterialDiffuse where it's visible.
+#include "Constants.hlsli"
+#include "PRNG.hlsli"
+#include "Sampling.hlsli"
+
+cbuffer BackgroundCB {
+	// Camera basis, as in ThinLensGBufferRayGen.
+	float3 gCameraPos;
+	float3 gCameraU;
+	float3 gCameraV;
+	float3 gCameraW;
+	float2 gPixelJitter;
+	uint2 gRenderSize;
+	float3 gBgColor;
+	bool gUseEnvMap;
+};
+
+Texture2D<float4> gEnvMap;
+
+struct BackgroundOutput {
+	float4 rayOriginOnLens : SV_Target0;
+	float4 primaryRayDirection : SV_Target1;
+	float4 matDif : SV_Target2;
+};
+
+BackgroundOutput main(float2 texC : TEXCOORD, float4 pos : SV_POSITION) {
+	// The same ray ThinLensGBufferRayGen generates with a lens radius of 0.
+	float2 pixelCenter = (floor(pos.xy) + 0.5f + gPixelJitter) / float2(gRenderSize);
+	float2 ndc = float2(2, -2) * pixelCenter + float2(-1, 1);
+	float3 direction = normalize(ndc.x*gCameraU + ndc.y*gCameraV + gCameraW);
+
+	BackgroundOutput output;
+	output.rayOriginOnLens = float4(gCameraPos, 0.0f);
+	output.primaryRayDirection = float4(direction, 1.0f);
+
+	if (gUseEnvMap) {
+		float2 envMapDimensions;
+		gEnvMap.GetDimensions(envMapDimensions.x, envMapDimensions.y);
+		float2 uv = WorldToLatitudeLongitude(direction);
+		output.matDif = float4(gEnvMap[uint2(uv * envMapDimensions)].rgb, 1.0f);
+	} else {
+		output.matDif = float4(gBgColor, 1.0f);
+	}
+	return output;
+}
\ No newline at end of file
@@ -0,0 +1,64 @@
+// Rasterized alternative to ThinLensGBufferRayGen for the pinhole camera, whose primary rays all
+// share an origin and can be resolved by the rasterizer instead of by BVH traversal. Writes the same
+// G-Buffer channels as PrimaryClosestHit.
+//
+// Compiled twice. With DEPTH_PREPASS, it only alpha tests, so that the depth buffer ends up with
+// the visible surface of every pixel; the G-Buffer pass then runs with an EQUAL depth test and
+// evaluates each pixel's material exactly once, like the shading pass of a visibility buffer.
+import ShaderCommon;
+import Shading;
+import DefaultVS;
+
+cbuffer GBufferCB {
+	bool gUseTextureLOD;
+	// Vertical resolution the spread angle of primary rays is computed for.
+	uint gTextureLODHeight;
+};
+
+#ifdef DEPTH_PREPASS
+
+void main(VertexOut vsOut) {
+	ShadingData shadeData = prepareShadingData(vsOut, gMaterial, gCamera.posW, 0.0f);
+	if (shadeData.opacity < gMaterial.alphaThreshold) {
+		discard;
+	}
+}
+
+#else
+
+struct GBufferOutput {
+	float4 wsPos : SV_Target0;
+	float4 wsNorm : SV_Target1;
+	float4 wsShadingNorm : SV_Target2;
+	float4 matDif : SV_Target3;
+	float4 matSpec : SV_Target4;
+	float4 matExtra : SV_Target5;
+	float4 matEmissive : SV_Target6;
+	float4 rayCone : SV_Target7;
+};
+
+GBufferOutput main(VertexOut vsOut) {
+	// Screen-space derivatives select the mip level, as the ray cone does for ray-traced primaries.
+	ShadingData shadeData = gUseTextureLOD
+		? prepareShadingData(vsOut, gMaterial, gCamera.posW)
+		: prepareShadingData(vsOut, gMaterial, gCamera.posW, 0.0f);
+
+	GBufferOutput output;
+	output.wsPos = float4(vsOut.posW, 1.0f);
+	output.wsNorm = float4(vsOut.normalW, 0.0f);
+	output.wsShadingNorm = float4(shadeData.N, 0.0f);
+	output.matDif = float4(shadeData.diffuse, shadeData.opacity);
+	output.matSpec = float4(shadeData.specular, shadeData.linearRoughness);
+	// Includes Index of Refraction and whether the material is double-sided.
+	output.matExtra = float4(shadeData.IoR, shadeData.doubleSidedMaterial ? 1.f : 0.f, 0.f, 0.f);
+	output.matEmissive = float4(shadeData.emissive, 1.0f);
+
+	// Subsequent passes continue the primary ray's cone; only its spread angle is read (see
+	// pixelSpreadAngle in RayCones.hlsli).
+	float tanHalfFovY = length(gCamera.cameraV) / length(gCamera.cameraW);
+	float spreadAngle = gUseTextureLOD ? atan(2.0f * tanHalfFovY / float(gTextureLODHeight)) : 0.0f;
+	output.rayCone = float4(0.0f, spreadAngle, 0.0f, 0.0f);
+	return output;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,56 @@
+// A coarse world-space radiance cache for guiding Russian roulette and extra light samples (see
+// PathIntegrator::Li). Cells of a uniform grid are hashed into a fixed-size table, without
+// collision resolution: it only needs to tell bright regions from dark ones, cheaply.
+//
+// Every path vertex adds the luminance of the radiance that left it toward the previous vertex
+// (everything the path collected from that vertex on, divided by the throughput up to it) to its
+// cell. A cell's estimate is the mean of what was added to it.
+//
+// The table is a RADIANCE_CACHE_WIDTH x RADIANCE_CACHE_HEIGHT R32Uint texture. Each cell takes 2
+// consecutive texels of a row: the fixed-point sum and the count.
+
+// Must match UnidirectionalPathTracingPass::kRadianceCacheWidth and kRadianceCacheHeight.
+#define RADIANCE_CACHE_WIDTH 1024
+#define RADIANCE_CACHE_HEIGHT 512
+#define RADIANCE_CACHE_CELL_COUNT (RADIANCE_CACHE_WIDTH / 2 * RADIANCE_CACHE_HEIGHT)
+
+// Fixed-point scale of the sums and the largest luminance added per sample, chosen so that a cell
+// can take RADIANCE_CACHE_MAX_COUNT samples without overflowing.
+#define RADIANCE_CACHE_SCALE 64.0f
+#define RADIANCE_CACHE_MAX_LUMINANCE 64.0f
+#define RADIANCE_CACHE_MAX_COUNT 65536
+
+RWTexture2D<uint> gRadianceCache;
+
+uint radianceCacheCell(float3 p, float cellSize) {
+    int3 cell = int3(floor(p / cellSize));
+    return pcg4d(uint4(asuint(cell), 0x5bd1e995u)).x % RADIANCE_CACHE_CELL_COUNT;
+}
+
+uint2 radianceCacheTexel(uint cell) {
+    uint cellsPerRow = RADIANCE_CACHE_WIDTH / 2;
+    return uint2(2 * (cell % cellsPerRow), cell / cellsPerRow);
+}
+
+// Mean luminance cached for the cell, or a negative value if nothing was cached for it yet.
+float lookupRadianceCache(uint cell) {
+    uint2 texel = radianceCacheTexel(cell);
+    uint count = gRadianceCache[texel + uint2(1, 0)];
+    if (count == 0) {
+        return -1.0f;
+    }
+
+    return float(gRadianceCache[texel]) / (RADIANCE_CACHE_SCALE * float(count));
+}
+
+void addToRadianceCache(uint cell, float luminance) {
+    uint2 texel = radianceCacheTexel(cell);
+    // Converged enough; also keeps the sum from overflowing.
+    if (gRadianceCache[texel + uint2(1, 0)] >= RADIANCE_CACHE_MAX_COUNT) {
+        return;
+    }
+
+    uint fixedPoint = uint(clamp(luminance, 0.0f, RADIANCE_CACHE_MAX_LUMINANCE) * RADIANCE_CACHE_SCALE);
+    InterlockedAdd(gRadianceCache[texel], fixedPoint);
+    InterlockedAdd(gRadianceCache[texel + uint2(1, 0)], 1);
+}
@@ -0,0 +1,92 @@
+// Ray cones for texture level of detail selection. See Ray Tracing Gems Ch. 20: Texture Level of
+// Detail Strategies for Real-Time Ray Tracing.
+//
+// A ray cone approximates the footprint of a ray: its width at the origin and its spread angle.
+// The footprint widens as the ray travels and as it bounces off of curved or rough surfaces. At
+// each hit, the width of the footprint relative to the size of the texels of the hit triangle
+// gives the mip level to sample its textures from; sampling the full-resolution level for every
+// hit, regardless of the footprint, aliases and fetches much more texture memory than necessary.
+struct RayCone {
+    float width;
+    float spreadAngle;
+};
+
+// The spread angle of the cone of a primary ray that covers exactly one pixel of a camera whose
+// V vector is scaled by tan(fovY/2) relative to its W vector (see ThinLensGBufferRayGen).
+float pixelSpreadAngle(float3 cameraV, float3 cameraW, float pixelCountY) {
+    float tanHalfFovY = length(cameraV) / length(cameraW);
+    return atan(2.0f * tanHalfFovY / pixelCountY);
+}
+
+float pixelSpreadAngle(uint pixelCountY) {
+    return pixelSpreadAngle(gCamera.cameraV, gCamera.cameraW, float(pixelCountY));
+}
+
+RayCone primaryRayCone(uint pixelCountY) {
+    RayCone cone;
+    cone.width = 0.0f;
+    cone.spreadAngle = pixelSpreadAngle(pixelCountY);
+    return cone;
+}
+
+// Widens the cone to the hit point at distance hitT and adds the spread caused by the surface.
+RayCone propagateRayCone(RayCone cone, float surfaceSpreadAngle, float hitT) {
+    RayCone newCone;
+    newCone.width = cone.spreadAngle * hitT + cone.width;
+    newCone.spreadAngle = cone.spreadAngle + surfaceSpreadAngle;
+    return newCone;
+}
+
+// Approximates the spread added by a glossy or diffuse bounce. A perfect mirror doesn't widen the
+// cone, a rough surface widens it roughly in proportion to the width of its lobe.
+float roughnessSpreadAngle(float linearRoughness) {
+    return linearRoughness * linearRoughness * M_PI_2;
+}
+
+// The base LOD of a triangle: half the log2 of the ratio of its texel area to its world-space area.
+float triangleLODConstant(uint triangleIndex, float2 textureDimensions) {
+    uint3 indices = getIndices(triangleIndex);
+
+    float3x4 objectToWorld = ObjectToWorld3x4();
+    float3 p0 = mul(objectToWorld, float4(gPositions[indices.x], 1.0f));
+    float3 p1 = mul(objectToWorld, float4(gPositions[indices.y], 1.0f));
+    float3 p2 = mul(objectToWorld, float4(gPositions[indices.z], 1.0f));
+
+    float2 uv0 = gTexCrds[indices.x];
+    float2 uv1 = gTexCrds[indices.y];
+    float2 uv2 = gTexCrds[indices.z];
+
+    float worldArea = length(cross(p1 - p0, p2 - p0));
+    float2 uv10 = uv1 - uv0;
+    float2 uv20 = uv2 - uv0;
+    float texelArea = textureDimensions.x * textureDimensions.y * abs(uv10.x * uv20.y - uv20.x * uv10.y);
+
+    if (worldArea <= 0.0f || texelArea <= 0.0f) {
+        return 0.0f;
+    }
+
+    return 0.5f * log2(texelArea / worldArea);
+}
+
+// Mip level for sampling the textures of the current hit. A cone of width 0 (no spread angle)
+// always selects the full-resolution level.
+float computeTextureLOD(RayCone coneAtHit, float3 rayDirection, float3 normal, uint triangleIndex, float2 textureDimensions) {
+    float cosTheta = abs(dot(normalize(rayDirection), normal));
+    if (coneAtHit.width <= 0.0f || cosTheta <= 0.0f) {
+        return 0.0f;
+    }
+
+    float lod = triangleLODConstant(triangleIndex, textureDimensions)
+        + log2(abs(coneAtHit.width))
+        - log2(cosTheta);
+
+    return max(lod, 0.0f);
+}
+
+// The dimensions of the base color texture of the current material. Textures of the other
+// material channels usually have the same dimensions, so this determines the LOD of all of them.
+float2 materialTextureDimensions() {
+    float2 dimensions;
+    gMaterial.resources.baseColor.GetDimensions(dimensions.x, dimensions.y);
+    return max(dimensions, float2(1.0f, 1.0f));
+}
@@ -59,6 +59,15 @@ float3 CosineSampleHemisphere(float2 u) {
 	return float3(d.x, d.y, z);
 }
 
+// Maps a uniformly distributed random point on the unit square to a direction distributed uniformly
+// over the unit sphere; its pdf is 1 / (4 * pi).
+float3 UniformSampleSphere(float2 u) {
+	float z = 1.f - 2.f * u.x;
+	float r = sqrt(max(0.f, 1.f - z * z));
+	float phi = 2.f * M_PI * u.y;
+	return float3(r * cos(phi), r * sin(phi), z);
+}
+
 // Uniform sampling of the hemisphere of directions.
 float3 getUniformHemisphereSample(inout uint seed, float3 hitNormal) {
 	float2 randVal = float2(nextRand(seed), nextRand(seed));
@@ -0,0 +1,107 @@
+// Visibility of the scene's directional light from cascaded shadow maps (ShadowCascades), instead
+// of, or before, a shadow ray.
+//
+// SHADOW_MODE_RAYS traces a shadow ray from every shaded point, as before. SHADOW_MODE_MAP filters
+// the tightest cascade that covers the point with PCF and only traces outside the cascades. SHADOW_MODE_HYBRID trusts
+// the map only where every PCF tap agrees (fully lit or fully shadowed) and traces a ray for the
+// penumbrae, where the map's resolution and bias errors concentrate, and for points outside every
+// cascade.
+
+#define SHADOW_MAP_MAX_CASCADES 4
+
+// Must match ShadowMode in the passes.
+#define SHADOW_MODE_RAYS 0
+#define SHADOW_MODE_MAP 1
+#define SHADOW_MODE_HYBRID 2
+
+// Half the width of the PCF kernel, in taps. Each tap is a bilinear comparison of 2x2 texels.
+#define SHADOW_MAP_PCF_RADIUS 1
+
+Texture2DArray<float> gShadowMap;
+SamplerComparisonState gShadowMapSampler;
+
+// [0] lookups resolved by the map, [1] lookups that fell back to a ray, [2] sum of the absolute
+// difference between the map's visibility and a reference ray's, in 1/1024ths, [3] lookups compared.
+// Only bound on the frames the statistics are collected.
+RWTexture2D<uint> gShadowMapStats;
+
+cbuffer ShadowMapCB {
+    float4x4 gCascadeViewProj[SHADOW_MAP_MAX_CASCADES];
+    // World-space texel size of each cascade.
+    float4 gCascadeTexelSize;
+    uint gShadowMode;
+    uint gCascadeCount;
+    // Index of the directional light in gLights, or -1 if the scene has none.
+    int gShadowMapLight;
+    float gShadowMapResolution;
+};
+
+bool shadowMapStatsBound() {
+    uint width, height;
+    gShadowMapStats.GetDimensions(width, height);
+    return width != 0;
+}
+
+// Fraction of the PCF kernel around p, offset along n to keep surfaces from shadowing themselves,
+// that the light reaches. False if no cascade covers p.
+bool shadowMapVisibility(float3 p, float3 n, out float visibility, out bool penumbra) {
+    visibility = 1.0f;
+    penumbra = false;
+
+    float margin = (SHADOW_MAP_PCF_RADIUS + 1) / gShadowMapResolution;
+    for (uint cascade = 0; cascade < gCascadeCount; cascade++) {
+        float3 offsetP = p + n * (1.5f * gCascadeTexelSize[cascade]);
+        float4 posL = mul(float4(offsetP, 1.0f), gCascadeViewProj[cascade]);
+        float3 ndc = posL.xyz / posL.w;
+        float2 uv = ndc.xy * float2(0.5f, -0.5f) + 0.5f;
+
+        if (any(uv < margin) || any(uv > 1.0f - margin) || ndc.z < 0.0f || ndc.z > 1.0f) {
+            continue;
+        }
+
+        float lit = 0.0f;
+        uint litTaps = 0;
+        for (int y = -SHADOW_MAP_PCF_RADIUS; y <= SHADOW_MAP_PCF_RADIUS; y++) {
+            for (int x = -SHADOW_MAP_PCF_RADIUS; x <= SHADOW_MAP_PCF_RADIUS; x++) {
+                float2 tapUV = uv + float2(x, y) / gShadowMapResolution;
+                float tap = gShadowMap.SampleCmpLevelZero(gShadowMapSampler, float3(tapUV, cascade), ndc.z);
+                lit += tap;
+                litTaps += (tap > 0.0f) ? 1 : 0;
+                penumbra = penumbra || (tap > 0.0f && tap < 1.0f);
+            }
+        }
+
+        const uint tapCount = (2 * SHADOW_MAP_PCF_RADIUS + 1) * (2 * SHADOW_MAP_PCF_RADIUS + 1);
+        visibility = lit / tapCount;
+        penumbra = penumbra || (litTaps != 0 && litTaps != tapCount);
+        return true;
+    }
+
+    return false;
+}
+
+// Visibility of the directional light from it.p in SHADOW_MODE_MAP and SHADOW_MODE_HYBRID, with
+// the shadow ray traced only where the mode calls for it.
+float directionalLightVisibility(VisibilityTester visibility, Interaction it) {
+    float mapVisibility;
+    bool penumbra;
+    bool covered = shadowMapVisibility(it.p, it.n, mapVisibility, penumbra);
+    bool resolved = covered && (gShadowMode == SHADOW_MODE_MAP || !penumbra);
+
+    bool collectStats = shadowMapStatsBound();
+    if (collectStats) {
+        InterlockedAdd(gShadowMapStats[uint2(resolved ? 0 : 1, 0)], 1);
+    }
+
+    if (!resolved) {
+        return visibility.Unoccluded() ? 1.0f : 0.0f;
+    }
+
+    if (collectStats) {
+        float reference = visibility.Unoccluded() ? 1.0f : 0.0f;
+        InterlockedAdd(gShadowMapStats[uint2(2, 0)], uint(abs(mapVisibility - reference) * 1024.0f + 0.5f));
+        InterlockedAdd(gShadowMapStats[uint2(3, 0)], 1);
+    }
+
+    return mapVisibility;
+}
\ No newline at end of file
@@ -0,0 +1,129 @@
+cbuffer UpscalingCB {
+    // Size of the region of gInput that was rendered, and of the output.
+    uint2 gRenderSize;
+    uint2 gOutputSize;
+    // Subpixel offset of this frame's samples, in render pixels; sample (i, j) was taken at
+    // (i + 0.5, j + 0.5) + gJitter.
+    float2 gJitter;
+    // Basis of this frame's and the previous frame's camera, without jitter, as in
+    // ThinLensGBuffer.rt.hlsl's ray generation.
+    float3 gCameraPos;
+    float3 gCameraU;
+    float3 gCameraV;
+    float3 gCameraW;
+    float3 gPrevCameraPos;
+    float3 gPrevCameraU;
+    float3 gPrevCameraV;
+    float3 gPrevCameraW;
+    // Minimum weight of the current frame.
+    float gBlendFactor;
+    // Width of the history clamping box, in standard deviations of the neighborhood.
+    float gClampGamma;
+    bool gHistoryValid;
+    // The camera hasn't moved since the last frame. The current frame is then output as is, leaving
+    // its accumulation to a later accumulation pass, which weighs each frame by its sample count.
+    bool gCameraStatic;
+    // Without it, the history is read at the same pixel; for frames with several views, whose
+    // cameras aren't tracked.
+    bool gReprojectHistory;
+}
+
+// Low-resolution frame, in the top-left gRenderSize region.
+Texture2D<float4> gInput;
+// G-Buffer, at the render resolution.
+Texture2D<float4> gWsPos;
+// Last frame's output; alpha is the number of frames accumulated in it.
+Texture2D<float4> gHistory;
+
+// Falloff of a sample's weight with its distance to the output pixel center, in render pixels.
+// Approximates a Blackman-Harris window of width 3.
+float sampleWeight(float2 offset) {
+    return exp(-2.29f * dot(offset, offset));
+}
+
+// Where the point (or, for directions, the point at infinity) was on last frame's screen, in [0,1]^2.
+// Inverts the ray generation of ThinLensGBuffer.rt.hlsl, whose unnormalized ray direction is
+// ndc.x * U + ndc.y * V + W.
+bool projectToPreviousFrame(float3 d, out float2 uv) {
+    float w = dot(d, gPrevCameraW) / dot(gPrevCameraW, gPrevCameraW);
+    float2 ndc = float2(
+        dot(d, gPrevCameraU) / dot(gPrevCameraU, gPrevCameraU),
+        dot(d, gPrevCameraV) / dot(gPrevCameraV, gPrevCameraV)
+    ) / w;
+    uv = float2(ndc.x + 1.0f, 1.0f - ndc.y) * 0.5f;
+    return w > 0.0f && all(uv >= 0.0f) && all(uv <= 1.0f);
+}
+
+float4 sampleHistory(float2 uv) {
+    float2 p = uv * gOutputSize - 0.5f;
+    int2 p0 = int2(floor(p));
+    float2 f = p - p0;
+
+    int2 maxPixel = int2(gOutputSize) - 1;
+    float4 h00 = gHistory[clamp(p0, 0, maxPixel)];
+    float4 h10 = gHistory[clamp(p0 + int2(1, 0), 0, maxPixel)];
+    float4 h01 = gHistory[clamp(p0 + int2(0, 1), 0, maxPixel)];
+    float4 h11 = gHistory[clamp(p0 + int2(1, 1), 0, maxPixel)];
+    return lerp(lerp(h00, h10, f.x), lerp(h01, h11, f.x), f.y);
+}
+
+float4 main(float2 texC : TEXCOORD, float4 pos : SV_POSITION) : SV_Target0 {
+    uint2 outputPixel = uint2(pos.xy);
+
+    // Output pixel center in render pixels, and the render pixel whose sample is closest to it.
+    float2 p = (outputPixel + 0.5f) * float2(gRenderSize) / float2(gOutputSize);
+    int2 maxPixel = int2(gRenderSize) - 1;
+    int2 nearest = clamp(int2(floor(p - gJitter)), 0, maxPixel);
+
+    // Current frame: the jittered samples around the pixel, weighted by their distance to its
+    // center. Their mean and standard deviation bound the history.
+    float3 current = float3(0, 0, 0);
+    float weightSum = 0.0f;
+    float3 m1 = float3(0, 0, 0);
+    float3 m2 = float3(0, 0, 0);
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            int2 samplePixel = clamp(nearest + int2(x, y), 0, maxPixel);
+            float3 c = gInput[samplePixel].rgb;
+            float w = sampleWeight(p - (samplePixel + 0.5f + gJitter));
+
+            current += w * c;
+            weightSum += w;
+            m1 += c;
+            m2 += c * c;
+        }
+    }
+    current /= max(weightSum, 1e-5f);
+
+    if (gCameraStatic) {
+        return float4(current, 1.0f);
+    }
+
+    float3 mean = m1 / 9.0f;
+    float3 sigma = sqrt(max(m2 / 9.0f - mean * mean, 0.0f));
+    float3 boxMin = mean - gClampGamma * sigma;
+    float3 boxMax = mean + gClampGamma * sigma;
+
+    // Reproject the output pixel center: the unjittered ray through it, at the distance of the
+    // surface seen by the nearest sample. Background pixels reproject along that ray's direction.
+    float2 centerNdc = float2(2, -2) * (outputPixel + 0.5f) / float2(gOutputSize) + float2(-1, 1);
+    float3 centerDirection = normalize(centerNdc.x * gCameraU + centerNdc.y * gCameraV + gCameraW);
+    float4 worldPos = gWsPos[nearest];
+    float3 d = worldPos.w != 0.0f
+        ? gCameraPos + centerDirection * distance(worldPos.xyz, gCameraPos) - gPrevCameraPos
+        : centerDirection;
+
+    float2 prevUV = (outputPixel + 0.5f) / float2(gOutputSize);
+    if (!gHistoryValid || (gReprojectHistory && !projectToPreviousFrame(d, prevUV))) {
+        return float4(current, 1.0f);
+    }
+
+    float4 history = sampleHistory(prevUV);
+    // Disoccluded or changed surfaces fall outside the box; clamping keeps their old color from
+    // ghosting.
+    float3 clampedHistory = clamp(history.rgb, boxMin, boxMax);
+
+    float frameCount = history.a;
+    float alpha = max(1.0f / (frameCount + 1.0f), gBlendFactor);
+    return float4(lerp(clampedHistory, current, alpha), min(frameCount + 1.0f, 255.0f));
+}
\ No newline at end of file
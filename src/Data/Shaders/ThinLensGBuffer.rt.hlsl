@@ -6,6 +6,10 @@ import Shading;
 #include "AlphaTesting.hlsli"
 #include "PRNG.hlsli"
 #include "Sampling.hlsli"
+#include "RayCones.hlsli"
+
+// Must match ThinLensGBufferPass::kMaxViews.
+#define MAX_VIEWS 8
 
 // G-Buffer.
 RWTexture2D<float4> gRayOriginOnLens;
@@ -17,6 +21,7 @@ RWTexture2D<float4> gMatDif;
 RWTexture2D<float4> gMatSpec;
 RWTexture2D<float4> gMatExtra;
 RWTexture2D<float4> gMatEmissive;
+RWTexture2D<float4> gRayCone;
 // Environment map;
 Texture2D<float4> gEnvMap;
 
@@ -25,10 +30,25 @@ cbuffer RayGenCB {
 	float gFocalLength;
 	float gLensRadius;
 	uint gFrameCount;
+	bool gUseTextureLOD;
+	// Vertical resolution the spread angle of primary rays is computed for.
+	uint gTextureLODHeight;
+	// Multi-view: with more than one view, the image is split into a gViewGrid of tiles, row by
+	// row, each rendered from the camera of the next view (wrapping around if there are more tiles
+	// than views). All views trace through the same acceleration structure in a single dispatch,
+	// so rays of different views are interleaved in the same waves.
+	uint gViewCount;
+	uint2 gViewGrid;
+	// Camera bases of the views, as gCamera's posW, cameraU, cameraV and cameraW.
+	float4 gViewPos[MAX_VIEWS];
+	float4 gViewU[MAX_VIEWS];
+	float4 gViewV[MAX_VIEWS];
+	float4 gViewW[MAX_VIEWS];
 };
 
 struct RayPayload {
-	bool dummyValue;
+	// Footprint of the primary ray; selects the mip level of the material textures at the hit.
+	RayCone cone;
 };
 
 [shader("raygeneration")]
@@ -41,37 +61,61 @@ void ThinLensGBufferRayGen() {
 	// to RayLaunch::execute()'s 2nd parameter: the total number of pixels.
 	uint2 pixelCount = DispatchRaysDimensions().xy;
 
+	// The camera of this pixel's view; the view's tile is its image.
+	float3 cameraPos = gCamera.posW;
+	float3 cameraU = gCamera.cameraU;
+	float3 cameraV = gCamera.cameraV;
+	float3 cameraW = gCamera.cameraW;
+	uint2 viewPixel = pixelIndex;
+	uint2 viewPixelCount = pixelCount;
+	float lodHeight = float(gTextureLODHeight);
+	if (gViewCount > 1) {
+		// The last row and column of tiles take the pixels left over by the division.
+		uint2 tileSize = pixelCount / gViewGrid;
+		uint2 tile = min(pixelIndex / tileSize, gViewGrid - 1);
+		uint view = (tile.y * gViewGrid.x + tile.x) % gViewCount;
+		viewPixel = pixelIndex - tile * tileSize;
+		viewPixelCount = (tile == gViewGrid - 1) ? pixelCount - tile * tileSize : tileSize;
+		lodHeight *= float(viewPixelCount.y) / float(pixelCount.y);
+
+		cameraPos = gViewPos[view].xyz;
+		cameraV = gViewV[view].xyz;
+		cameraW = gViewW[view].xyz;
+		// The cameras' aspect ratio is the screen's; keep the vertical field of view and widen or
+		// narrow the horizontal one to the tile's.
+		cameraU = normalize(gViewU[view].xyz) * length(cameraV) * (float(viewPixelCount.x) / float(viewPixelCount.y));
+	}
+
 	// The interval [0,1) is subdivided uniformly into subintervals of size 1/pixelCount. pixelIndex
 	// locates the subinterval that corresponds to this pixel. Without jitter, pixelCenter corresponds
-	// to the left endpoint of the subinterval. With gPixelJitter, which is in [-0.5,0.5], the center
-	// moves into the previous subinterval, if negative, or into the subinterval, if positive, by up
-	// to half a pixel.
-	float2 pixelCenter = (pixelIndex + gPixelJitter) / pixelCount;
+	// to the midpoint of the subinterval. With gPixelJitter, which is in [-0.5,0.5], the center
+	// moves anywhere within the subinterval. The TemporalUpscalingPass relies on samples landing at
+	// (pixelIndex + 0.5 + gPixelJitter) / pixelCount.
+	float2 pixelCenter = (viewPixel + 0.5f + gPixelJitter) / viewPixelCount;
 
 	// Map pixelCenter to [-1,1]x[1,-1]. Note that before the y-coordinate transformation, the image is
 	// upside-down.  
 	float2 ndc = float2(2, -2) * pixelCenter + float2(-1, 1);
 
-	// The view space basis is (gCamera.cameraU, gCamera.cameraV, gCamera.cameraW). The primary ray's
-	// direction is a linear combination of this basis with coefficients given by the pixel center's
-	// NDC coordinates.
-	float3 worldSpaceRayDir = ndc.x*gCamera.cameraU + ndc.y*gCamera.cameraV + gCamera.cameraW;
+	// The view space basis is (cameraU, cameraV, cameraW). The primary ray's direction is a linear
+	// combination of this basis with coefficients given by the pixel center's NDC coordinates.
+	float3 worldSpaceRayDir = ndc.x*cameraU + ndc.y*cameraV + cameraW;
 
-	// // Dividing by length(gCamera.cameraW) doesn't change the direction of worldSpaceRayDir, it just
+	// // Dividing by length(cameraW) doesn't change the direction of worldSpaceRayDir, it just
 	// // shortens the vector, making worldSpaceRayDir have length 1 in the camera's w-axis.
-	worldSpaceRayDir /= length(gCamera.cameraW);
+	worldSpaceRayDir /= length(cameraW);
 
 	// The origin of the ray is the camera's world-space position and the focal point lies on the line
 	// along the ray's world-space direction vector, a gFocalLength distance away from the origin. 
-	float3 focalPoint = gCamera.posW + gFocalLength*worldSpaceRayDir;
+	float3 focalPoint = cameraPos + gFocalLength*worldSpaceRayDir;
 
 	// Sample a point on the lens at random, in polar coordinates, (theta, radius) in [0,2PI]x[0,gLensRadius].
 	float PI = 3.14159265f;
-	uint seed = initRand(pixelIndex.x + pixelIndex.y*pixelCount.x, gFrameCount, 16);
-	float2 lensSamplePoint = float2(2*PI*nextRand(seed), gLensRadius*nextRand(seed));
+	float2 u = sampleDimension2D(makeSampleCoordinates(pixelIndex, gFrameCount, 0), RNG_DIM_LENS);
+	float2 lensSamplePoint = float2(2*PI*u.x, gLensRadius*u.y);
 
 	// Move the ray's origin from the world-space position of the camera to the sample point on the lens.
-	float3 rayOriginOnLens = gCamera.posW + lensSamplePoint.y*cos(lensSamplePoint.x)*normalize(gCamera.cameraU) + lensSamplePoint.y*sin(lensSamplePoint.x)*normalize(gCamera.cameraV);
+	float3 rayOriginOnLens = cameraPos + lensSamplePoint.y*cos(lensSamplePoint.x)*normalize(cameraU) + lensSamplePoint.y*sin(lensSamplePoint.x)*normalize(cameraV);
 
 	// The ray.
 	RayDesc ray;
@@ -81,7 +125,13 @@ void ThinLensGBufferRayGen() {
 	// Hits beyond this ray.Origin + ray.TMax*ray.Direction are ignored.
 	ray.TMax = 1e+38f;
 
-	RayPayload payload = {false};
+	RayPayload payload;
+	// A cone with no spread angle always samples the full-resolution mip level.
+	payload.cone.width = 0.0f;
+	payload.cone.spreadAngle = pixelSpreadAngle(cameraV, cameraW, lodHeight);
+	if (!gUseTextureLOD) {
+		payload.cone.spreadAngle = 0.0f;
+	}
 
 	// Store ray origin on lens and direction so that subsequent passes can reconstruct this ray.
 	// Reconstructing the ray from the origin point on the lens and the primary hit point is not
@@ -116,8 +166,14 @@ void PrimaryClosestHit(inout RayPayload payload, BuiltInTriangleIntersectionAttr
     // the identifier of the current primitive.
 	VertexOut vsOut = getVertexAttributes(PrimitiveIndex(), attributes);
 
-	// Supplied by Falcor.
-	ShadingData shadeData = prepareShadingData(vsOut, gMaterial, gCamera.posW, 0);
+	// The footprint of the primary ray at the hit point determines the mip level of the material
+	// textures.
+	RayCone coneAtHit = propagateRayCone(payload.cone, 0.0f, RayTCurrent());
+	float lod = computeTextureLOD(coneAtHit, WorldRayDirection(), vsOut.normalW, PrimitiveIndex(), materialTextureDimensions());
+
+	// Supplied by Falcor. The view vector points back to the ray's origin, which is not the active
+	// camera's position for thin lens samples and the other views.
+	ShadingData shadeData = prepareShadingData(vsOut, gMaterial, WorldRayOrigin(), lod);
 
 	gWsPos[pixelIndex] = float4(vsOut.posW, 1.0f);
 	gWsNorm[pixelIndex] = float4(vsOut.normalW, 0.0f);
@@ -127,6 +183,8 @@ void PrimaryClosestHit(inout RayPayload payload, BuiltInTriangleIntersectionAttr
 	// Includes Index of Refraction and whether the material is double-sided.
 	gMatExtra[pixelIndex] = float4(shadeData.IoR, shadeData.doubleSidedMaterial ? 1.f : 0.f, 0.f, 0.f);
 	gMatEmissive[pixelIndex] = float4(shadeData.emissive, 1.0f);
+	// Subsequent passes continue the primary ray's cone from here.
+	gRayCone[pixelIndex] = float4(coneAtHit.width, coneAtHit.spreadAngle, lod, 0.0f);
 }
 
 [shader("anyhit")]
@@ -0,0 +1,25 @@
+// Shared by the luminance histogram, exposure and tone mapping shaders of the ToneMappingPass.
+
+// Must match ToneMappingPass::kHistogramBinCount and the thread group size of the histogram and
+// exposure shaders (16x16).
+#define HISTOGRAM_BIN_COUNT 256
+
+// Bin 0 holds the pixels that are too dark to have a meaningful log2; they don't vote for the
+// exposure. The remaining bins cover [gMinLogLuminance, gMinLogLuminance + 1/gInvLogLuminanceRange]
+// uniformly in log2 space.
+uint luminanceToBin(float luminance, float minLogLuminance, float invLogLuminanceRange) {
+    if (luminance < 1e-5f) {
+        return 0;
+    }
+
+    float t = saturate((log2(luminance) - minLogLuminance) * invLogLuminanceRange);
+    return uint(t * float(HISTOGRAM_BIN_COUNT - 2) + 1.0f);
+}
+
+float binToLogLuminance(float bin, float minLogLuminance, float logLuminanceRange) {
+    return (bin - 1.0f) / float(HISTOGRAM_BIN_COUNT - 2) * logLuminanceRange + minLogLuminance;
+}
+
+float luminance(float3 color) {
+    return dot(color, float3(0.2126f, 0.7152f, 0.0722f));
+}
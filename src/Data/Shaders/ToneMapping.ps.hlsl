@@ -0,0 +1,107 @@
+#include "ToneMapping.hlsli"
+
+// Must match ToneMappingPass::Operator.
+#define OPERATOR_CLAMP 0
+#define OPERATOR_REINHARD 1
+#define OPERATOR_ACES 2
+#define OPERATOR_AGX 3
+
+cbuffer ToneMappingCB {
+    uint gOperator;
+    bool gAutoExposure;
+    // In stops. Added to the automatic exposure, or the whole exposure when it's manual.
+    float gExposureCompensation;
+    // The luminance that the adapted average luminance is mapped to (middle gray).
+    float gKeyValue;
+    // Reinhard only. The luminance that maps to white.
+    float gWhitePoint;
+}
+
+// The HDR frame.
+Texture2D<float4> gInput;
+
+// 1x1, written by the exposure shader.
+Texture2D<float> gAdaptedLuminance;
+
+// Extended Reinhard, applied to luminance to preserve hue.
+float3 reinhard(float3 color) {
+    float lum = luminance(color);
+    if (lum <= 0.0f) {
+        return float3(0.0f, 0.0f, 0.0f);
+    }
+
+    float mappedLum = lum * (1.0f + lum / (gWhitePoint * gWhitePoint)) / (1.0f + lum);
+    return color * (mappedLum / lum);
+}
+
+// Stephen Hill's fit of the ACES RRT and sRGB ODT.
+float3 aces(float3 color) {
+    // sRGB => XYZ => D65_2_D60 => AP1 => RRT_SAT
+    const float3x3 inputMatrix = float3x3(
+        0.59719f, 0.35458f, 0.04823f,
+        0.07600f, 0.90834f, 0.01566f,
+        0.02840f, 0.13383f, 0.83777f
+    );
+    // ODT_SAT => XYZ => D60_2_D65 => sRGB
+    const float3x3 outputMatrix = float3x3(
+         1.60475f, -0.53108f, -0.07367f,
+        -0.10208f,  1.10813f, -0.00605f,
+        -0.00327f, -0.07276f,  1.07602f
+    );
+
+    color = mul(inputMatrix, color);
+    float3 a = color * (color + 0.0245786f) - 0.000090537f;
+    float3 b = color * (0.983729f * color + 0.4329510f) + 0.238081f;
+    color = mul(outputMatrix, a / b);
+    return saturate(color);
+}
+
+// Minimal AgX (Troy Sobotka's AgX, with Benjamin Wrensch's polynomial fit of the default contrast
+// curve). Returns linear values, like the other operators.
+float3 agx(float3 color) {
+    const float3x3 inset = float3x3(
+        0.842479062253094f, 0.0423282422610123f, 0.0423756549057051f,
+        0.0784335999999992f, 0.878468636469772f, 0.0784336f,
+        0.0792237451477643f, 0.0791661274605434f, 0.879142973793104f
+    );
+    const float3x3 outset = float3x3(
+        1.19687900512017f, -0.0528968517574562f, -0.0529716355144438f,
+        -0.0980208811401368f, 1.15190312990417f, -0.0980434501171241f,
+        -0.0990297440797205f, -0.0989611768448433f, 1.15107367264116f
+    );
+    const float minEv = -12.47393f;
+    const float maxEv = 4.026069f;
+
+    color = mul(color, inset);
+    color = clamp(log2(max(color, 1e-10f)), minEv, maxEv);
+    color = (color - minEv) / (maxEv - minEv);
+
+    float3 x2 = color * color;
+    float3 x4 = x2 * x2;
+    color = 15.5f * x4 * x2 - 40.14f * x4 * color + 31.96f * x4 - 6.868f * x2 * color + 0.4298f * x2 + 0.1191f * color - 0.00232f;
+
+    color = mul(color, outset);
+    return pow(max(color, 0.0f), 2.2f);
+}
+
+float4 main(float2 texC : TEXCOORD, float4 pos : SV_POSITION) : SV_Target0 {
+    float4 hdr = gInput[(uint2) pos.xy];
+
+    float exposure = exp2(gExposureCompensation);
+    if (gAutoExposure) {
+        exposure *= gKeyValue / max(gAdaptedLuminance[uint2(0, 0)], 1e-4f);
+    }
+    float3 color = hdr.rgb * exposure;
+
+    if (gOperator == OPERATOR_REINHARD) {
+        color = reinhard(color);
+    } else if (gOperator == OPERATOR_ACES) {
+        color = aces(color);
+    } else if (gOperator == OPERATOR_AGX) {
+        color = agx(color);
+    } else {
+        color = saturate(color);
+    }
+
+    return float4(color, hdr.a);
+}
@@ -0,0 +1,98 @@
+// Per-pixel cache of the visibility of delta (point and directional) lights from the primary hit.
+//
+// While the camera and the scene stay put, the primary hits of a pixel all land within its
+// footprint, and the visibility of a delta light from them is usually the same: the footprint is
+// either lit or in shadow. The cache is keyed on what survives subpixel jitter: the instance and
+// triangle that were hit, and a position anywhere within gVisibilityCacheTolerance pixel footprints
+// of the first hit the key was made for. A hit that leaves the tolerance (the camera or the scene
+// moved) starts a new key; one on another triangle within it (the footprint straddles an edge)
+// just bypasses the cache.
+//
+// Reusing the first sample's visibility for the whole footprint would alias shadow edges, so each
+// light's shadow rays keep being traced until VISIBILITY_CACHE_MIN_TRACES of them agree. From then
+// on, a light that was always visible or always occluded from the footprint is read from the
+// cache; one that was both is on a shadow edge and keeps being traced. A penumbra narrow enough to
+// be missed by the first traces stays biased, by at most the fraction of the footprint it covers.
+//
+// gVisibilityMask holds, per pixel, a bit per light (the first VISIBILITY_CACHE_MAX_LIGHTS lights)
+// telling whether the light was seen visible (x) and seen occluded (y), and the number of shadow
+// rays traced toward it, a 2-bit saturating counter split across z (low bit) and w (high bit).
+// Scene changes are handled by the passes, which clear the masks.
+
+#define VISIBILITY_CACHE_MAX_LIGHTS 32
+// At most 3, the largest value of the counter.
+#define VISIBILITY_CACHE_MIN_TRACES 3
+
+// xyz: position of the first hit of the key; w: visibilityGeometryKey.
+RWTexture2D<float4> gVisibilityKey;
+RWTexture2D<uint4> gVisibilityMask;
+
+cbuffer VisibilityCacheCB {
+    bool gUseVisibilityCache;
+    // How far a hit may be from the first hit of the key, in pixel footprints, and still share its
+    // cached visibility.
+    float gVisibilityCacheTolerance;
+}
+
+// The instance and triangle of the closest hit being shaded. Only compared, never decoded.
+uint visibilityGeometryKey() {
+    return (InstanceIndex() << 20) ^ PrimitiveIndex();
+}
+
+// Width of the footprint of a pixel of the launch at a hit at distance distanceToHit from the
+// camera, whose surface is at cosTheta to the ray. gCamera's field of view is assumed; the tiles of a
+// multi-view frame have wider pixels, which only makes the tolerance tighter.
+float visibilityPixelFootprint(float distanceToHit, float cosTheta) {
+    float tanHalfFovY = length(gCamera.cameraV) / length(gCamera.cameraW);
+    float pixelAngle = 2.0f * tanHalfFovY / float(DispatchRaysDimensions().y);
+    return distanceToHit * pixelAngle / max(abs(cosTheta), 0.25f);
+}
+
+// Called at the primary hit before any light is sampled. Starts a new key for the pixel if the hit
+// is outside of the footprint of the current one; returns whether the cache may be used for this hit.
+// viewOrigin is the origin of the primary ray: the camera of the pixel's view, which isn't gCamera's
+// for the tiles of a multi-view frame.
+bool validateVisibilityCache(uint2 pixel, float3 p, float3 n, float3 viewOrigin) {
+    float4 key = gVisibilityKey[pixel];
+    uint geometry = visibilityGeometryKey();
+
+    float3 toHit = p - viewOrigin;
+    float distanceToHit = length(toHit);
+    float tolerance = gVisibilityCacheTolerance * visibilityPixelFootprint(distanceToHit, dot(n, toHit / distanceToHit));
+
+    if (distance(key.xyz, p) > tolerance) {
+        gVisibilityKey[pixel] = float4(p, asfloat(geometry));
+        gVisibilityMask[pixel] = uint4(0, 0, 0, 0);
+        return true;
+    }
+
+    return asuint(key.w) == geometry;
+}
+
+// visibility.Unoccluded(), through the cache of the pixel.
+bool cachedUnoccluded(VisibilityTester visibility, uint2 pixel, int lightNum) {
+    uint4 mask = gVisibilityMask[pixel];
+    uint bit = 1u << uint(lightNum);
+    bool seenVisible = (mask.x & bit) != 0;
+    bool seenOccluded = (mask.y & bit) != 0;
+    uint traces = ((mask.z & bit) != 0 ? 1u : 0u) + ((mask.w & bit) != 0 ? 2u : 0u);
+
+    if (traces >= VISIBILITY_CACHE_MIN_TRACES && seenVisible != seenOccluded) {
+        return seenVisible;
+    }
+
+    bool unoccluded = visibility.Unoccluded();
+    if (unoccluded) {
+        mask.x |= bit;
+    } else {
+        mask.y |= bit;
+    }
+    if (traces < 3) {
+        traces++;
+        mask.z = (traces & 1u) != 0 ? mask.z | bit : mask.z & ~bit;
+        mask.w = (traces & 2u) != 0 ? mask.w | bit : mask.w & ~bit;
+    }
+    gVisibilityMask[pixel] = mask;
+
+    return unoccluded;
+}
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "Falcor.h"
+#include "BidirectionalPathTracingPass.h"
+#include "../SharedUtils/ResourceManager.h"
+#include "../SharedUtils/RayLaunch.h"
+
+namespace {
+    const char *kShaderFile = "Shaders\\BidirectionalPathTracing.rt.hlsl";
+    const char *kResolveShader = "Shaders\\BidirectionalResolve.ps.hlsl";
+
+    // Entrypoints.
+    const char *kEntryPointRayGen = "BidirectionalPathTracingRayGen";
+    const char *kEntryPointBDPTClosestHit = "BDPTClosestHit";
+    const char *kEntryPointBDPTAnyHit = "BDPTAnyHit";
+    const char *kEntryPointBDPTMiss = "BDPTMiss";
+    const char *kEntryPointShadowClosestHit = "ShadowClosestHit";
+    const char *kEntryPointShadowAnyHit = "ShadowAnyHit";
+    const char *kEntryPointShadowMiss = "ShadowMiss";
+
+    // Environment map file.
+    const char* kEnvironmentMap = "MonValley_G_DirtRoad_3k.hdr";
+
+    // Radiance of the camera subpaths, before the light tracing splats are added.
+    const char *kCameraPathsChannel = "BidirectionalCameraPaths";
+};
+
+bool BidirectionalPathTracingPass::initialize(RenderContext* pRenderContext, ResourceManager::SharedPtr pResManager) {
+    mpResManager = pResManager;
+
+    mpResManager->requestTextureResource(kCameraPathsChannel, ResourceFormat::RGBA32Float);
+    mpResManager->requestTextureResource(mOutputBuffer, mOutputFormat);
+    // Decoded asynchronously; the first frames render with a placeholder environment.
+    mpEnvMapLoader = EnvironmentMapLoader::get(kEnvironmentMap);
+    mpResManager->setDefaultSceneName("Data/pink_room/pink_room.fscene");
+
+    mpRayTracer = RayLaunch::create(kShaderFile, kEntryPointRayGen);
+    // Ray type / hit group 0: camera and light subpath rays.
+    mpRayTracer->addMissShader(kShaderFile, kEntryPointBDPTMiss);
+    mpRayTracer->addHitShader(kShaderFile, kEntryPointBDPTClosestHit, kEntryPointBDPTAnyHit);
+    // Ray type / hit group 1: shadow rays of the connections.
+    mpRayTracer->addMissShader(kShaderFile, kEntryPointShadowMiss);
+    mpRayTracer->addHitShader(kShaderFile, kEntryPointShadowClosestHit, kEntryPointShadowAnyHit);
+    mpRayTracer->compileRayProgram();
+    if (mpScene) {
+        mpRayTracer->setScene(mpScene);
+    }
+
+    mpResolveShader = FullscreenLaunch::create(kResolveShader);
+    mpGfxState = GraphicsState::create();
+    mpFrameTimer = GpuTimer::create();
+
+    return true;
+}
+
+void BidirectionalPathTracingPass::initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene) {
+    mpScene = std::dynamic_pointer_cast<RtScene>(pScene);
+    if (mpRayTracer) {
+        mpRayTracer->setScene(mpScene);
+    }
+}
+
+void BidirectionalPathTracingPass::execute(RenderContext* pRenderContext) {
+    Texture::SharedPtr cameraPathsTex = mpResManager->getTexture(kCameraPathsChannel);
+    if (!cameraPathsTex || !mpScene || !mpRayTracer || !mpRayTracer->readyToRender()) {
+        return;
+    }
+
+    // Swap in the environment map once it has been decoded; accumulated frames rendered with the
+    // placeholder are discarded.
+    if (mpEnvMapLoader->update(mpResManager)) {
+        setRefreshFlag();
+    }
+
+    // The GPU time of the previous frame is available by now.
+    if (mFrameTimerPending) {
+        float ms = float(mpFrameTimer->getElapsedTime());
+        mMsPerFrame = mMsPerFrame < 0.0f ? ms : glm::mix(mMsPerFrame, ms, 0.05f);
+        if (mpSampleBudget) {
+            mpSampleBudget->addMeasurement(ms, mTimedSamplesPerPixel);
+        }
+        mFrameTimerPending = false;
+    }
+
+    // Paths are traced for the region of the G-Buffer that was rendered.
+    uvec2 screenSize = mpResManager->getScreenSize();
+    uvec2 renderSize = mpRenderScale ? mpRenderScale->getRenderSize(screenSize) : screenSize;
+    if (!mpLightSplats || mpLightSplats->getWidth() != 3 * renderSize.x || mpLightSplats->getHeight() != renderSize.y) {
+        mpLightSplats = Texture::create2D(
+            3 * renderSize.x, renderSize.y, ResourceFormat::R32Uint, 1, 1, nullptr,
+            Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+        );
+    }
+
+    mpFrameTimer->begin();
+    pRenderContext->clearUAV(mpLightSplats->getUAV().get(), uvec4(0));
+
+    auto rayGenVars = mpRayTracer->getRayGenVars();
+    rayGenVars["RayGenCB"]["gSceneCenter"] = mpScene->getCenter();
+    rayGenVars["RayGenCB"]["gSceneRadius"] = mpScene->getRadius();
+    uint32_t samplesPerPixel = mpSampleBudget ? mpSampleBudget->beginFrame() : 1;
+    rayGenVars["RayGenCB"]["gFirstSampleIndex"] = mSampleCount;
+    rayGenVars["RayGenCB"]["gSamplesPerPixel"] = samplesPerPixel;
+    mSampleCount += samplesPerPixel;
+    rayGenVars["RayGenCB"]["gMaxDepth"] = uint32_t(mMaxDepth);
+    rayGenVars["gOutput"] = cameraPathsTex;
+    rayGenVars["gLightSplats"] = mpLightSplats;
+
+    // Both ray types alpha test masked geometry in their any-hit shaders, without opacity states.
+    for (uint32_t hitGroup = 0; hitGroup < 2; hitGroup++) {
+        for (auto hitVars : mpRayTracer->getHitVars(hitGroup)) {
+            hitVars["gOpacityStateKeys"] = nullptr;
+            hitVars["gOpacityStates"] = nullptr;
+            hitVars["gOpacityStats"] = nullptr;
+        }
+    }
+
+    auto bdptMissVars = mpRayTracer->getMissVars(0);
+    bdptMissVars["gEnvMap"] = mpResManager->getTexture(ResourceManager::kEnvironmentMap);
+
+    mpRayTracer->execute(pRenderContext, renderSize);
+
+    // Add the light tracing splats to the camera paths' radiance.
+    Fbo::SharedPtr outputFbo = mpResManager->createManagedFbo({ mOutputBuffer });
+    mpGfxState->setFbo(outputFbo);
+
+    auto resolveVars = mpResolveShader->getVars();
+    resolveVars["gCameraPaths"] = cameraPathsTex;
+    resolveVars["gLightSplats"] = mpLightSplats;
+    mpResolveShader->execute(pRenderContext, mpGfxState);
+
+    mpFrameTimer->end();
+    mFrameTimerPending = true;
+    mTimedSamplesPerPixel = samplesPerPixel;
+}
+
+void BidirectionalPathTracingPass::renderGui(Gui* pGui) {
+    int dirty = 0;
+
+    dirty |= (int)pGui->addIntVar("Max depth", mMaxDepth, 1, int32_t(kMaxDepth));
+
+    // The same controls as the UnidirectionalPathTracingPass's; only one of them is in the pipeline.
+    if (mpSampleBudget) {
+        bool adaptive = mpSampleBudget->isAdaptive();
+        if (pGui->addCheckBox(adaptive ? "Samples per pixel within a GPU time budget" : "Fixed samples per pixel", adaptive)) {
+            mpSampleBudget->setAdaptive(adaptive);
+        }
+        if (adaptive) {
+            float budgetMs = mpSampleBudget->getBudgetMs();
+            if (pGui->addFloatVar("Path tracing budget (ms)", budgetMs, 0.1f, 1000.0f, 0.5f)) {
+                mpSampleBudget->setBudgetMs(budgetMs);
+            }
+        } else {
+            int32_t samplesPerPixel = int32_t(mpSampleBudget->getFixedSamplesPerPixel());
+            if (pGui->addIntVar("Samples per pixel", samplesPerPixel, 1, int32_t(SampleBudget::kMaxSamplesPerPixel))) {
+                mpSampleBudget->setFixedSamplesPerPixel(uint32_t(samplesPerPixel));
+            }
+        }
+    }
+
+    // For equal-time comparisons with the UnidirectionalPathTracingPass: render both with a static
+    // camera and match their accumulated frames to the same total time.
+    uvec2 screenSize = mpResManager->getScreenSize();
+    uvec2 renderSize = mpRenderScale ? mpRenderScale->getRenderSize(screenSize) : screenSize;
+    char buffer[128];
+    if (mMsPerFrame < 0.0f) {
+        snprintf(buffer, sizeof(buffer), "Bidirectional: not measured");
+    } else {
+        snprintf(buffer, sizeof(buffer), "Bidirectional: %.2f ms/frame, %.1f Msamples/s", mMsPerFrame,
+            float(renderSize.x) * float(renderSize.y) * float(mTimedSamplesPerPixel) / (mMsPerFrame * 1000.0f));
+    }
+    pGui->addText(buffer);
+
+    if (dirty) {
+        setRefreshFlag();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+#include "Falcor.h"
+#include "../SharedUtils/RenderPass.h"
+#include "../SharedUtils/RayLaunch.h"
+#include "../SharedUtils/FullscreenLaunch.h"
+#include "../Utils/EnvironmentMapLoader.h"
+#include "../Utils/RenderScale.h"
+#include "../Utils/SampleBudget.h"
+
+// Bidirectional path tracing (see BidirectionalPathIntegrator in Integrators/Bidirectional.hlsli), an
+// alternative to the UnidirectionalPathTracingPass for lighting that camera paths rarely reach. It
+// traces its own camera rays from a pinhole instead of starting from the G-Buffer, at the same
+// internal resolution, so that it can take the UnidirectionalPathTracingPass's place in front of the
+// TemporalUpscalingPass and the TemporalAccumulationPass. Light tracing contributions are splatted
+// atomically and added to the camera paths' radiance by a fullscreen resolve.
+//
+// Splats land on whichever pixel they project to, i.e. they're box filtered over the pixel, so the
+// camera rays go through random points of the pixel too rather than through the frame's jitter:
+// otherwise each frame would weigh the two kinds of strategies over different footprints and be
+// biased. At a render scale below 1, the upscaler gets less subpixel detail from it.
+class BidirectionalPathTracingPass : public ::RenderPass, inherit_shared_from_this<::RenderPass, BidirectionalPathTracingPass> {
+protected:
+	// A camera subpath has maxDepth + 2 vertices; must match BDPT_MAX_PATH_VERTICES in
+	// Integrators/Bidirectional.hlsli.
+	static const uint32_t kMaxDepth = 4;
+
+	RayLaunch::SharedPtr mpRayTracer;
+	FullscreenLaunch::SharedPtr mpResolveShader;
+	GraphicsState::SharedPtr mpGfxState;
+	EnvironmentMapLoader::SharedPtr mpEnvMapLoader;
+	RtScene::SharedPtr mpScene;
+	std::string mOutputBuffer;
+
+	// Storage format of the output buffer.
+	ResourceFormat mOutputFormat;
+
+	// Internal render resolution; nullptr renders at the screen size. Its subpixel jitter isn't used.
+	RenderScale::SharedPtr mpRenderScale;
+
+	// Samples per pixel of every frame; nullptr takes 1.
+	SampleBudget::SharedPtr mpSampleBudget;
+
+	// Light tracing contributions of the frame, 3 R32Uint texels (r, g, b) per pixel in fixed point.
+	// Cleared every frame.
+	Texture::SharedPtr mpLightSplats;
+
+	// First sample of the next frame.
+	uint32_t mSampleCount = 0x1337u;
+	int32_t mMaxDepth = int32_t(kMaxDepth);
+
+	// GPU time of the ray tracing dispatch and the resolve, a running average, or negative until
+	// measured. Compare it with the UnidirectionalPathTracingPass's ms/frame for equal-time
+	// comparisons.
+	GpuTimer::SharedPtr mpFrameTimer;
+	bool mFrameTimerPending = false;
+	float mMsPerFrame = -1.0f;
+	// Samples per pixel of the timed frame.
+	uint32_t mTimedSamplesPerPixel = 1;
+
+	BidirectionalPathTracingPass(const std::string &outputBuffer, ResourceFormat outputFormat, RenderScale::SharedPtr pRenderScale, SampleBudget::SharedPtr pSampleBudget) : ::RenderPass("BidirectionalPathTracing", "BidirectionalPathTracing Settings") {
+		mOutputBuffer = outputBuffer;
+		mOutputFormat = outputFormat;
+		mpRenderScale = pRenderScale;
+		mpSampleBudget = pSampleBudget;
+	}
+
+    bool initialize(RenderContext* pRenderContext, ResourceManager::SharedPtr pResManager) override;
+
+    void initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene) override;
+
+    void execute(RenderContext* pRenderContext) override;
+
+    void renderGui(Gui* pGui) override;
+
+	bool requiresScene() override { 
+		return true;
+	}
+
+	bool usesRayTracing() override {
+		return true;
+	}
+
+	bool usesEnvironmentMap() override {
+		return true;
+	}
+
+public:
+    using SharedPtr = std::shared_ptr<BidirectionalPathTracingPass>;
+
+    using SharedConstPtr = std::shared_ptr<const BidirectionalPathTracingPass>;
+
+    static SharedPtr create(const std::string &outputBuffer, ResourceFormat outputFormat = ResourceFormat::RGBA32Float, RenderScale::SharedPtr pRenderScale = nullptr, SampleBudget::SharedPtr pSampleBudget = nullptr) {
+        return SharedPtr(new BidirectionalPathTracingPass(outputBuffer, outputFormat, pRenderScale, pSampleBudget));
+    }
+
+    virtual ~BidirectionalPathTracingPass() = default;
+};
\ No newline at end of file
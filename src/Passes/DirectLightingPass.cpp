@@ -35,8 +35,11 @@ bool DirectLightingPass::initialize(RenderContext* pRenderContext, ResourceManag
         "BRDFProbability"
     });
     mpResManager->requestTextureResource(mOutputBuffer);
+    mpResManager->requestTextureResource("VisibilityKey", ResourceFormat::RGBA32Float);
+    mpResManager->requestTextureResource("VisibilityMask", ResourceFormat::RGBA32Uint);
 
-    mpResManager->updateEnvironmentMap(kEnvironmentMap);
+    // Decoded asynchronously; the first frames render with a placeholder environment.
+    mpEnvMapLoader = EnvironmentMapLoader::get(kEnvironmentMap);
     mpResManager->setDefaultSceneName("Data/pink_room/pink_room.fscene");
 
     mpRayTracer = RayLaunch::create(kShaderFile, kEntryPointRayGen);
@@ -47,9 +50,12 @@ bool DirectLightingPass::initialize(RenderContext* pRenderContext, ResourceManag
     mpRayTracer->addMissShader(kShaderFile, kEntryPointShadowMiss);
     mpRayTracer->addHitShader(kShaderFile, kEntryPointShadowClosestHit, kEntryPointShadowAnyHit);
 
+    mpShadowCascades = ShadowCascades::create();
+
     mpRayTracer->compileRayProgram();
     if (mpScene) {
         mpRayTracer->setScene(mpScene);
+        mpShadowCascades->setScene(mpScene);
     }
 
     return true;
@@ -59,6 +65,13 @@ bool DirectLightingPass::initialize(RenderContext* pRenderContext, ResourceManag
 void DirectLightingPass::initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene) {
     mpScene = std::dynamic_pointer_cast<RtScene>(pScene);
     if (mpRayTracer) mpRayTracer->setScene(mpScene);
+    if (mpShadowCascades) mpShadowCascades->setScene(mpScene);
+
+    mResetVisibilityCache = true;
+}
+
+void DirectLightingPass::stateRefreshed() {
+    mResetVisibilityCache = true;
 }
 
 void DirectLightingPass::execute(RenderContext* pRenderContext) {
@@ -74,6 +87,23 @@ void DirectLightingPass::execute(RenderContext* pRenderContext) {
         return;
     }
 
+    // Swap in the environment map once it has been decoded; accumulated frames rendered with the
+    // placeholder are discarded.
+    if (mpEnvMapLoader->update(mpResManager)) {
+        setRefreshFlag();
+    }
+
+    // Forget all cached visibility after a scene change.
+    Texture::SharedPtr visibilityMaskTex = mpResManager->getTexture("VisibilityMask");
+    if (mResetVisibilityCache) {
+        pRenderContext->clearUAV(visibilityMaskTex->getUAV().get(), uvec4(0));
+        mResetVisibilityCache = false;
+    }
+
+    if (mShadowMode != uint32_t(ShadowCascades::Mode::Rays)) {
+        mpShadowCascades->update(pRenderContext);
+    }
+
     auto rayGenVars = mpRayTracer->getRayGenVars();
     rayGenVars["RayGenCB"]["gFrameCount"] = mFrameCount++;
     rayGenVars["RayGenCB"]["gMaxBounces"] = mMaxBounces;
@@ -97,6 +127,12 @@ void DirectLightingPass::execute(RenderContext* pRenderContext) {
         dlHitVars["gDirectL"] = directLTex;
         dlHitVars["gLe"] = leTex;
         dlHitVars["gBRDFProbability"] = brdfProbabilityTex;
+        dlHitVars["VisibilityCacheCB"]["gUseVisibilityCache"] = mUseVisibilityCache;
+        dlHitVars["VisibilityCacheCB"]["gVisibilityCacheTolerance"] = mVisibilityCacheTolerance;
+        dlHitVars["gVisibilityKey"] = mpResManager->getTexture("VisibilityKey");
+        dlHitVars["gVisibilityMask"] = visibilityMaskTex;
+        mpShadowCascades->setShaderData(dlHitVars, ShadowCascades::Mode(mShadowMode));
+        dlHitVars["gShadowMapStats"] = nullptr;
     }
 
     // TODO: should be 1 instead of 0, because it is hitgroup 1 that uses gEnvMap; but if set to 1,
@@ -107,4 +143,25 @@ void DirectLightingPass::execute(RenderContext* pRenderContext) {
     dlMissVars["gDirectL"] = directLTex;
 
     mpRayTracer->execute(pRenderContext, mpResManager->getScreenSize());
+}
+
+void DirectLightingPass::renderGui(Gui* pGui) {
+    int dirty = 0;
+
+    dirty |= (int)pGui->addCheckBox(mUseVisibilityCache ? "Cached delta light visibility" : "Shadow rays every frame", mUseVisibilityCache);
+    if (mUseVisibilityCache) {
+        dirty |= (int)pGui->addFloatVar("Visibility cache tolerance (pixels)", mVisibilityCacheTolerance, 0.5f, 4.0f, 0.1f);
+    }
+
+    if (mpShadowCascades->getLightIndex() >= 0) {
+        Gui::DropdownList shadowModes;
+        shadowModes.push_back({ int32_t(ShadowCascades::Mode::Rays), "Shadow rays" });
+        shadowModes.push_back({ int32_t(ShadowCascades::Mode::Map), "Cascaded shadow maps" });
+        shadowModes.push_back({ int32_t(ShadowCascades::Mode::Hybrid), "Shadow maps, rays in penumbrae" });
+        dirty |= (int)pGui->addDropdown("Directional light shadows", shadowModes, mShadowMode);
+    }
+
+    if (dirty) {
+        setRefreshFlag();
+    }
 }
\ No newline at end of file
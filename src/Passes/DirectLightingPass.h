@@ -3,16 +3,32 @@
 #include "Falcor.h"
 #include "../SharedUtils/RenderPass.h"
 #include "../SharedUtils/RayLaunch.h"
+#include "../Utils/EnvironmentMapLoader.h"
+#include "../Utils/ShadowCascades.h"
 
 class DirectLightingPass : public ::RenderPass, inherit_shared_from_this<::RenderPass, DirectLightingPass> {
 protected:
 	RayLaunch::SharedPtr mpRayTracer;
+	EnvironmentMapLoader::SharedPtr mpEnvMapLoader;
     RtScene::SharedPtr mpScene;
 	std::string mOutputBuffer;
 
 	uint32_t mFrameCount = 0x1337u;
 	uint32_t mMaxBounces = 5;
 
+	// Delta light visibility from primary hits can be cached per pixel (VisibilityCache.hlsli) and
+	// reused while the camera and scene stay put, across subpixel jitter. Off by default: a penumbra
+	// the first shadow rays of a pixel miss stays biased.
+	bool mUseVisibilityCache = false;
+	// How far a primary hit may be from the first hit cached for the pixel, in pixel footprints, and
+	// still reuse its visibility. Jittered hits of a pixel are within sqrt(2) footprints of each other.
+	float mVisibilityCacheTolerance = 1.5f;
+	bool mResetVisibilityCache = true;
+
+	// Visibility of the scene's directional light; see ShadowMaps.hlsli.
+	ShadowCascades::SharedPtr mpShadowCascades;
+	uint32_t mShadowMode = uint32_t(ShadowCascades::Mode::Rays);
+
 	DirectLightingPass(const std::string &outputBuffer) : ::RenderPass("Direct Lighting", "Direct Lighting Settings") {
 		mOutputBuffer = outputBuffer;
 	}
@@ -23,6 +39,10 @@ protected:
 
     void execute(RenderContext* pRenderContext) override;
 
+    void renderGui(Gui* pGui) override;
+
+    void stateRefreshed() override;
+
 	bool requiresScene() override { 
 		return true;
 	}
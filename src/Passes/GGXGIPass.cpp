@@ -4,21 +4,22 @@
 #include "../SharedUtils/RayLaunch.h"
 
 namespace {
-    // Shader file.
+    // Shader files.
     const char *kShaderFile = "Shaders\\GGXGI.rt.hlsl";
+    const char *kUpsampleShader = "Shaders\\IndirectUpsample.ps.hlsl";
 
     // Entrypoints.
     const char *kEntryPointRayGen = "GGXGIRayGen";
-    const char *kEntryPointGGXGIClosestHit = "GGXGIClosestHit";
-    const char *kEntryPointGGXGIAnyHit = "GGXGIAnyHit";
-    const char *kEntryPointGGXGIMiss = "GGXGIMiss";
     const char *kEntryPointShadowClosestHit = "ShadowClosestHit";
     const char *kEntryPointShadowAnyHit = "ShadowAnyHit";
     const char *kEntryPointShadowMiss = "ShadowMiss";
 
-    const char* kEntryPointMiss1         = "IndirectMiss";
+    const char* kEntryPointMiss0         = "IndirectMiss";
 	const char* kEntryIndirectAnyHit     = "IndirectAnyHit";
 	const char* kEntryIndirectClosestHit = "IndirectClosestHit";
+
+    // Environment map file.
+    const char* kEnvironmentMap = "MonValley_G_DirtRoad_3k.hdr";
 };
 
 bool GGXGIPass::initialize(RenderContext* pRenderContext, ResourceManager::SharedPtr pResManager) {
@@ -29,27 +30,47 @@ bool GGXGIPass::initialize(RenderContext* pRenderContext, ResourceManager::Share
     });
     mpResManager->requestTextureResource(mOutputBuffer);
     mpResManager->requestTextureResource(ResourceManager::kEnvironmentMap);
+    // Decoded, and prefiltered, asynchronously; the first frames render with a placeholder
+    // environment and trace every specular sample.
+    mpEnvMapLoader = EnvironmentMapLoader::get(kEnvironmentMap);
+
+    // Direct lighting, and sparse and reconstructed indirect lighting.
+    mpResManager->requestTextureResource("GGXDirect");
+    mpResManager->requestTextureResource("GGXIndirect", ResourceFormat::RGBA16Float);
+    mpResManager->requestTextureResource("GGXIndirectFiltered", ResourceFormat::RGBA16Float);
 
     mpResManager->setDefaultSceneName("Data/pink_room/pink_room.fscene");
 
     mpRayTracer = RayLaunch::create(kShaderFile, kEntryPointRayGen);
 
-    // Ray type / hit group 0: shadow rays.
+    // Ray type / hit group 0 (STANDARD_RAY_HIT_GROUP): indirect rays.
+    mpRayTracer->addMissShader(kShaderFile, kEntryPointMiss0);
+	mpRayTracer->addHitShader(kShaderFile, kEntryIndirectClosestHit, kEntryIndirectAnyHit);
+
+    // Ray type / hit group 1 (SHADOW_RAY_HIT_GROUP): shadow rays.
     mpRayTracer->addMissShader(kShaderFile, kEntryPointShadowMiss);
     mpRayTracer->addHitShader(kShaderFile, kEntryPointShadowClosestHit, kEntryPointShadowAnyHit);
 
-    // Ray type / hit group 1: GI rays.
-    // mpRayTracer->addMissShader(kShaderFile, kEntryPointGGXGIMiss);
-    // mpRayTracer->addHitShader(kShaderFile, kEntryPointGGXGIClosestHit, kEntryPointGGXGIAnyHit);
-    mpRayTracer->addMissShader(kShaderFile, kEntryPointMiss1);
-	mpRayTracer->addHitShader(kShaderFile, kEntryIndirectClosestHit, kEntryIndirectAnyHit);
-
     mpRayTracer->compileRayProgram();
     mpRayTracer->setMaxRecursionDepth(uint32_t(mMaxRayDepth));
     if (mpScene) {
         mpRayTracer->setScene(mpScene);
     }
 
+    mpUpsampleShader = FullscreenLaunch::create(kUpsampleShader);
+    mpGfxState = GraphicsState::create();
+
+    Sampler::Desc samplerDesc;
+    samplerDesc.setFilterMode(Sampler::Filter::Linear, Sampler::Filter::Linear, Sampler::Filter::Linear);
+    samplerDesc.setAddressingMode(Sampler::AddressMode::Wrap, Sampler::AddressMode::Clamp, Sampler::AddressMode::Clamp);
+    mpEnvSampler = Sampler::create(samplerDesc);
+    samplerDesc.setAddressingMode(Sampler::AddressMode::Clamp, Sampler::AddressMode::Clamp, Sampler::AddressMode::Clamp);
+    mpLutSampler = Sampler::create(samplerDesc);
+
+    mpUpsampleStats = Texture::create2D(
+        4, 1, ResourceFormat::R32Uint, 1, 1, nullptr, Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+    );
+
     return true;
 }
 
@@ -60,12 +81,30 @@ void GGXGIPass::initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene
 }
 
 void GGXGIPass::execute(RenderContext* pRenderContext) {
-    Texture::SharedPtr outputTex = mpResManager->getClearedTexture(mOutputBuffer, vec4(0.0f, 0.0f, 0.0f, 0.0f));
+    Texture::SharedPtr directTex = mpResManager->getClearedTexture("GGXDirect", vec4(0.0f, 0.0f, 0.0f, 0.0f));
+    Texture::SharedPtr indirectTex = mpResManager->getTexture("GGXIndirect");
+    Texture::SharedPtr filteredIndirectTex = mpResManager->getTexture("GGXIndirectFiltered");
 
-    if (!outputTex || !mpRayTracer || !mpRayTracer->readyToRender()) {
+    if (!directTex || !mpRayTracer || !mpRayTracer->readyToRender()) {
         return;
     }
 
+    // Swap in the environment map once it has been decoded; accumulated frames rendered with the
+    // placeholder are discarded.
+    if (mpEnvMapLoader->update(mpResManager)) {
+        setRefreshFlag();
+    }
+    bool prefilteredEnv = mUsePrefilteredEnv && mpEnvMapLoader->getPrefilteredEnvMap();
+
+    // Statistics collected last frame; reading them back a frame later keeps the stall short.
+    if (mStatsPending) {
+        readUpsampleStats(pRenderContext);
+    }
+    bool collectStats = (mFrameCount % kStatsInterval) == 0;
+    if (collectStats) {
+        pRenderContext->clearUAV(mpUpsampleStats->getUAV().get(), uvec4(0));
+    }
+
 	auto globalVars = mpRayTracer->getGlobalVars();
 	globalVars["GlobalCB"]["gMinT"]         = mpResManager->getMinTDist();
 	globalVars["GlobalCB"]["gFrameCount"]   = mFrameCount++;
@@ -73,16 +112,62 @@ void GGXGIPass::execute(RenderContext* pRenderContext) {
 	globalVars["GlobalCB"]["gDoDirectGI"]   = mDoDirectGI;
 	globalVars["GlobalCB"]["gMaxDepth"]     = mRayDepth;
     globalVars["GlobalCB"]["gEmitMult"]     = 1.0f;
+    globalVars["GlobalCB"]["gIndirectRate"] = mIndirectRate;
+    globalVars["GlobalCB"]["gFullRateContrast"] = mFullRateContrast;
+    globalVars["GlobalCB"]["gHalfRateContrast"] = mHalfRateContrast;
+    globalVars["GlobalCB"]["gPrefilteredRoughness"] = prefilteredEnv ? mPrefilteredRoughness : 2.0f;
+    globalVars["gPrefilteredEnvMap"] = mpEnvMapLoader->getPrefilteredEnvMap();
+    globalVars["gEnvBRDFLut"] = mpEnvMapLoader->getBRDFLut();
+    globalVars["gEnvSampler"] = mpEnvSampler;
+    globalVars["gLutSampler"] = mpLutSampler;
 	globalVars["gPos"]         = mpResManager->getTexture("WorldPosition");
 	globalVars["gNorm"]        = mpResManager->getTexture("WorldNormal");
 	globalVars["gDiffuseMatl"] = mpResManager->getTexture("MaterialDiffuse");
 	globalVars["gSpecMatl"]    = mpResManager->getTexture("MaterialSpecRough");
 	globalVars["gExtraMatl"]   = mpResManager->getTexture("MaterialExtraParams");
     globalVars["gEmissive"]    = mpResManager->getTexture("Emissive");
-	globalVars["gOutput"]      = outputTex;
+	globalVars["gOutput"]      = directTex;
+    globalVars["gIndirectOutput"] = indirectTex;
+    globalVars["gLastIndirect"] = filteredIndirectTex;
 	globalVars["gEnvMap"] = mpResManager->getTexture(ResourceManager::kEnvironmentMap);
 
     mpRayTracer->execute(pRenderContext, mpResManager->getScreenSize());
+
+    // Fill in the pixels that didn't trace indirect rays and add indirect to direct lighting.
+    Fbo::SharedPtr outputFbo = mpResManager->createManagedFbo({ mOutputBuffer, "GGXIndirectFiltered" });
+    mpGfxState->setFbo(outputFbo);
+
+    auto upsampleVars = mpUpsampleShader->getVars();
+    upsampleVars["UpsampleCB"]["gCameraPos"] = (mpScene && mpScene->getActiveCamera()) ? mpScene->getActiveCamera()->getPosition() : vec3(0.0f);
+    upsampleVars["UpsampleCB"]["gPlaneDistanceScale"] = mPlaneDistanceScale;
+    upsampleVars["UpsampleCB"]["gNormalPower"] = mNormalPower;
+    upsampleVars["UpsampleCB"]["gCollectStats"] = collectStats;
+    upsampleVars["gDirect"] = directTex;
+    upsampleVars["gIndirect"] = indirectTex;
+    upsampleVars["gPos"] = mpResManager->getTexture("WorldPosition");
+    upsampleVars["gNorm"] = mpResManager->getTexture("WorldNormal");
+    upsampleVars["gDiffuseMatl"] = mpResManager->getTexture("MaterialDiffuse");
+    upsampleVars["gSpecMatl"] = mpResManager->getTexture("MaterialSpecRough");
+    upsampleVars["gUpsampleStats"] = mpUpsampleStats;
+    mpUpsampleShader->execute(pRenderContext, mpGfxState);
+
+    mStatsPending = collectStats;
+}
+
+void GGXGIPass::readUpsampleStats(RenderContext* pRenderContext) {
+    mStatsPending = false;
+
+    std::vector<uint8_t> texels = pRenderContext->readTextureSubresource(mpUpsampleStats.get(), 0);
+    const uint32_t *stats = reinterpret_cast<const uint32_t*>(texels.data());
+
+    uint32_t tracedPixels = stats[0];
+    uint32_t geometryPixels = stats[1];
+    if (geometryPixels > 0) {
+        mTracedFraction = float(tracedPixels) / float(geometryPixels);
+    }
+    if (stats[3] > 0) {
+        mReconstructionError = float(stats[2]) / 1024.0f / float(stats[3]);
+    }
 }
 
 void GGXGIPass::renderGui(Gui* pGui) {
@@ -94,6 +179,35 @@ void GGXGIPass::renderGui(Gui* pGui) {
 
 	dirty |= (int)pGui->addCheckBox(mDoIndirectGI ? "Do indirect illumination" : "Don't do indirect illumination", mDoIndirectGI);
 
+    if (mDoIndirectGI) {
+        Gui::DropdownList indirectRates;
+        indirectRates.push_back({ int32_t(IndirectRate::Full), "Full rate" });
+        indirectRates.push_back({ int32_t(IndirectRate::Checkerboard), "Checkerboard (1/2)" });
+        indirectRates.push_back({ int32_t(IndirectRate::Quarter), "Quarter (1/4)" });
+        indirectRates.push_back({ int32_t(IndirectRate::Adaptive), "Adaptive per 8x8 tile" });
+        dirty |= (int)pGui->addDropdown("Indirect rate", indirectRates, mIndirectRate);
+
+        if (mIndirectRate == uint32_t(IndirectRate::Adaptive)) {
+            dirty |= (int)pGui->addFloatVar("Full rate above contrast", mFullRateContrast, 0.0f, 1.0f, 0.01f);
+            dirty |= (int)pGui->addFloatVar("Half rate above contrast", mHalfRateContrast, 0.0f, 1.0f, 0.01f);
+        }
+
+        dirty |= (int)pGui->addFloatVar("Upsampling plane distance", mPlaneDistanceScale, 0.0001f, 1.0f, 0.001f);
+        dirty |= (int)pGui->addFloatVar("Upsampling normal power", mNormalPower, 1.0f, 256.0f, 1.0f);
+
+        dirty |= (int)pGui->addCheckBox("Prefiltered environment for rough specular", mUsePrefilteredEnv);
+        if (mUsePrefilteredEnv) {
+            dirty |= (int)pGui->addFloatVar("Prefiltered from roughness", mPrefilteredRoughness, 0.0f, 1.0f, 0.01f);
+        }
+
+        // The error is measured at the traced pixels, by reconstructing each from its neighbors
+        // alone; it's the error the filter makes at the pixels it does fill in.
+        pGui->addText("     ");
+        pGui->addText((std::string("Indirect rays traced: ") + std::to_string(int(mTracedFraction * 100.0f + 0.5f)) + "%").c_str());
+        pGui->addText((std::string("Indirect rays saved: ") + std::to_string(int((1.0f - mTracedFraction) * 100.0f + 0.5f)) + "%").c_str());
+        pGui->addText((std::string("Upsampling error (relative): ") + std::to_string(mReconstructionError)).c_str());
+    }
+
 	if (dirty) {
         setRefreshFlag();
     }
@@ -2,21 +2,75 @@
 #include "Falcor.h"
 #include "../SharedUtils/RenderPass.h"
 #include "../SharedUtils/RayLaunch.h"
+#include "../SharedUtils/FullscreenLaunch.h"
+#include "../Utils/EnvironmentMapLoader.h"
 
+// Direct and one-or-more-bounce indirect lighting with a Lambertian plus GGX BRDF.
+//
+// Indirect lighting is traced for every pixel by default. It's the expensive part and it's smooth,
+// so it can instead be traced for a fraction of the pixels: every other pixel in a checkerboard, one
+// in each 2x2 block, or a rate chosen per 8x8 tile from the luminance contrast of last frame's
+// indirect lighting (full rate where it varies, quarter rate where it's flat). The traced pixels
+// rotate every frame. A fullscreen joint bilateral filter guided by WorldPosition and WorldNormal
+// fills in the rest before adding it to the direct lighting. Indirect lighting is divided by the reflectance before filtering so that texture
+// detail isn't blurred.
+//
+// Specular samples on rough surfaces don't trace either: their reflection of the environment is
+// read from a GGX-prefiltered environment map and a BRDF table precomputed on the CPU at load (the
+// split-sum approximation), which ignores occlusion by the scene.
 class GGXGIPass : public ::RenderPass, inherit_shared_from_this<::RenderPass, GGXGIPass> {
+public:
+    // Must match the INDIRECT_RATE_* defines of GGXGI.rt.hlsl.
+    enum class IndirectRate : uint32_t {
+        Full = 0,
+        Checkerboard,
+        Quarter,
+        Adaptive
+    };
+
 protected:
+    // How often (in frames) the upsampling pass collects statistics for the GUI.
+    static const uint32_t kStatsInterval = 32;
+
 	RayLaunch::SharedPtr mpRayTracer;
+    EnvironmentMapLoader::SharedPtr mpEnvMapLoader;
     RtScene::SharedPtr mpScene;
 	std::string mOutputBuffer;
 
+    FullscreenLaunch::SharedPtr mpUpsampleShader;
+    GraphicsState::SharedPtr mpGfxState;
+
+    // 4x1 counters written by the upsampling shader; see IndirectUpsample.ps.hlsl.
+    Texture::SharedPtr mpUpsampleStats;
+
 	bool mDoIndirectGI = true;
 	bool mDoDirectGI = true;
     const int32_t mMaxRayDepth = 8;
     int32_t mRayDepth = 1;
 
+    uint32_t mIndirectRate = uint32_t(IndirectRate::Full);
+    float mFullRateContrast = 0.5f;
+    float mHalfRateContrast = 0.15f;
+    float mPlaneDistanceScale = 0.02f;
+    float mNormalPower = 32.0f;
+
+    // Specular lobes at least this rough (perceptual roughness) use the prefiltered environment.
+    bool mUsePrefilteredEnv = true;
+    float mPrefilteredRoughness = 0.5f;
+    Sampler::SharedPtr mpEnvSampler;
+    Sampler::SharedPtr mpLutSampler;
+
+    // Whether the stats texture was written this frame and has to be read back on the next one.
+    bool mStatsPending = false;
+
+    // Fraction of the pixels with geometry that traced indirect rays, and mean relative error of
+    // the filter at the traced pixels (leave-one-out), last time they were collected.
+    float mTracedFraction = 1.0f;
+    float mReconstructionError = 0.0f;
+
 	uint32_t mFrameCount = 0x1337u;
 
-	GGXGIPass(const std::string &outputBuffer) : ::RenderPass("Diffuse GI Ray", "Diffuse GI Settings") {
+	GGXGIPass(const std::string &outputBuffer) : ::RenderPass("GGX GI Ray", "GGX GI Settings") {
 		mOutputBuffer = outputBuffer;
 	}
 
@@ -28,6 +82,8 @@ protected:
 
 	void renderGui(Gui* pGui) override;
 
+    void readUpsampleStats(RenderContext* pRenderContext);
+
 	bool requiresScene() override { 
 		return true;
 	}
@@ -48,4 +104,4 @@ public:
     static SharedPtr create(const std::string &outputBuffer) { return SharedPtr(new GGXGIPass(outputBuffer)); }
 
     virtual ~GGXGIPass() = default;
-};
+};
\ No newline at end of file
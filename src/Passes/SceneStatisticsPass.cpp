@@ -0,0 +1,50 @@
+#include "SceneStatisticsPass.h"
+
+bool SceneStatisticsPass::initialize(RenderContext* pRenderContext, ResourceManager::SharedPtr pResManager) {
+    mpResManager = pResManager;
+    mpMemoryStats = SceneMemoryStats::create();
+    mpMemoryStats->setScene(mpScene);
+    return true;
+}
+
+void SceneStatisticsPass::initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene) {
+    mpScene = pScene;
+    if (mpMemoryStats) {
+        mpMemoryStats->setScene(mpScene);
+    }
+    // The report describes the previous scene.
+    mHasCompressionReport = false;
+}
+
+void SceneStatisticsPass::execute(RenderContext* pRenderContext) {
+    if (mValidateCompression) {
+        mCompressionReport = VertexCompression::validate(pRenderContext, mpScene);
+        mHasCompressionReport = true;
+        mValidateCompression = false;
+    }
+}
+
+void SceneStatisticsPass::renderGui(Gui* pGui) {
+    mpMemoryStats->renderGui(pGui);
+    pGui->addText("     ");
+
+    if (!mpScene) {
+        return;
+    }
+
+    // Precision and memory of a quantized vertex format; see VertexCompression.
+    if (pGui->addButton("Validate compressed vertices")) {
+        mValidateCompression = true;
+    }
+    if (mHasCompressionReport) {
+        const uint64_t kMB = 1024 * 1024;
+        const VertexCompression::Report &report = mCompressionReport;
+        pGui->addText((std::string("Meshes: ") + std::to_string(report.meshCount) + ", vertices: " + std::to_string(report.vertexCount)).c_str());
+        pGui->addText((std::string("Mesh memory (MB): ") + std::to_string(report.originalBytes / kMB) + " -> " + std::to_string(report.compressedBytes / kMB)).c_str());
+        pGui->addText((std::string("Saved: ") + std::to_string(int(100.0 * (1.0 - double(report.compressedBytes) / double(std::max<uint64_t>(report.originalBytes, 1))) + 0.5)) + "%").c_str());
+        pGui->addText((std::string("Max position error: ") + std::to_string(report.maxPositionError) + " (" + std::to_string(report.maxRelativePositionError) + " of mesh extent)").c_str());
+        pGui->addText((std::string("Max normal error (deg): ") + std::to_string(report.maxNormalError)).c_str());
+        pGui->addText((std::string("Max bitangent error (deg): ") + std::to_string(report.maxBitangentError)).c_str());
+        pGui->addText((std::string("Max texcoord error: ") + std::to_string(report.maxTexCoordError)).c_str());
+    }
+}
\ No newline at end of file
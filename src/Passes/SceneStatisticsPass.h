@@ -0,0 +1,39 @@
+#pragma once
+#include "Falcor.h"
+#include "../SharedUtils/RenderPass.h"
+#include "../Utils/SceneMemoryStats.h"
+#include "../Utils/VertexCompression.h"
+
+// Renders nothing; shows the geometry and video memory statistics of the scene in its own GUI
+// window, so that the rendering passes don't have to, and validates a compressed vertex format for
+// it on demand (see VertexCompression).
+class SceneStatisticsPass : public ::RenderPass, inherit_shared_from_this<::RenderPass, SceneStatisticsPass> {
+protected:
+    Scene::SharedPtr mpScene;
+
+    SceneMemoryStats::SharedPtr mpMemoryStats;
+
+    // Set from the GUI; the validation needs a RenderContext, so it runs in the next execute().
+    bool mValidateCompression = false;
+    bool mHasCompressionReport = false;
+    VertexCompression::Report mCompressionReport;
+
+    SceneStatisticsPass() : ::RenderPass("Scene Statistics", "Scene Statistics") {}
+
+    bool initialize(RenderContext* pRenderContext, ResourceManager::SharedPtr pResManager) override;
+
+    void initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene) override;
+
+    void execute(RenderContext* pRenderContext) override;
+
+    void renderGui(Gui* pGui) override;
+
+public:
+    using SharedPtr = std::shared_ptr<SceneStatisticsPass>;
+
+    static SharedPtr create() {
+        return SharedPtr(new SceneStatisticsPass());
+    }
+
+    virtual ~SceneStatisticsPass() = default;
+};
\ No newline at end of file
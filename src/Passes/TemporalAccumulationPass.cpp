@@ -2,17 +2,36 @@
 
 namespace {
     const char *kAccumShader = "Shaders\\Accumulation.ps.hlsl";
+
+    struct HDRFormatInfo {
+        Falcor::ResourceFormat format;
+        const char *name;
+        // Worst-case relative rounding error of a stored value, 2^-(mantissa bits + 1). For RGB9E5,
+        // relative to the largest channel of the pixel (the exponent is shared).
+        float relativeError;
+        // Whether shaders can write it (as UAV or render target).
+        bool writable;
+    };
+
+    const HDRFormatInfo kHDRFormats[] = {
+        { Falcor::ResourceFormat::RGBA32Float, "RGBA32Float", 5.96e-8f, true },
+        { Falcor::ResourceFormat::RGBA16Float, "RGBA16Float", 4.88e-4f, true },
+        // 6-bit mantissas for R and G, 5-bit for B, no alpha.
+        { Falcor::ResourceFormat::R11G11B10Float, "R11G11B10Float", 1.56e-2f, true },
+        // 9-bit mantissas without an implicit leading 1. Not a render target or UAV format in D3D12.
+        { Falcor::ResourceFormat::RGB9E5Float, "RGB9E5Float", 1.95e-3f, false },
+    };
 };
 
-TemporalAccumulationPass::SharedPtr TemporalAccumulationPass::create(const std::string &accumulationBuffer) {
-    return SharedPtr(new TemporalAccumulationPass(accumulationBuffer));
+TemporalAccumulationPass::SharedPtr TemporalAccumulationPass::create(const std::string &accumulationBuffer, Falcor::ResourceFormat accumulationFormat, SampleBudget::SharedPtr pSampleBudget) {
+    return SharedPtr(new TemporalAccumulationPass(accumulationBuffer, accumulationFormat, pSampleBudget));
 }
 
 bool TemporalAccumulationPass::initialize(RenderContext *pRenderContext, ResourceManager::SharedPtr pResManager) {
     mpResManager = pResManager;
-    // Request a single texture of default format (RGBA32Float) and default size (screen sized).
-    // The TemporalAccumulationPass accumulates multiple frames' data in this texture.
-    mpResManager->requestTextureResource(mAccumChannel);
+    // Request a single screen-sized texture. The TemporalAccumulationPass presents the average of
+    // multiple frames' data in this texture.
+    mpResManager->requestTextureResource(mAccumChannel, mAccumFormat);
 
     mpResManager->setDefaultSceneName("Data/pink_room/pink_room.fscene");
 
@@ -34,6 +53,8 @@ void TemporalAccumulationPass::initScene(RenderContext *pRenderContext, Falcor::
     if (mpScene && mpScene->getActiveCamera()) {
         mpLastCameraMatrix = mpScene->getActiveCamera()->getViewMatrix();
     } 
+
+    saveInstanceMatrices();
 }
 
 void TemporalAccumulationPass::execute(RenderContext *pRenderContext) {
@@ -61,20 +82,41 @@ void TemporalAccumulationPass::execute(RenderContext *pRenderContext) {
         mpLastCameraMatrix = mpScene->getActiveCamera()->getViewMatrix();
     }
 
+    if (haveInstancesMoved()) {
+        // Same as when the camera moves: the accumulated value no longer corresponds to the scene.
+        mNumFramesAccum = 0;
+
+        // Unlike camera motion, this also invalidates what other passes cache about the scene
+        // (e.g. light visibility), so let them know.
+        setRefreshFlag();
+    }
+
     // Execute the pixel shader, passing it down the last frame and accumulation texture.
     // The pixel shader will do a weighted combination of the last frame and the
     // accumulation texture to obtain an average.
+    if (mNumFramesAccum == 0) {
+        mAccumulatedWeight = 0.0f;
+    }
+    float frameWeight = mpSampleBudget ? float(mpSampleBudget->getSamplesPerPixel()) : 1.0f;
+
     auto pixelShaderVars = mpAccumShader->getVars();
     pixelShaderVars["PerFrameCB"]["gNumFramesAccum"] = mNumFramesAccum++;
+    pixelShaderVars["PerFrameCB"]["gAccumulatedWeight"] = mAccumulatedWeight;
+    pixelShaderVars["PerFrameCB"]["gFrameWeight"] = frameWeight;
+    mAccumulatedWeight += frameWeight;
     // The last frame is the frame produced by the RayTracedAmbientOcclusionPass.
     pixelShaderVars["gLastFrame"] = mpLastFrame;
+    pixelShaderVars["gLastCompensation"] = mpLastCompensation;
     pixelShaderVars["gCurFrame"] = accumTexture;
     mpAccumShader->execute(pRenderContext, mpGfxState);
 
-    // blit copies a source SRV into a destination RTV.
+    // blit copies a source SRV into a destination RTV. Converts to the accumulation channel's
+    // format, if it's not RGBA32Float.
     pRenderContext->blit(mpInternalFbo->getColorTexture(0)->getSRV(), accumTexture->getRTV());
-    // Save the rendered frame to pass it down to the next frame's pixel shader.
+    // Save the rendered frame and its compensation term to pass them down to the next frame's
+    // pixel shader.
     pRenderContext->blit(mpInternalFbo->getColorTexture(0)->getSRV(), mpLastFrame->getRTV());
+    pRenderContext->blit(mpInternalFbo->getColorTexture(1)->getSRV(), mpLastCompensation->getRTV());
 }
 
 bool TemporalAccumulationPass::hasCameraMoved() {
@@ -86,6 +128,50 @@ bool TemporalAccumulationPass::hasCameraMoved() {
         && (mpLastCameraMatrix != mpScene->getActiveCamera()->getViewMatrix());
 }
 
+bool TemporalAccumulationPass::haveInstancesMoved() {
+    mMovedInstanceCount = 0;
+    if (!mpScene) {
+        return false;
+    }
+
+    uint32_t i = 0;
+    for (uint32_t modelId = 0; modelId < mpScene->getModelCount(); modelId++) {
+        for (uint32_t instanceId = 0; instanceId < mpScene->getModelInstanceCount(modelId); instanceId++, i++) {
+            const glm::mat4 &matrix = mpScene->getModelInstance(modelId, instanceId)->getTransformMatrix();
+
+            if (i >= mLastInstanceMatrices.size()) {
+                // Instance added since the last frame.
+                mLastInstanceMatrices.push_back(matrix);
+                mMovedInstanceCount++;
+            } else if (mLastInstanceMatrices[i] != matrix) {
+                mLastInstanceMatrices[i] = matrix;
+                mMovedInstanceCount++;
+            }
+        }
+    }
+
+    if (i < mLastInstanceMatrices.size()) {
+        // Instances removed since the last frame.
+        mMovedInstanceCount += uint32_t(mLastInstanceMatrices.size()) - i;
+        mLastInstanceMatrices.resize(i);
+    }
+
+    return mMovedInstanceCount > 0;
+}
+
+void TemporalAccumulationPass::saveInstanceMatrices() {
+    mLastInstanceMatrices.clear();
+    if (!mpScene) {
+        return;
+    }
+
+    for (uint32_t modelId = 0; modelId < mpScene->getModelCount(); modelId++) {
+        for (uint32_t instanceId = 0; instanceId < mpScene->getModelInstanceCount(modelId); instanceId++) {
+            mLastInstanceMatrices.push_back(mpScene->getModelInstance(modelId, instanceId)->getTransformMatrix());
+        }
+    }
+}
+
 void TemporalAccumulationPass::stateRefreshed() {
 	mNumFramesAccum = 0;
 }
@@ -95,7 +181,15 @@ void TemporalAccumulationPass::resize(uint32_t width, uint32_t height) {
         width, height, Falcor::ResourceFormat::RGBA32Float, 1, 1, nullptr, ResourceManager::kDefaultFlags
     );
 
-    mpInternalFbo = ResourceManager::createFbo(width, height, ResourceFormat::RGBA32Float);
+    mpLastCompensation = Falcor::Texture::create2D(
+        width, height, Falcor::ResourceFormat::RGBA32Float, 1, 1, nullptr, ResourceManager::kDefaultFlags
+    );
+
+    // Render target 0: running average; 1: its compensation term.
+    Fbo::Desc fboDesc;
+    fboDesc.setColorTarget(0, ResourceFormat::RGBA32Float);
+    fboDesc.setColorTarget(1, ResourceFormat::RGBA32Float);
+    mpInternalFbo = FboHelper::create2D(width, height, fboDesc);
     mpGfxState->setFbo(mpInternalFbo);
 
     // Start accumulation over.
@@ -113,4 +207,27 @@ void TemporalAccumulationPass::renderGui(Gui* pGui) {
 
 	pGui->addText("");
 	pGui->addText((std::string("Frames accumulated: ") + std::to_string(mNumFramesAccum)).c_str());
+	pGui->addText((std::string("Instances moved last frame: ") + std::to_string(mMovedInstanceCount)).c_str());
+
+	pGui->addText("");
+	renderFormatReport(pGui);
+}
+
+void TemporalAccumulationPass::renderFormatReport(Gui* pGui) {
+    uint32_t pixelCount = mpLastFrame ? mpLastFrame->getWidth() * mpLastFrame->getHeight() : 0;
+
+    pGui->addText("Accumulation state: RGBA32Float average + RGBA32Float compensation (32 B/pixel)");
+
+    for (const HDRFormatInfo &info : kHDRFormats) {
+        uint32_t bytesPerPixel = getFormatBytesPerBlock(info.format);
+        float megabytesPerFrame = float(bytesPerPixel) * float(pixelCount) / (1024.0f * 1024.0f);
+
+        char line[256];
+        snprintf(
+            line, sizeof(line), "%s%s: %u B/pixel, %.1f MB per write or read, max relative error %.2e%s",
+            info.format == mAccumFormat ? "> " : "  ", info.name, bytesPerPixel, megabytesPerFrame, info.relativeError,
+            info.writable ? "" : " (can't be written by shaders)"
+        );
+        pGui->addText(line);
+    }
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 #include "../SharedUtils/FullscreenLaunch.h"
 #include "../SharedUtils/RenderPass.h"
+#include "../Utils/SampleBudget.h"
 
 // Temporal accumulation of frames takes place as long as the camera doesn't move or the
 // scene changes.
@@ -9,6 +10,10 @@ protected:
     // The ResourceManager refers to textures by channel name;
     std::string mAccumChannel;
 
+    // Storage format of mAccumChannel. The running average itself is kept in RGBA32Float
+    // regardless (mpLastFrame, mpLastCompensation); mAccumChannel only receives a copy of it.
+    Falcor::ResourceFormat mAccumFormat;
+
     // Number of frames that have been accumulated so far. It gets restarted every time the
     // camera moves or when a new scene is loaded. This counter acts as the weight of the
     // contribution of the accumulated value to the new frame; when it's reset to 0, the
@@ -16,6 +21,11 @@ protected:
     // weight of the frame from the previous pass continues to be 1), effectively restarting
     // the accumulation.
     uint32_t mNumFramesAccum;
+
+    // Samples per pixel of the accumulated frames. Each frame is weighted by its sample count, taken
+    // from mpSampleBudget (1 without one).
+    float mAccumulatedWeight = 0.0f;
+    SampleBudget::SharedPtr mpSampleBudget;
     
     Falcor::Scene::SharedPtr mpScene;
     // Cameras belong to scenes; every scene defines its own cameras, one of which is active at 
@@ -24,6 +34,13 @@ protected:
     // no longer valid and we need to start it over.
     glm::mat4 mpLastCameraMatrix;
 
+    // Transform of every model instance as of the last frame, in (model, instance) order. Moving
+    // an instance invalidates the accumulation texture just like moving the camera does.
+    std::vector<glm::mat4> mLastInstanceMatrices;
+
+    // Number of model instances whose transform changed in the last frame.
+    uint32_t mMovedInstanceCount = 0;
+
     // State for rasterization pipeline.
     Falcor::GraphicsState::SharedPtr mpGfxState;
 
@@ -35,10 +52,16 @@ protected:
 
     Falcor::Texture::SharedPtr mpLastFrame;
 
+    // Kahan compensation term of the running average in mpLastFrame: the low-order bits lost when
+    // the ever smaller contribution of a new frame was added to it.
+    Falcor::Texture::SharedPtr mpLastCompensation;
+
     bool mDoAccumulation;
 
-    TemporalAccumulationPass(const std::string &accumulationBuffer) : RenderPass("Temporal Accumulation Pass", "Temporal Accumulation Pass Options") {
+    TemporalAccumulationPass(const std::string &accumulationBuffer, Falcor::ResourceFormat accumulationFormat, SampleBudget::SharedPtr pSampleBudget) : RenderPass("Temporal Accumulation Pass", "Temporal Accumulation Pass Options") {
         mAccumChannel = accumulationBuffer;
+        mAccumFormat = accumulationFormat;
+        mpSampleBudget = pSampleBudget;
     };
 
     bool initialize(RenderContext *pRenderContext, ResourceManager::SharedPtr pResManager) override;
@@ -57,10 +80,19 @@ protected:
     // Temporal accumulation starts over when the camera moves. 
     bool hasCameraMoved();
 
+    // Temporal accumulation also starts over when a model instance moves. Only the instances whose
+    // transform changed are counted; unchanged ones cost a single matrix comparison.
+    bool haveInstancesMoved();
+
+    void saveInstanceMatrices();
+
+    // Bandwidth and precision of the formats the accumulation channel can be stored in.
+    void renderFormatReport(Gui* pGui);
+
 public:
     using SharedPtr = std::shared_ptr<TemporalAccumulationPass>;
     
-    static SharedPtr create(const std::string &accumulationBuffer);
+    static SharedPtr create(const std::string &accumulationBuffer, Falcor::ResourceFormat accumulationFormat = Falcor::ResourceFormat::RGBA32Float, SampleBudget::SharedPtr pSampleBudget = nullptr);
 
     bool requiresScene() override {
         return true;
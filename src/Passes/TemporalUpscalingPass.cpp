@@ -0,0 +1,143 @@
+#include "TemporalUpscalingPass.h"
+
+namespace {
+    const char *kUpscaleShader = "Shaders\\TemporalUpscaling.ps.hlsl";
+};
+
+bool TemporalUpscalingPass::initialize(RenderContext *pRenderContext, ResourceManager::SharedPtr pResManager) {
+    mpResManager = pResManager;
+    mpResManager->requestTextureResource(mInChannel, mFormat);
+    mpResManager->requestTextureResource(mOutChannel, mFormat);
+    mpResManager->requestTextureResource("WorldPosition");
+
+    mpResManager->setDefaultSceneName("Data/pink_room/pink_room.fscene");
+
+    mpGfxState = Falcor::GraphicsState::create();
+
+    mpUpscaleShader = FullscreenLaunch::create(kUpscaleShader);
+
+    return true;
+}
+
+void TemporalUpscalingPass::initScene(RenderContext *pRenderContext, Falcor::Scene::SharedPtr pScene) {
+    mpScene = pScene;
+    mHistoryValid = false;
+    saveCamera();
+}
+
+void TemporalUpscalingPass::execute(RenderContext *pRenderContext) {
+    Falcor::Texture::SharedPtr inTexture = mpResManager->getTexture(mInChannel);
+    Falcor::Texture::SharedPtr outTexture = mpResManager->getTexture(mOutChannel);
+    if (!inTexture || !outTexture || !mpInternalFbo || !mpScene || !mpScene->getActiveCamera()) {
+        return;
+    }
+
+    // Nothing to upscale; the jittered frames are antialiased by the accumulation pass.
+    if (mpRenderScale->getScale() == 1.0f) {
+        pRenderContext->blit(inTexture->getSRV(), outTexture->getRTV());
+        mHistoryValid = false;
+        saveCamera();
+        return;
+    }
+
+    uvec2 screenSize = mpResManager->getScreenSize();
+    uvec2 renderSize = mpRenderScale->getRenderSize(screenSize);
+
+    const CameraData &cameraData = mpScene->getActiveCamera()->getData();
+    auto pixelShaderVars = mpUpscaleShader->getVars();
+    pixelShaderVars["UpscalingCB"]["gRenderSize"] = renderSize;
+    pixelShaderVars["UpscalingCB"]["gOutputSize"] = screenSize;
+    pixelShaderVars["UpscalingCB"]["gJitter"] = mpRenderScale->getJitter();
+    pixelShaderVars["UpscalingCB"]["gCameraPos"] = cameraData.posW;
+    pixelShaderVars["UpscalingCB"]["gCameraU"] = cameraData.cameraU;
+    pixelShaderVars["UpscalingCB"]["gCameraV"] = cameraData.cameraV;
+    pixelShaderVars["UpscalingCB"]["gCameraW"] = cameraData.cameraW;
+    pixelShaderVars["UpscalingCB"]["gPrevCameraPos"] = mLastCameraPos;
+    pixelShaderVars["UpscalingCB"]["gPrevCameraU"] = mLastCameraU;
+    pixelShaderVars["UpscalingCB"]["gPrevCameraV"] = mLastCameraV;
+    pixelShaderVars["UpscalingCB"]["gPrevCameraW"] = mLastCameraW;
+    pixelShaderVars["UpscalingCB"]["gBlendFactor"] = mBlendFactor;
+    pixelShaderVars["UpscalingCB"]["gClampGamma"] = mClampGamma;
+    pixelShaderVars["UpscalingCB"]["gHistoryValid"] = mHistoryValid;
+    pixelShaderVars["UpscalingCB"]["gCameraStatic"] = isCameraStatic();
+    pixelShaderVars["UpscalingCB"]["gReprojectHistory"] = !mpRenderScale->isMultiView();
+    pixelShaderVars["gInput"] = inTexture;
+    pixelShaderVars["gWsPos"] = mpResManager->getTexture("WorldPosition");
+    pixelShaderVars["gHistory"] = mpHistory;
+    mpUpscaleShader->execute(pRenderContext, mpGfxState);
+
+    // Converts to the output channel's format, if it's not RGBA32Float. The history keeps full
+    // precision.
+    pRenderContext->blit(mpInternalFbo->getColorTexture(0)->getSRV(), outTexture->getRTV());
+    pRenderContext->blit(mpInternalFbo->getColorTexture(0)->getSRV(), mpHistory->getRTV());
+
+    mHistoryValid = true;
+    saveCamera();
+}
+
+bool TemporalUpscalingPass::isCameraStatic() const {
+    const CameraData &cameraData = mpScene->getActiveCamera()->getData();
+    return cameraData.posW == mLastCameraPos && cameraData.cameraU == mLastCameraU
+        && cameraData.cameraV == mLastCameraV && cameraData.cameraW == mLastCameraW;
+}
+
+void TemporalUpscalingPass::saveCamera() {
+    if (!mpScene || !mpScene->getActiveCamera()) {
+        return;
+    }
+
+    // The same basis ThinLensGBuffer.rt.hlsl generates primary rays from; it doesn't include the
+    // jitter.
+    const CameraData &cameraData = mpScene->getActiveCamera()->getData();
+    mLastCameraPos = cameraData.posW;
+    mLastCameraU = cameraData.cameraU;
+    mLastCameraV = cameraData.cameraV;
+    mLastCameraW = cameraData.cameraW;
+}
+
+void TemporalUpscalingPass::stateRefreshed() {
+    mHistoryValid = false;
+}
+
+void TemporalUpscalingPass::resize(uint32_t width, uint32_t height) {
+    mpHistory = Falcor::Texture::create2D(
+        width, height, Falcor::ResourceFormat::RGBA32Float, 1, 1, nullptr, ResourceManager::kDefaultFlags
+    );
+
+    Fbo::Desc fboDesc;
+    fboDesc.setColorTarget(0, ResourceFormat::RGBA32Float);
+    mpInternalFbo = FboHelper::create2D(width, height, fboDesc);
+    mpGfxState->setFbo(mpInternalFbo);
+
+    mHistoryValid = false;
+}
+
+void TemporalUpscalingPass::renderGui(Gui* pGui) {
+    int dirty = 0;
+
+    float scale = mpRenderScale->getScale();
+    if (pGui->addFloatVar("Render scale", scale, 0.25f, 1.0f, 0.05f)) {
+        mpRenderScale->setScale(scale);
+        dirty = 1;
+    }
+
+    dirty |= (int)pGui->addFloatVar("Minimum current frame weight", mBlendFactor, 0.01f, 1.0f, 0.01f);
+    dirty |= (int)pGui->addFloatVar("History clamping (std. dev.)", mClampGamma, 0.5f, 4.0f, 0.05f);
+
+    // Rays are traced for the render resolution; everything after this pass is at the screen size.
+    if (mpResManager) {
+        uvec2 screenSize = mpResManager->getScreenSize();
+        uvec2 renderSize = mpRenderScale->getRenderSize(screenSize);
+        float rayFraction = float(renderSize.x * renderSize.y) / float(screenSize.x * screenSize.y);
+
+        pGui->addText("");
+        pGui->addText((std::string("Render resolution: ") + std::to_string(renderSize.x) + "x" + std::to_string(renderSize.y)).c_str());
+        pGui->addText((std::string("Output resolution: ") + std::to_string(screenSize.x) + "x" + std::to_string(screenSize.y)).c_str());
+        pGui->addText((std::string("Ray cost: ") + std::to_string(int(rayFraction * 100.0f + 0.5f)) + "% of native").c_str());
+        pGui->addText((std::string("Jitter phases: ") + std::to_string(mpRenderScale->getJitterPhaseCount())).c_str());
+    }
+
+    if (dirty) {
+        setRefreshFlag();
+    }
+}
\ No newline at end of file
@@ -0,0 +1,86 @@
+#pragma once
+#include "../SharedUtils/FullscreenLaunch.h"
+#include "../SharedUtils/RenderPass.h"
+#include "../Utils/RenderScale.h"
+
+// Brings a frame rendered at the internal resolution of a RenderScale up to the screen size.
+//
+// Every frame the G-Buffer pass offsets its samples by a different point of a Halton sequence, so
+// over a few frames each output pixel receives samples from all over its area. This pass weighs the
+// current frame's samples by their distance to each output pixel's center and blends them with the
+// previous output, reprojected with the surface position in the G-Buffer and the previous camera.
+// The history is clamped to the mean and standard deviation of the neighboring samples so that
+// disoccluded and changing surfaces don't ghost. Unlike TemporalAccumulationPass, it keeps reusing
+// samples while the camera moves. While the camera is static, each frame's upsampled samples are
+// passed through as they are and accumulating them is left to TemporalAccumulationPass, which
+// weighs them by their samples per pixel.
+//
+// At a render scale of 1 there's nothing to upscale: the input is copied to the output as is.
+class TemporalUpscalingPass : public ::RenderPass, inherit_shared_from_this<::RenderPass, TemporalUpscalingPass> {
+protected:
+    // Low-resolution input (in its top-left region) and full-resolution output.
+    std::string mInChannel;
+    std::string mOutChannel;
+
+    Falcor::ResourceFormat mFormat;
+
+    RenderScale::SharedPtr mpRenderScale;
+
+    Falcor::Scene::SharedPtr mpScene;
+
+    // Position and (unnormalized, unjittered) basis of the camera as of the last frame.
+    glm::vec3 mLastCameraPos;
+    glm::vec3 mLastCameraU;
+    glm::vec3 mLastCameraV;
+    glm::vec3 mLastCameraW;
+
+    // False when there's no previous output to reuse (new scene, resize, changed settings).
+    bool mHistoryValid = false;
+
+    Falcor::GraphicsState::SharedPtr mpGfxState;
+
+    Falcor::Fbo::SharedPtr mpInternalFbo;
+
+    FullscreenLaunch::SharedPtr mpUpscaleShader;
+
+    // Last frame's output, in RGBA32Float. Alpha is the number of frames accumulated in it.
+    Falcor::Texture::SharedPtr mpHistory;
+
+    float mBlendFactor = 0.1f;
+    float mClampGamma = 1.25f;
+
+    TemporalUpscalingPass(const std::string &inChannel, const std::string &outChannel, RenderScale::SharedPtr pRenderScale, Falcor::ResourceFormat format) : RenderPass("Temporal Upscaling Pass", "Temporal Upscaling Options") {
+        mInChannel = inChannel;
+        mOutChannel = outChannel;
+        mpRenderScale = pRenderScale;
+        mFormat = format;
+    };
+
+    bool initialize(RenderContext *pRenderContext, ResourceManager::SharedPtr pResManager) override;
+
+    void initScene(RenderContext *pRenderContext, Falcor::Scene::SharedPtr pScene) override;
+
+    void execute(RenderContext *pRenderContext) override;
+
+    void stateRefreshed() override;
+
+    void resize(uint32_t width, uint32_t height) override;
+
+    void renderGui(Gui* pGui) override;
+
+    void saveCamera();
+
+    // Whether the active camera has the basis saved by saveCamera().
+    bool isCameraStatic() const;
+
+public:
+    using SharedPtr = std::shared_ptr<TemporalUpscalingPass>;
+
+    static SharedPtr create(const std::string &inChannel, const std::string &outChannel, RenderScale::SharedPtr pRenderScale, Falcor::ResourceFormat format = Falcor::ResourceFormat::RGBA32Float) {
+        return SharedPtr(new TemporalUpscalingPass(inChannel, outChannel, pRenderScale, format));
+    }
+
+    bool requiresScene() override {
+        return true;
+    }
+};
\ No newline at end of file
@@ -30,10 +30,12 @@ bool ThinLensGBufferPass::initialize(Falcor::RenderContext *pRenderContext, Reso
         "MaterialDiffuse",
         "MaterialSpecRough",
         "MaterialExtraParams", 
-        "MaterialEmissive"
+        "MaterialEmissive",
+        "RayCone"
     });
 
-    mpResManager->updateEnvironmentMap(kEnvironmentMap);
+    // Decoded asynchronously; the first frames render with a placeholder environment.
+    mpEnvMapLoader = EnvironmentMapLoader::get(kEnvironmentMap);
 
     mpResManager->setDefaultSceneName("Scenes\\PinkRoom\\pink_room.fscene");
 
@@ -46,6 +48,23 @@ bool ThinLensGBufferPass::initialize(Falcor::RenderContext *pRenderContext, Reso
         mpRayTracer->setScene(mpScene);
     }
 
+    mpViewLayout = MultiViewLayout::create();
+
+    // Rasterized primary visibility for the pinhole camera.
+    mpPinholeRasterizer = PinholeRasterizer::create(mpResManager);
+    mpPinholeRasterizer->setScene(mpScene);
+
+    mpPrimaryTimer = GpuTimer::create();
+
+    mpOpacityStateKeys = Texture::create2D(
+        kOpacityStatesWidth, kOpacityStatesHeight, ResourceFormat::R32Uint, 1, 1, nullptr,
+        Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+    );
+    mpOpacityStates = Texture::create2D(
+        kOpacityStatesWidth, kOpacityStatesHeight, ResourceFormat::R32Uint, 1, 1, nullptr,
+        Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+    );
+
     // Set up the pseudo-random number generator.
     auto currentTime = std::chrono::high_resolution_clock::now();
     auto timeInMilliSecs = std::chrono::time_point_cast<std::chrono::milliseconds>(currentTime);
@@ -61,6 +80,12 @@ void ThinLensGBufferPass::execute(Falcor::RenderContext *pRenderContext) {
         return;
     }
 
+    // Swap in the environment map once it has been decoded; accumulated frames rendered with the
+    // placeholder are discarded.
+    if (mpEnvMapLoader->update(mpResManager)) {
+        setRefreshFlag();
+    }
+
     mLensRadius = mFocalLength / (2.0f * mFNumber);
 
     // Load G-Buffer textures.
@@ -70,9 +95,14 @@ void ThinLensGBufferPass::execute(Falcor::RenderContext *pRenderContext) {
     Falcor::Texture::SharedPtr worldSpaceNormal = mpResManager->getClearedTexture("WorldNormal", vec4(0, 0, 0, 0));
     Falcor::Texture::SharedPtr worldSpaceShadingNormal = mpResManager->getClearedTexture("WorldShadingNormal", vec4(0, 0, 0, 0));
     Falcor::Texture::SharedPtr materialDiffuse = mpResManager->getClearedTexture("MaterialDiffuse", vec4(0, 0, 0, 0));
-    Falcor::Texture::SharedPtr materialSpecularRoughness = mpResManager->getClearedTexture("MatSpecRough", vec4(0, 0, 0, 0));
+    Falcor::Texture::SharedPtr materialSpecularRoughness = mpResManager->getClearedTexture("MaterialSpecRough", vec4(0, 0, 0, 0));
     Falcor::Texture::SharedPtr materialExtraParams = mpResManager->getClearedTexture("MaterialExtraParams", vec4(0, 0, 0, 0));
     Falcor::Texture::SharedPtr materialEmissive = mpResManager->getClearedTexture("MaterialEmissive", vec4(0, 0, 0, 0));
+    Falcor::Texture::SharedPtr rayCone = mpResManager->getClearedTexture("RayCone", vec4(0, 0, 0, 0));
+
+    // Only the top-left region of the G-Buffers is rendered when rendering below the screen size.
+    uvec2 screenSize = mpResManager->getScreenSize();
+    uvec2 renderSize = mpRenderScale ? mpRenderScale->getRenderSize(screenSize) : screenSize;
 
     // Lens parameters are relevant when computing primary ray origins, so they go in the ray
     // generation shader.
@@ -80,6 +110,16 @@ void ThinLensGBufferPass::execute(Falcor::RenderContext *pRenderContext) {
     rayGenVars["RayGenCB"]["gFrameCount"] = mFrameCount++;
     rayGenVars["RayGenCB"]["gLensRadius"] = mUseThinLens ? mLensRadius : 0.0f;
     rayGenVars["RayGenCB"]["gFocalLength"] = mFocalLength;
+    rayGenVars["RayGenCB"]["gUseTextureLOD"] = mUseTextureLOD;
+    // Textures are filtered for the output resolution, not the render resolution, so that the
+    // upscaled image keeps their detail.
+    rayGenVars["RayGenCB"]["gTextureLODHeight"] = screenSize.y;
+    uint32_t viewCount = mpViewLayout->setShaderData(rayGenVars, mpScene);
+    // The upscaler reprojects history with the active camera, which only sees the whole screen in
+    // single-view frames.
+    if (mpRenderScale) {
+        mpRenderScale->setMultiView(viewCount > 1);
+    }
     rayGenVars["gRayOriginOnLens"] = primaryRayOriginOnLens;
     rayGenVars["gPrimaryRayDirection"] = primaryRayDirection;
 
@@ -92,6 +132,15 @@ void ThinLensGBufferPass::execute(Falcor::RenderContext *pRenderContext) {
         hitVars["gMatSpec"] = materialSpecularRoughness;
         hitVars["gMatExtra"] = materialExtraParams;
         hitVars["gMatEmissive"] = materialEmissive;
+        hitVars["gRayCone"] = rayCone;
+        hitVars["gOpacityStateKeys"] = mpOpacityStateKeys;
+        hitVars["gOpacityStates"] = mpOpacityStates;
+    }
+
+    if (mResetOpacityStates) {
+        pRenderContext->clearUAV(mpOpacityStateKeys->getUAV().get(), uvec4(0));
+        pRenderContext->clearUAV(mpOpacityStates->getUAV().get(), uvec4(0));
+        mResetOpacityStates = false;
     }
 
     auto missVars = mpRayTracer->getMissVars(0);
@@ -101,20 +150,40 @@ void ThinLensGBufferPass::execute(Falcor::RenderContext *pRenderContext) {
     missVars["gMatDif"] = materialDiffuse;
     missVars["gEnvMap"] = mpResManager->getTexture(ResourceManager::kEnvironmentMap);
 
+    vec2 pixelJitter = vec2(0.0f);
     if (mUseJitter && mpScene && mpScene->getActiveCamera()) {
-        // Jitter the camera with random subpixel offsets of size up to half a pixel.
-        float xJitter = mRNGDistribution(mPRNG) - 0.5f;
-        // The size of the viewport can be gotten from any of the G-Buffers.
-        float xSubpixelOffset = xJitter / float(worldSpacePosition->getWidth());
-        float yJitter = mRNGDistribution(mPRNG) - 0.5f;
-        float ySubpixelOffset = yJitter / float(worldSpacePosition->getHeight());
-        mpScene->getActiveCamera()->setJitter(xSubpixelOffset, ySubpixelOffset);
+        // Jitter the camera with subpixel offsets of size up to half a pixel.
+        pixelJitter = mpRenderScale
+            ? mpRenderScale->getHaltonJitter(mFrameCount)
+            : vec2(mRNGDistribution(mPRNG) - 0.5f, mRNGDistribution(mPRNG) - 0.5f);
+        // The size of the viewport is the size of the region of the G-Buffers being rendered.
+        mpScene->getActiveCamera()->setJitter(pixelJitter.x / float(renderSize.x), pixelJitter.y / float(renderSize.y));
+    }
+
+    // Just the jitter size, not the subpixel offset.
+    rayGenVars["RayGenCB"]["gPixelJitter"] = pixelJitter;
+    if (mpRenderScale) {
+        mpRenderScale->setJitter(pixelJitter);
+    }
 
-        // Just the jitter size, not the subpixel offset.
-        rayGenVars["RayGenCB"]["gPixelJitter"] = vec2(xJitter, yJitter);
+    // Time the previous frame's primary visibility now that it has most likely finished; reading
+    // the timer right after end() would stall until the GPU catches up.
+    if (mTimerPending) {
+        float ms = float(mpPrimaryTimer->getElapsedTime());
+        float &average = mPrimaryVisibilityMs[mTimedRasterized ? 1 : 0];
+        average = average < 0.0f ? ms : 0.95f * average + 0.05f * ms;
     }
 
-    mpRayTracer->execute(pRenderContext, mpResManager->getScreenSize());
+    bool rasterize = !mUseThinLens && mRasterizePinhole && viewCount == 1 && mpPinholeRasterizer->canRender();
+    mpPrimaryTimer->begin();
+    if (rasterize) {
+        mpPinholeRasterizer->execute(pRenderContext, renderSize, pixelJitter, mBgColor, mUseEnvMap, mUseTextureLOD);
+    } else {
+        mpRayTracer->execute(pRenderContext, renderSize);
+    }
+    mpPrimaryTimer->end();
+    mTimerPending = true;
+    mTimedRasterized = rasterize;
 }
 
 void ThinLensGBufferPass::initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene) {
@@ -122,6 +191,10 @@ void ThinLensGBufferPass::initScene(RenderContext* pRenderContext, Scene::Shared
 	if (mpRayTracer) {
         mpRayTracer->setScene(mpScene);
     }
+    if (mpPinholeRasterizer) {
+        mpPinholeRasterizer->setScene(mpScene);
+    }
+    mResetOpacityStates = true;
 }
 
 void ThinLensGBufferPass::renderGui(Gui* pGui) {
@@ -134,7 +207,26 @@ void ThinLensGBufferPass::renderGui(Gui* pGui) {
 		pGui->addText("     ");
         dirty |= (int)pGui->addFloatVar("f-number", mFNumber, 1.0f, 128.0f, 0.01f, true);
         pGui->addText("     ");
-	}
+	} else {
+        dirty |= (int)pGui->addCheckBox(mRasterizePinhole ? "Rasterized primary visibility" : "Ray traced primary visibility", mRasterizePinhole);
+    }
+
+    // Toggle between the two with a static camera; both are timed the same way.
+    const char *primaryVisibilityNames[2] = { "Ray traced", "Rasterized" };
+    for (uint32_t mode = 0; mode < 2; mode++) {
+        char buffer[128];
+        if (mPrimaryVisibilityMs[mode] < 0.0f) {
+            snprintf(buffer, sizeof(buffer), "%s primary visibility: not measured", primaryVisibilityNames[mode]);
+        } else {
+            snprintf(buffer, sizeof(buffer), "%s primary visibility: %.3f ms", primaryVisibilityNames[mode], mPrimaryVisibilityMs[mode]);
+        }
+        pGui->addText(buffer);
+    }
+    if (mPrimaryVisibilityMs[0] > 0.0f && mPrimaryVisibilityMs[1] > 0.0f) {
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer), "Rasterization speedup: %.2fx", mPrimaryVisibilityMs[0] / mPrimaryVisibilityMs[1]);
+        pGui->addText(buffer);
+    }
 
     if (mpScene) {
         pGui->addText("     ");
@@ -142,6 +234,8 @@ void ThinLensGBufferPass::renderGui(Gui* pGui) {
         // Choose among the preconfigured cameras available in the scene description file.
         dirty |= (int)pGui->addIntVar("Active camera", mActiveCameraId, 0, mpScene->getCameraCount()-1, 1, true);
         mpScene->setActiveCamera(mActiveCameraId);
+
+        dirty |= (int)mpViewLayout->renderGui(pGui);
         pGui->addText("     ");
 
         // Export and save the scene as an .fscene file.
@@ -161,10 +255,23 @@ void ThinLensGBufferPass::renderGui(Gui* pGui) {
         pGui->addText("     ");
     }
 
+    // Environment map loading times.
+    if (mpEnvMapLoader) {
+        pGui->addText((std::string("Environment map: ") + mpEnvMapLoader->getFilename()).c_str());
+        pGui->addText((std::string("Time to first frame (ms): ") + std::to_string(mpEnvMapLoader->getTimeToFirstFrame())).c_str());
+        std::string fullyLoaded = mpEnvMapLoader->isLoaded()
+            ? std::string("Time to fully loaded (ms): ") + std::to_string(mpEnvMapLoader->getTimeToFullyLoaded())
+            : std::string("Loading...");
+        pGui->addText(fullyLoaded.c_str());
+        pGui->addText("     ");
+    }
+
 	dirty |= (int)pGui->addCheckBox(mUseJitter ? "Jitter" : "No jitter", mUseJitter);
 
 	dirty |= (int)pGui->addCheckBox(mUseEnvMap ? "Environment map" : "Background color", mUseEnvMap);
 
+	dirty |= (int)pGui->addCheckBox(mUseTextureLOD ? "Ray cone texture LOD" : "Full-resolution textures", mUseTextureLOD);
+
 	if (dirty) {
         setRefreshFlag();
     }
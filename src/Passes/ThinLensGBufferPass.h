@@ -3,13 +3,41 @@
 #include "../SharedUtils/RenderPass.h"
 #include "../SharedUtils/ResourceManager.h"
 #include "../SharedUtils/RayLaunch.h"
+#include "../Utils/EnvironmentMapLoader.h"
+#include "../Utils/MultiViewLayout.h"
+#include "../Utils/PinholeRasterizer.h"
+#include "../Utils/RenderScale.h"
 
 class ThinLensGBufferPass : public ::RenderPass, inherit_shared_from_this<::RenderPass, ThinLensGBufferPass> {
 protected:
     RayLaunch::SharedPtr mpRayTracer;
+    EnvironmentMapLoader::SharedPtr mpEnvMapLoader;
+
+    // Internal render resolution; nullptr renders at the screen size. With it, the subpixel jitter
+    // follows a Halton sequence instead of mPRNG, so that it covers the pixel evenly for upscaling.
+    RenderScale::SharedPtr mpRenderScale;
 
     Falcor::RtScene::SharedPtr mpScene;
 
+    // Per-triangle opacity states of alpha-masked geometry hit by primary rays; see
+    // AlphaTesting.hlsli. Must match OPACITY_STATES_WIDTH and OPACITY_STATES_HEIGHT.
+    static const uint32_t kOpacityStatesWidth = 2048;
+    static const uint32_t kOpacityStatesHeight = 1024;
+    Texture::SharedPtr mpOpacityStateKeys;
+    Texture::SharedPtr mpOpacityStates;
+    bool mResetOpacityStates = true;
+
+    // Used when the thin lens is disabled and mRasterizePinhole is set; see PinholeRasterizer.
+    bool mRasterizePinhole = true;
+    PinholeRasterizer::SharedPtr mpPinholeRasterizer;
+
+    // GPU time of primary visibility, ray traced [0] and rasterized [1]; a running average, or
+    // negative until measured.
+    GpuTimer::SharedPtr mpPrimaryTimer;
+    bool mTimerPending = false;
+    bool mTimedRasterized = false;
+    float mPrimaryVisibilityMs[2] = { -1.0f, -1.0f };
+
     // Mersenne Twister pseudo-random generator of 32-bit numbers with a state size of 19937 bits.
     std::mt19937 mPRNG;
     std::uniform_real_distribution<float> mRNGDistribution;
@@ -24,12 +52,21 @@ protected:
     float mFNumber = 32.0f;
     int32_t mActiveCameraId = 1;
 
+    // Multiple views are always ray traced.
+    MultiViewLayout::SharedPtr mpViewLayout;
+
     vec3 mBgColor = vec3(0.5f, 0.5f, 1.0f);
     bool mUseEnvMap = true;
 
+    // Select the mip level of material textures from the footprint (ray cone) of primary rays.
+    // The path tracer continues the cones of primary rays from the RayCone channel of the G-Buffer.
+    bool mUseTextureLOD = true;
+
     uint mFrameCount = 0xdeadbeef;
 
-    ThinLensGBufferPass() : ::RenderPass("Thin Lens Camera", "Camera Settings") {}
+    ThinLensGBufferPass(RenderScale::SharedPtr pRenderScale) : ::RenderPass("Thin Lens Camera", "Camera Settings") {
+        mpRenderScale = pRenderScale;
+    }
 
     bool initialize(Falcor::RenderContext *pRenderContext, ResourceManager::SharedPtr pResManager) override;
 
@@ -42,8 +79,8 @@ protected:
 public:
     using SharedPtr = std::shared_ptr<ThinLensGBufferPass>;
 
-    static SharedPtr create() {
-        return SharedPtr(new ThinLensGBufferPass());
+    static SharedPtr create(RenderScale::SharedPtr pRenderScale = nullptr) {
+        return SharedPtr(new ThinLensGBufferPass(pRenderScale));
     }
 
     virtual ~ThinLensGBufferPass() = default;
@@ -1,39 +1,148 @@
 #include "ToneMappingPass.h"
 
+namespace {
+    const char *kHistogramShader = "Shaders\\LuminanceHistogram.cs.hlsl";
+    const char *kExposureShader = "Shaders\\AutoExposure.cs.hlsl";
+    const char *kToneMapShader = "Shaders\\ToneMapping.ps.hlsl";
+
+    // Tile size of the histogram shader.
+    const uint32_t kTileSize = 16;
+};
+
 bool ToneMappingPass::initialize(RenderContext* pRenderContext, ResourceManager::SharedPtr pResManager) {
 	if (!pResManager) return false;
 
 	mpResManager = pResManager;
-	mpResManager->requestTextureResources({ mInChannel, mOutChannel });
+	mpResManager->requestTextureResource(mInChannel, mInFormat);
+	mpResManager->requestTextureResource(mOutChannel);
 
 	mpResManager->setDefaultSceneName("Data/pink_room/pink_room.fscene");
 
-    // This class delegates all the work to Falcor's ToneMapping class.
-	mpToneMapper = ToneMapping::create(ToneMapping::Operator::Clamp);
+    mpHistogramProgram = ComputeProgram::createFromFile(kHistogramShader, "main");
+    mpHistogramVars = ComputeVars::create(mpHistogramProgram->getReflector());
+    mpHistogramState = ComputeState::create();
+    mpHistogramState->setProgram(mpHistogramProgram);
+
+    mpExposureProgram = ComputeProgram::createFromFile(kExposureShader, "main");
+    mpExposureVars = ComputeVars::create(mpExposureProgram->getReflector());
+    mpExposureState = ComputeState::create();
+    mpExposureState->setProgram(mpExposureProgram);
+
+    mpToneMapShader = FullscreenLaunch::create(kToneMapShader);
 
 	mpGfxState = GraphicsState::create();
 
+    // The exposure shader clears the histogram after reading it, so it only needs to start cleared.
+    std::vector<uint32_t> zeros(kHistogramBinCount, 0);
+    mpHistogram = TypedBuffer<uint32_t>::create(kHistogramBinCount, Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess);
+    mpHistogram->setBlob(zeros.data(), 0, zeros.size() * sizeof(uint32_t));
+
+    float initialLuminance = mKeyValue;
+    mpAdaptedLuminance = Texture::create2D(
+        1, 1, ResourceFormat::R32Float, 1, 1, &initialLuminance, Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+    );
+
+    mLastFrameTime = std::chrono::high_resolution_clock::now();
+
 	return true;
 }
 
+void ToneMappingPass::initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene) {
+    // Don't make the new scene fade in from the exposure of the old one.
+    mResetAdaptation = true;
+}
+
 void ToneMappingPass::execute(RenderContext* pRenderContext) {
 	if (!mpResManager) return;
    
     // Get render target produced by the previous pass. It is assumed that this is an HDR render,
 	// due to the use of an HDR environment map.
     Texture::SharedPtr renderTargetToToneMap = mpResManager->getTexture(mInChannel);
+    if (!renderTargetToToneMap) return;
+
+    if (mAutoExposure) {
+        computeExposure(pRenderContext, renderTargetToToneMap);
+    }
 
     // Tone mapped result.
 	Fbo::SharedPtr toneMappedFbo = mpResManager->createManagedFbo({ mOutChannel });
+    mpGfxState->setFbo(toneMappedFbo);
 
-	// You can push multiple graphics contexts to a stack and the top one will be the active one.
-    // It is said that Falcor's tone mapper has unintended effects on the graphics context, so we
-    // push one, execute the tone mapper, and then pop it to activate the original context again.
-	pRenderContext->pushGraphicsState(mpGfxState);
-    mpToneMapper->execute(pRenderContext, renderTargetToToneMap, toneMappedFbo);
-	pRenderContext->popGraphicsState();
+    auto pixelShaderVars = mpToneMapShader->getVars();
+    pixelShaderVars["ToneMappingCB"]["gOperator"] = mOperator;
+    pixelShaderVars["ToneMappingCB"]["gAutoExposure"] = mAutoExposure;
+    pixelShaderVars["ToneMappingCB"]["gExposureCompensation"] = mExposureCompensation;
+    pixelShaderVars["ToneMappingCB"]["gKeyValue"] = mKeyValue;
+    pixelShaderVars["ToneMappingCB"]["gWhitePoint"] = mWhitePoint;
+    pixelShaderVars["gInput"] = renderTargetToToneMap;
+    pixelShaderVars["gAdaptedLuminance"] = mpAdaptedLuminance;
+    mpToneMapShader->execute(pRenderContext, mpGfxState);
+}
+
+void ToneMappingPass::computeExposure(RenderContext* pRenderContext, Texture::SharedPtr pInput) {
+    uint32_t width = pInput->getWidth();
+    uint32_t height = pInput->getHeight();
+    float logLuminanceRange = mMaxLogLuminance - mMinLogLuminance;
+
+    // Adaptation follows wall-clock time, not frame count, so that it looks the same at any frame
+    // rate. Long stalls (loading, resizing) are clamped so they don't snap the exposure.
+    auto now = std::chrono::high_resolution_clock::now();
+    float deltaTime = std::min(std::chrono::duration<float>(now - mLastFrameTime).count(), 0.1f);
+    mLastFrameTime = now;
+
+    // Histogram: one thread per pixel, one thread group per tile.
+    mpHistogramVars["HistogramCB"]["gInputSize"] = uvec2(width, height);
+    mpHistogramVars["HistogramCB"]["gMinLogLuminance"] = mMinLogLuminance;
+    mpHistogramVars["HistogramCB"]["gInvLogLuminanceRange"] = 1.0f / logLuminanceRange;
+    mpHistogramVars->setTexture("gInput", pInput);
+    mpHistogramVars->setTypedBuffer("gHistogram", mpHistogram);
+
+    pRenderContext->setComputeState(mpHistogramState);
+    pRenderContext->setComputeVars(mpHistogramVars);
+    pRenderContext->dispatch((width + kTileSize - 1) / kTileSize, (height + kTileSize - 1) / kTileSize, 1);
+
+    // The exposure pass reads what every tile wrote.
+    pRenderContext->uavBarrier(mpHistogram.get());
+
+    // Reduction and adaptation: a single thread group, one thread per bin.
+    mpExposureVars["ExposureCB"]["gPixelCount"] = width * height;
+    mpExposureVars["ExposureCB"]["gMinLogLuminance"] = mMinLogLuminance;
+    mpExposureVars["ExposureCB"]["gLogLuminanceRange"] = logLuminanceRange;
+    mpExposureVars["ExposureCB"]["gDeltaTime"] = deltaTime;
+    mpExposureVars["ExposureCB"]["gAdaptationSpeed"] = mAdaptationSpeed;
+    mpExposureVars["ExposureCB"]["gResetAdaptation"] = mResetAdaptation;
+    mpExposureVars->setTypedBuffer("gHistogram", mpHistogram);
+    mpExposureVars->setTexture("gAdaptedLuminance", mpAdaptedLuminance);
+
+    pRenderContext->setComputeState(mpExposureState);
+    pRenderContext->setComputeVars(mpExposureVars);
+    pRenderContext->dispatch(1, 1, 1);
+
+    mResetAdaptation = false;
 }
 
 void ToneMappingPass::renderGui(Gui* pGui) {
-	mpToneMapper->renderUI(pGui, nullptr); 
-}
\ No newline at end of file
+    Gui::DropdownList operators;
+    operators.push_back({ int32_t(Operator::Clamp), "Clamp" });
+    operators.push_back({ int32_t(Operator::Reinhard), "Reinhard" });
+    operators.push_back({ int32_t(Operator::ACES), "ACES" });
+    operators.push_back({ int32_t(Operator::AgX), "AgX" });
+    pGui->addDropdown("Operator", operators, mOperator);
+
+    if (mOperator == uint32_t(Operator::Reinhard)) {
+        pGui->addFloatVar("White point", mWhitePoint, 0.01f, FLT_MAX, 0.01f);
+    }
+
+    pGui->addText("");
+    if (pGui->addCheckBox(mAutoExposure ? "Automatic exposure" : "Manual exposure", mAutoExposure)) {
+        mResetAdaptation = true;
+    }
+    pGui->addFloatVar(mAutoExposure ? "Exposure compensation (stops)" : "Exposure (stops)", mExposureCompensation, -16.0f, 16.0f, 0.1f);
+
+    if (mAutoExposure) {
+        pGui->addFloatVar("Key value", mKeyValue, 0.01f, 1.0f, 0.01f);
+        pGui->addFloatVar("Adaptation speed", mAdaptationSpeed, 0.01f, 100.0f, 0.1f);
+        pGui->addFloatVar("Min log2 luminance", mMinLogLuminance, -32.0f, mMaxLogLuminance - 1.0f, 0.5f);
+        pGui->addFloatVar("Max log2 luminance", mMaxLogLuminance, mMinLogLuminance + 1.0f, 32.0f, 0.5f);
+    }
+}
@@ -1,29 +1,91 @@
 #pragma once
+#include <chrono>
 #include "Falcor.h"
 #include "../SharedUtils/RenderPass.h"
-#include "../SharedUtils/RayLaunch.h"
+#include "../SharedUtils/FullscreenLaunch.h"
 
-// Applies tone mapping post-processing, delegating the work to Falcor's ToneMapping class.
+// Applies tone mapping post-processing. Defaults to clamping at a fixed exposure; the other operators
+// and automatic exposure are options in the GUI.
+//
+// The automatic exposure comes from a luminance histogram of the HDR frame built on the GPU: a
+// compute pass bins each 16x16 tile in group shared memory and merges the tile histograms into a
+// global one, and a second, single-group compute pass reduces the histogram to the frame's mean log
+// luminance and adapts to it over time, like an eye would. A fullscreen pass then applies the
+// exposure and the selected operator.
 class ToneMappingPass : public ::RenderPass, inherit_shared_from_this<::RenderPass, ToneMappingPass> {
+public:
+    // Must match the OPERATOR_* defines of ToneMapping.ps.hlsl.
+    enum class Operator : uint32_t {
+        Clamp = 0,
+        Reinhard,
+        ACES,
+        AgX
+    };
+
 protected:
+    // Must match HISTOGRAM_BIN_COUNT in ToneMapping.hlsli.
+    static const uint32_t kHistogramBinCount = 256;
+
     // The name of the render target produced by the previous pass. Assumed to be HDR due to the
     // use of an HDR environment map.
     std::string mInChannel;
 
+    ResourceFormat mInFormat;
+
     // The name of the tone mapped result.
     std::string mOutChannel;
 
-    // Falcor's ToneMapping class.
-    ToneMapping::SharedPtr mpToneMapper;
+    ComputeProgram::SharedPtr mpHistogramProgram;
+    ComputeVars::SharedPtr mpHistogramVars;
+    ComputeState::SharedPtr mpHistogramState;
+
+    ComputeProgram::SharedPtr mpExposureProgram;
+    ComputeVars::SharedPtr mpExposureVars;
+    ComputeState::SharedPtr mpExposureState;
+
+    FullscreenLaunch::SharedPtr mpToneMapShader;
 
     GraphicsState::SharedPtr mpGfxState;
 
-	ToneMappingPass(const std::string &inBuffer, const std::string &outBuffer) 
-        : ::RenderPass("Tone Mapping", "Tone Mapping Settings"), mInChannel(inBuffer), mOutChannel(outBuffer)
+    // kHistogramBinCount counters.
+    TypedBuffer<uint32_t>::SharedPtr mpHistogram;
+
+    // 1x1. The luminance the exposure has adapted to; persists across frames.
+    Texture::SharedPtr mpAdaptedLuminance;
+
+    uint32_t mOperator = uint32_t(Operator::Clamp);
+
+    bool mAutoExposure = false;
+
+    // In stops.
+    float mExposureCompensation = 0.0f;
+
+    // Middle gray.
+    float mKeyValue = 0.18f;
+
+    // For Reinhard.
+    float mWhitePoint = 4.0f;
+
+    // Range of the histogram, in log2 luminance. Luminance outside of it is clamped to the first or
+    // last bin.
+    float mMinLogLuminance = -10.0f;
+    float mMaxLogLuminance = 6.0f;
+
+    float mAdaptationSpeed = 1.5f;
+
+    // The adapted luminance jumps to the current frame's instead of adapting to it.
+    bool mResetAdaptation = true;
+
+    std::chrono::high_resolution_clock::time_point mLastFrameTime;
+
+	ToneMappingPass(const std::string &inBuffer, const std::string &outBuffer, ResourceFormat inFormat) 
+        : ::RenderPass("Tone Mapping", "Tone Mapping Settings"), mInChannel(inBuffer), mInFormat(inFormat), mOutChannel(outBuffer)
     {}
 
     bool initialize(RenderContext* pRenderContext, ResourceManager::SharedPtr pResManager) override;
 
+    void initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene) override;
+
     void execute(RenderContext* pRenderContext) override;
 
 	void renderGui(Gui* pGui) override;
@@ -32,13 +94,16 @@ protected:
 		return true;
 	}
 
+    // Builds the histogram of the frame and updates the adapted luminance.
+    void computeExposure(RenderContext* pRenderContext, Texture::SharedPtr pInput);
+
 public:
     using SharedPtr = std::shared_ptr<ToneMappingPass>;
 
     using SharedConstPtr = std::shared_ptr<const ToneMappingPass>;
 
-    static SharedPtr create(const std::string &inBuffer, const std::string &outBuffer) { 
-        return SharedPtr(new ToneMappingPass(inBuffer, outBuffer));
+    static SharedPtr create(const std::string &inBuffer, const std::string &outBuffer, ResourceFormat inFormat = ResourceFormat::RGBA32Float) { 
+        return SharedPtr(new ToneMappingPass(inBuffer, outBuffer, inFormat));
     }
 
     virtual ~ToneMappingPass() = default;
@@ -4,8 +4,13 @@
 #include "../SharedUtils/RayLaunch.h"
 
 namespace {
-    // Shader file.
-    const char *kShaderFile = "Shaders\\PathTracing.rt.hlsl";
+    // Shader file of each BsdfConfiguration.
+    const char *kShaderFiles[] = {
+        "Shaders\\PathTracing.rt.hlsl",
+        "Shaders\\PathTracingDiffuse.rt.hlsl",
+        "Shaders\\PathTracingDiffuseSpecular.rt.hlsl",
+        "Shaders\\PathTracingAllBxDFs.rt.hlsl"
+    };
 
     // Entrypoints.
     const char *kEntryPointRayGen = "PathTracingRayGen";
@@ -29,78 +34,233 @@ bool UnidirectionalPathTracingPass::initialize(RenderContext* pRenderContext, Re
         "WorldPosition",
         "WorldNormal",
         "WorldShadingNormal",
-        "DirectL",
+        "RayCone",
         "Le",
-        "Wo",
-        "Wi",
-        "BDRF",
-        "PDF"
+        "PixelEstimate"
     });
-    mpResManager->requestTextureResource(mOutputBuffer);
-    mpResManager->updateEnvironmentMap(kEnvironmentMap);
+    mpResManager->requestTextureResource(mOutputBuffer, mOutputFormat);
+    mpResManager->requestTextureResource("VisibilityKey", ResourceFormat::RGBA32Float);
+    mpResManager->requestTextureResource("VisibilityMask", ResourceFormat::RGBA32Uint);
+    // Decoded asynchronously; the first frames render with a placeholder environment.
+    mpEnvMapLoader = EnvironmentMapLoader::get(kEnvironmentMap);
     mpResManager->setDefaultSceneName("Data/pink_room/pink_room.fscene");
 
-    mpRayTracer = RayLaunch::create(kShaderFile, kEntryPointRayGen);
-    // Ray type / hit group 0: path tracing rays.
-    mpRayTracer->addMissShader(kShaderFile, kEntryPointPTMiss);
-    mpRayTracer->addHitShader(kShaderFile, kEntryPointPTClosestHit, kEntryPointPTAnyHit);
-    // Ray type / hit group 1: shadow rays.
-    mpRayTracer->addMissShader(kShaderFile, kEntryPointShadowMiss);
-    mpRayTracer->addHitShader(kShaderFile, kEntryPointShadowClosestHit, kEntryPointShadowAnyHit);
+    mpRadianceCache = Texture::create2D(
+        kRadianceCacheWidth, kRadianceCacheHeight, ResourceFormat::R32Uint, 1, 1, nullptr,
+        Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+    );
+
+    mpOpacityStateKeys = Texture::create2D(
+        kOpacityStatesWidth, kOpacityStatesHeight, ResourceFormat::R32Uint, 1, 1, nullptr,
+        Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+    );
+    mpOpacityStates = Texture::create2D(
+        kOpacityStatesWidth, kOpacityStatesHeight, ResourceFormat::R32Uint, 1, 1, nullptr,
+        Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+    );
+    mpOpacityStats = Texture::create2D(
+        2, 1, ResourceFormat::R32Uint, 1, 1, nullptr,
+        Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+    );
 
-    mpRayTracer->compileRayProgram();
+    mpShadowCascades = ShadowCascades::create();
+    mpShadowMapStats = Texture::create2D(
+        4, 1, ResourceFormat::R32Uint, 1, 1, nullptr,
+        Resource::BindFlags::ShaderResource | Resource::BindFlags::UnorderedAccess
+    );
+    mpFrameTimer = GpuTimer::create();
+
+    mpRayTracer = createRayTracer(BsdfConfiguration(mBsdfConfiguration));
+    mpRayTracers[mBsdfConfiguration] = mpRayTracer;
     if (mpScene) {
-        mpRayTracer->setScene(mpScene);
+        mpShadowCascades->setScene(mpScene);
     }
 
     return true;
 }
 
+RayLaunch::SharedPtr UnidirectionalPathTracingPass::createRayTracer(BsdfConfiguration configuration) {
+    const char *shaderFile = kShaderFiles[uint32_t(configuration)];
+    RayLaunch::SharedPtr pRayTracer = RayLaunch::create(shaderFile, kEntryPointRayGen);
+    // Ray type / hit group 0: path tracing rays.
+    pRayTracer->addMissShader(shaderFile, kEntryPointPTMiss);
+    pRayTracer->addHitShader(shaderFile, kEntryPointPTClosestHit, kEntryPointPTAnyHit);
+    // Ray type / hit group 1: shadow rays.
+    pRayTracer->addMissShader(shaderFile, kEntryPointShadowMiss);
+    pRayTracer->addHitShader(shaderFile, kEntryPointShadowClosestHit, kEntryPointShadowAnyHit);
+
+    pRayTracer->compileRayProgram();
+    if (mpScene) {
+        pRayTracer->setScene(mpScene);
+    }
+    return pRayTracer;
+}
+
 void UnidirectionalPathTracingPass::initScene(RenderContext* pRenderContext, Scene::SharedPtr pScene) {
     mpScene = std::dynamic_pointer_cast<RtScene>(pScene);
-    if (mpRayTracer) mpRayTracer->setScene(mpScene);
+    for (auto &pRayTracer : mpRayTracers) {
+        if (pRayTracer) pRayTracer->setScene(mpScene);
+    }
+    if (mpShadowCascades) mpShadowCascades->setScene(mpScene);
+
+    mResetEstimates = true;
+    mResetVisibilityCache = true;
+    mResetOpacityStates = true;
+}
+
+void UnidirectionalPathTracingPass::stateRefreshed() {
+    mResetEstimates = true;
+    mResetVisibilityCache = true;
 }
 
 void UnidirectionalPathTracingPass::execute(RenderContext* pRenderContext) {
-    Texture::SharedPtr directLTex = mpResManager->getClearedTexture("DirectL", vec4(0.0f, 0.0f, 0.0f, 0.0f));
     Texture::SharedPtr leTex = mpResManager->getClearedTexture("Le", vec4(0.0f, 0.0f, 0.0f, 0.0f));
-    Texture::SharedPtr woTex = mpResManager->getClearedTexture("Wo", vec4(0.0f, 0.0f, 0.0f, 0.0f));
-    Texture::SharedPtr wiTex = mpResManager->getClearedTexture("Wi", vec4(0.0f, 0.0f, 0.0f, 0.0f));
-    Texture::SharedPtr brdfTex = mpResManager->getClearedTexture("BRDF", vec4(0.0f, 0.0f, 0.0f, 0.0f));
-    Texture::SharedPtr pdfTex = mpResManager->getClearedTexture("PDF", vec4(0.0f, 0.0f, 0.0f, 0.0f));
     Texture::SharedPtr outputTex = mpResManager->getClearedTexture(mOutputBuffer, vec4(0.0f, 0.0f, 0.0f, 0.0f));
 
+    // Specialize the kernel for another BSDF configuration the first time it's selected.
+    if (!mpRayTracers[mBsdfConfiguration]) {
+        mpRayTracers[mBsdfConfiguration] = createRayTracer(BsdfConfiguration(mBsdfConfiguration));
+    }
+    mpRayTracer = mpRayTracers[mBsdfConfiguration];
+
     if (!outputTex || !mpRayTracer || !mpRayTracer->readyToRender()) {
         return;
     }
 
+    // Swap in the environment map once it has been decoded; accumulated frames rendered with the
+    // placeholder are discarded.
+    if (mpEnvMapLoader->update(mpResManager)) {
+        setRefreshFlag();
+    }
+
+    // Moving the camera doesn't refresh the passes, but the pixel estimates describe what each
+    // pixel saw. The radiance cache is in world space and stays valid.
+    bool resetPixelEstimates = mResetEstimates;
+    if (mpScene && mpScene->getActiveCamera()) {
+        glm::mat4 cameraMatrix = mpScene->getActiveCamera()->getViewMatrix();
+        resetPixelEstimates = resetPixelEstimates || (cameraMatrix != mLastCameraMatrix);
+        mLastCameraMatrix = cameraMatrix;
+    }
+
+    if (mResetEstimates) {
+        pRenderContext->clearUAV(mpRadianceCache->getUAV().get(), uvec4(0));
+    }
+    if (resetPixelEstimates) {
+        mBenchmarkFrameCount = 0;
+        mBenchmarkSampleCount = 0;
+        mBenchmarkStart = std::chrono::high_resolution_clock::now();
+    }
+
+    // Forget all cached visibility after a scene change.
+    Texture::SharedPtr visibilityMaskTex = mpResManager->getTexture("VisibilityMask");
+    if (mResetVisibilityCache) {
+        pRenderContext->clearUAV(visibilityMaskTex->getUAV().get(), uvec4(0));
+        mResetVisibilityCache = false;
+    }
+
+    if (mResetOpacityStates) {
+        pRenderContext->clearUAV(mpOpacityStateKeys->getUAV().get(), uvec4(0));
+        pRenderContext->clearUAV(mpOpacityStates->getUAV().get(), uvec4(0));
+        mResetOpacityStates = false;
+    }
+
+    // Statistics collected last frame; reading them back a frame later keeps the stall short.
+    if (mOpacityStatsPending) {
+        readOpacityStats(pRenderContext);
+    }
+    bool collectOpacityStats = mUseOpacityStates && ++mOpacityStatsFrameCount == kOpacityStatsFrames;
+    if (collectOpacityStats) {
+        pRenderContext->clearUAV(mpOpacityStats->getUAV().get(), uvec4(0));
+        mOpacityStatsFrameCount = 0;
+    }
+
+    // The GPU time of the previous frame is available by now.
+    if (mFrameTimerPending) {
+        float ms = float(mpFrameTimer->getElapsedTime());
+        if (mTimedBsdfConfiguration != mShadowModeTimingBsdfConfiguration || mTimedRouletteMode != mShadowModeTimingRouletteMode) {
+            for (float &shadowModeMs : mShadowModeMs) {
+                shadowModeMs = -1.0f;
+            }
+            mShadowModeTimingBsdfConfiguration = mTimedBsdfConfiguration;
+            mShadowModeTimingRouletteMode = mTimedRouletteMode;
+        }
+        if (mTimedShadowMode != mBsdfConfigurationTimingShadowMode || mTimedRouletteMode != mBsdfConfigurationTimingRouletteMode) {
+            for (float &configurationMs : mBsdfConfigurationMs) {
+                configurationMs = -1.0f;
+            }
+            mBsdfConfigurationTimingShadowMode = mTimedShadowMode;
+            mBsdfConfigurationTimingRouletteMode = mTimedRouletteMode;
+        }
+        float &average = mShadowModeMs[mTimedShadowMode];
+        average = average < 0.0f ? ms : glm::mix(average, ms, 0.05f);
+        float &configurationAverage = mBsdfConfigurationMs[mTimedBsdfConfiguration];
+        configurationAverage = configurationAverage < 0.0f ? ms : glm::mix(configurationAverage, ms, 0.05f);
+        if (mpSampleBudget) {
+            mpSampleBudget->addMeasurement(ms, mTimedSamplesPerPixel);
+        }
+        mFrameTimerPending = false;
+    }
+
+    if (mShadowStatsPending) {
+        readShadowStats(pRenderContext);
+    }
+    bool collectShadowStats = mShadowMode != uint32_t(ShadowCascades::Mode::Rays) && ++mShadowStatsFrameCount == kShadowStatsFrames;
+    if (collectShadowStats) {
+        pRenderContext->clearUAV(mpShadowMapStats->getUAV().get(), uvec4(0));
+        mShadowStatsFrameCount = 0;
+    }
+
+    // The shadow maps are part of the cost of their mode.
+    mpFrameTimer->begin();
+    if (mShadowMode != uint32_t(ShadowCascades::Mode::Rays)) {
+        mpShadowCascades->update(pRenderContext);
+    }
+
     auto rayGenVars = mpRayTracer->getRayGenVars();
-    rayGenVars["RayGenCB"]["gFrameCount"] = mFrameCount++;
+    uint32_t samplesPerPixel = mpSampleBudget ? mpSampleBudget->beginFrame() : 1;
+    rayGenVars["RayGenCB"]["gFirstSampleIndex"] = mSampleCount;
+    rayGenVars["RayGenCB"]["gSamplesPerPixel"] = samplesPerPixel;
+    mSampleCount += samplesPerPixel;
     rayGenVars["RayGenCB"]["gMaxBounces"] = mMaxBounces;
     rayGenVars["RayGenCB"]["gMinBouncesBeforeRussianRoulette"] = mMinBouncesBeforeRussianRoulette;
     rayGenVars["RayGenCB"]["gTMin"] = mpResManager->getMinTDist();
     rayGenVars["RayGenCB"]["gTMax"] = FLT_MAX;
+    rayGenVars["RayGenCB"]["gRouletteMode"] = mRouletteMode;
+    rayGenVars["RayGenCB"]["gWeightWindowSize"] = mWeightWindowSize;
+    rayGenVars["RayGenCB"]["gMaxLightSamples"] = uint32_t(mMaxLightSamples);
+    rayGenVars["RayGenCB"]["gCacheCellSize"] = mCacheCellSize;
+    rayGenVars["RayGenCB"]["gResetPixelEstimate"] = resetPixelEstimates;
+    rayGenVars["RayGenCB"]["gMaxPixelEstimateSamples"] = mMaxPixelEstimateSamples;
     rayGenVars["gWsPos"] = mpResManager->getTexture("WorldPosition");     
 	rayGenVars["gWsNorm"] = mpResManager->getTexture("WorldNormal");
     rayGenVars["gWsShadingNorm"] = mpResManager->getTexture("WorldShadingNormal");
+    rayGenVars["gRayCone"] = mpResManager->getTexture("RayCone");
     rayGenVars["gRayOriginOnLens"] = mpResManager->getTexture("PrimaryRayOriginOnLens");
     rayGenVars["gPrimaryRayDirection"] = mpResManager->getTexture("PrimaryRayDirection");
-    rayGenVars["gDirectL"] = directLTex;
     rayGenVars["gLe"] = leTex;
-    rayGenVars["gWo"] = woTex;
-    rayGenVars["gWi"] = wiTex;
-    rayGenVars["gBRDF"] = brdfTex;
-    rayGenVars["gPDF"] = pdfTex;
 	rayGenVars["gOutput"] = outputTex;
+    rayGenVars["gPixelEstimate"] = mpResManager->getTexture("PixelEstimate");
+    rayGenVars["gRadianceCache"] = mpRadianceCache;
 
-    // Set up variables for all hit shaders of the PT shader.
+    // Set up variables for all hit shaders of the PT shader. What a hit returns to the ray
+    // generation shader travels in the ray payload.
     for (auto ptHitVars : mpRayTracer->getHitVars(0)) {
-        ptHitVars["gDirectL"] = directLTex;
         ptHitVars["gLe"] = leTex;
-        ptHitVars["gWo"] = woTex;
-        ptHitVars["gWi"] = wiTex;
-        ptHitVars["gBRDF"] = brdfTex;
-        ptHitVars["gPDF"] = pdfTex;
+        ptHitVars["VisibilityCacheCB"]["gUseVisibilityCache"] = mUseVisibilityCache;
+        ptHitVars["VisibilityCacheCB"]["gVisibilityCacheTolerance"] = mVisibilityCacheTolerance;
+        ptHitVars["gVisibilityKey"] = mpResManager->getTexture("VisibilityKey");
+        ptHitVars["gVisibilityMask"] = visibilityMaskTex;
+        mpShadowCascades->setShaderData(ptHitVars, ShadowCascades::Mode(mShadowMode));
+        ptHitVars["gShadowMapStats"] = collectShadowStats ? mpShadowMapStats : nullptr;
+    }
+
+    // Both ray types alpha test masked geometry in their any-hit shaders.
+    for (uint32_t hitGroup = 0; hitGroup < 2; hitGroup++) {
+        for (auto hitVars : mpRayTracer->getHitVars(hitGroup)) {
+            hitVars["gOpacityStateKeys"] = mUseOpacityStates ? mpOpacityStateKeys : nullptr;
+            hitVars["gOpacityStates"] = mUseOpacityStates ? mpOpacityStates : nullptr;
+            hitVars["gOpacityStats"] = collectOpacityStats ? mpOpacityStats : nullptr;
+        }
     }
 
     // TODO: should be 1 instead of 0, because it is hitgroup 1 that uses gEnvMap; but if set to 1,
@@ -108,7 +268,210 @@ void UnidirectionalPathTracingPass::execute(RenderContext* pRenderContext) {
     auto ptMissVars = mpRayTracer->getMissVars(0);
     // Color sampled by all rays that escape the scene without hitting anything. Constant buffer.
     ptMissVars["gEnvMap"] = mpResManager->getTexture(ResourceManager::kEnvironmentMap);
-    ptMissVars["gDirectL"] = directLTex;
 
-    mpRayTracer->execute(pRenderContext, mpResManager->getScreenSize());
+    // Paths are traced for the region of the G-Buffer that was rendered.
+    uvec2 screenSize = mpResManager->getScreenSize();
+    mpRayTracer->execute(pRenderContext, mpRenderScale ? mpRenderScale->getRenderSize(screenSize) : screenSize);
+    mpFrameTimer->end();
+    mFrameTimerPending = true;
+    mTimedShadowMode = mShadowMode;
+    mTimedBsdfConfiguration = mBsdfConfiguration;
+    mTimedSamplesPerPixel = samplesPerPixel;
+    mTimedRouletteMode = mRouletteMode;
+    mResetEstimates = false;
+
+    if (mBenchmarkEfficiency) {
+        mBenchmarkSampleCount += samplesPerPixel;
+        if (++mBenchmarkFrameCount == kBenchmarkFrames) {
+            measureEfficiency(pRenderContext);
+        }
+    }
+
+    mOpacityStatsPending = collectOpacityStats;
+
+    mShadowStatsPending = collectShadowStats;
+}
+
+void UnidirectionalPathTracingPass::readOpacityStats(RenderContext* pRenderContext) {
+    mOpacityStatsPending = false;
+
+    std::vector<uint8_t> counts = pRenderContext->readTextureSubresource(mpOpacityStats.get(), 0);
+    const uint32_t *stats = reinterpret_cast<const uint32_t*>(counts.data());
+    mResolvedAlphaHits = stats[0];
+    mAlphaTests = stats[1];
+}
+
+void UnidirectionalPathTracingPass::readShadowStats(RenderContext* pRenderContext) {
+    mShadowStatsPending = false;
+
+    std::vector<uint8_t> counts = pRenderContext->readTextureSubresource(mpShadowMapStats.get(), 0);
+    const uint32_t *stats = reinterpret_cast<const uint32_t*>(counts.data());
+    mShadowMapLookups = stats[0];
+    mShadowRayFallbacks = stats[1];
+    mShadowMapError = stats[3] > 0 ? float(stats[2]) / 1024.0f / float(stats[3]) : -1.0f;
+}
+
+void UnidirectionalPathTracingPass::measureEfficiency(RenderContext* pRenderContext) {
+    Texture::SharedPtr estimateTex = mpResManager->getTexture("PixelEstimate");
+    if (!estimateTex) {
+        return;
+    }
+
+    // Stalls until the GPU catches up; the frame time is measured up to here.
+    std::vector<uint8_t> texels = pRenderContext->readTextureSubresource(estimateTex.get(), 0);
+    auto now = std::chrono::high_resolution_clock::now();
+    float elapsedMs = std::chrono::duration<float, std::milli>(now - mBenchmarkStart).count();
+    float msPerFrame = elapsedMs / float(kBenchmarkFrames);
+    // Time of one sample per pixel; the same as msPerFrame at 1 spp.
+    float msPerSample = elapsedMs / float(std::max(mBenchmarkSampleCount, 1u));
+
+    // Per-pixel variance of the luminance of a sample, E[x^2] - E[x]^2.
+    const vec4 *estimates = reinterpret_cast<const vec4*>(texels.data());
+    size_t pixelCount = texels.size() / sizeof(vec4);
+    double varianceSum = 0.0;
+    size_t estimatedPixels = 0;
+    for (size_t i = 0; i < pixelCount; i++) {
+        if (estimates[i].z > 1.0f) {
+            varianceSum += std::max(0.0f, estimates[i].y - estimates[i].x * estimates[i].x);
+            estimatedPixels++;
+        }
+    }
+
+    if (estimatedPixels > 0) {
+        float variance = float(varianceSum / double(estimatedPixels));
+        mSampleVariance[mRouletteMode] = variance;
+        mMsPerFrame[mRouletteMode] = msPerFrame;
+        mEfficiency[mRouletteMode] = variance > 0.0f ? 1.0f / (variance * msPerSample) : -1.0f;
+    }
+
+    mBenchmarkFrameCount = 0;
+    mBenchmarkSampleCount = 0;
+    mBenchmarkStart = std::chrono::high_resolution_clock::now();
+}
+
+void UnidirectionalPathTracingPass::renderGui(Gui* pGui) {
+    int dirty = 0;
+
+    Gui::DropdownList rouletteModes;
+    rouletteModes.push_back({ int32_t(RouletteMode::Throughput), "Throughput roulette" });
+    rouletteModes.push_back({ int32_t(RouletteMode::Efficiency), "Efficiency-aware roulette and extra light samples" });
+    dirty |= (int)pGui->addDropdown("Russian roulette", rouletteModes, mRouletteMode);
+
+
+    if (mRouletteMode == uint32_t(RouletteMode::Efficiency)) {
+        dirty |= (int)pGui->addFloatVar("Weight window size", mWeightWindowSize, 1.01f, 100.0f, 0.1f);
+        dirty |= (int)pGui->addIntVar("Max light samples above the window", mMaxLightSamples, 1, 16);
+        dirty |= (int)pGui->addFloatVar("Radiance cache cell size", mCacheCellSize, 0.001f, FLT_MAX, 0.01f);
+    }
+
+    if (mpSampleBudget) {
+        bool adaptive = mpSampleBudget->isAdaptive();
+        if (pGui->addCheckBox(adaptive ? "Samples per pixel within a GPU time budget" : "Fixed samples per pixel", adaptive)) {
+            mpSampleBudget->setAdaptive(adaptive);
+        }
+        if (adaptive) {
+            float budgetMs = mpSampleBudget->getBudgetMs();
+            if (pGui->addFloatVar("Path tracing budget (ms)", budgetMs, 0.1f, 1000.0f, 0.5f)) {
+                mpSampleBudget->setBudgetMs(budgetMs);
+            }
+        } else {
+            int32_t samplesPerPixel = int32_t(mpSampleBudget->getFixedSamplesPerPixel());
+            if (pGui->addIntVar("Samples per pixel", samplesPerPixel, 1, int32_t(SampleBudget::kMaxSamplesPerPixel))) {
+                mpSampleBudget->setFixedSamplesPerPixel(uint32_t(samplesPerPixel));
+            }
+        }
+
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer), "%u spp this frame, %.3f ms per sample per pixel", mpSampleBudget->getSamplesPerPixel(),
+            glm::max(mpSampleBudget->getMsPerSample(), 0.0f));
+        pGui->addText(buffer);
+    }
+
+    Gui::DropdownList bsdfConfigurations;
+    bsdfConfigurations.push_back({ int32_t(BsdfConfiguration::Glossy), "Ashikhmin-Shirley" });
+    bsdfConfigurations.push_back({ int32_t(BsdfConfiguration::Diffuse), "Lambertian" });
+    bsdfConfigurations.push_back({ int32_t(BsdfConfiguration::DiffuseSpecular), "Lambertian + specular" });
+    bsdfConfigurations.push_back({ int32_t(BsdfConfiguration::All), "All BxDFs" });
+    dirty |= (int)pGui->addDropdown("BSDF kernel", bsdfConfigurations, mBsdfConfiguration);
+
+    // Shading throughput of each kernel, in primary samples per second. Changing the shadow mode or
+    // the roulette clears it, so the kernels are compared with everything else unchanged.
+    uvec2 screenSize = mpResManager->getScreenSize();
+    uvec2 renderSize = mpRenderScale ? mpRenderScale->getRenderSize(screenSize) : screenSize;
+    const char *bsdfConfigurationNames[uint32_t(BsdfConfiguration::Count)] = { "Ashikhmin-Shirley", "Lambertian", "Lambertian + specular", "All BxDFs" };
+    for (uint32_t configuration = 0; configuration < uint32_t(BsdfConfiguration::Count); configuration++) {
+        char buffer[128];
+        float ms = mBsdfConfigurationMs[configuration];
+        if (ms < 0.0f) {
+            snprintf(buffer, sizeof(buffer), "%s: not measured", bsdfConfigurationNames[configuration]);
+        } else {
+            snprintf(buffer, sizeof(buffer), "%s: %.2f ms/frame, %.1f Msamples/s", bsdfConfigurationNames[configuration], ms,
+                float(renderSize.x) * float(renderSize.y) / (ms * 1000.0f));
+        }
+        pGui->addText(buffer);
+    }
+
+    dirty |= (int)pGui->addCheckBox(mUseVisibilityCache ? "Cached delta light visibility" : "Shadow rays every frame", mUseVisibilityCache);
+    if (mUseVisibilityCache) {
+        dirty |= (int)pGui->addFloatVar("Visibility cache tolerance (pixels)", mVisibilityCacheTolerance, 0.5f, 4.0f, 0.1f);
+    }
+
+    dirty |= (int)pGui->addCheckBox("Per-triangle opacity states", mUseOpacityStates);
+    if (mUseOpacityStates) {
+        uint32_t candidates = mResolvedAlphaHits + mAlphaTests;
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer), "Alpha fetches avoided: %u of %u (%.1f%%)", mResolvedAlphaHits, candidates,
+            candidates > 0 ? 100.0f * float(mResolvedAlphaHits) / float(candidates) : 0.0f);
+        pGui->addText(buffer);
+    }
+
+    if (mpShadowCascades->getLightIndex() >= 0) {
+        Gui::DropdownList shadowModes;
+        shadowModes.push_back({ int32_t(ShadowCascades::Mode::Rays), "Shadow rays" });
+        shadowModes.push_back({ int32_t(ShadowCascades::Mode::Map), "Cascaded shadow maps" });
+        shadowModes.push_back({ int32_t(ShadowCascades::Mode::Hybrid), "Shadow maps, rays in penumbrae" });
+        dirty |= (int)pGui->addDropdown("Directional light shadows", shadowModes, mShadowMode);
+
+        const char *shadowModeNames[3] = { "Rays", "Maps", "Hybrid" };
+        for (uint32_t mode = 0; mode < 3; mode++) {
+            char buffer[128];
+            if (mShadowModeMs[mode] < 0.0f) {
+                snprintf(buffer, sizeof(buffer), "%s: not measured", shadowModeNames[mode]);
+            } else {
+                snprintf(buffer, sizeof(buffer), "%s: %.2f ms/frame", shadowModeNames[mode], mShadowModeMs[mode]);
+            }
+            pGui->addText(buffer);
+        }
+
+        if (mShadowMode != uint32_t(ShadowCascades::Mode::Rays)) {
+            uint32_t lookups = mShadowMapLookups + mShadowRayFallbacks;
+            char buffer[128];
+            snprintf(buffer, sizeof(buffer), "Resolved by the maps: %.1f%%, mean error vs. rays: %.4f",
+                lookups > 0 ? 100.0f * float(mShadowMapLookups) / float(lookups) : 0.0f, glm::max(mShadowMapError, 0.0f));
+            pGui->addText(buffer);
+        }
+    }
+
+    // Switch modes with a static camera and compare; both are measured the same way.
+    pGui->addText("     ");
+    if (pGui->addCheckBox("Benchmark roulette efficiency", mBenchmarkEfficiency)) {
+        mBenchmarkFrameCount = 0;
+        mBenchmarkSampleCount = 0;
+        mBenchmarkStart = std::chrono::high_resolution_clock::now();
+    }
+    for (uint32_t mode = 0; mode < 2; mode++) {
+        std::string text = std::string(mode == uint32_t(RouletteMode::Throughput) ? "Throughput" : "Efficiency-aware") + ": ";
+        if (mEfficiency[mode] < 0.0f) {
+            text += "not measured";
+        } else {
+            char buffer[128];
+            snprintf(buffer, sizeof(buffer), "variance %.4g, %.2f ms/frame, efficiency %.4g", mSampleVariance[mode], mMsPerFrame[mode], mEfficiency[mode]);
+            text += buffer;
+        }
+        pGui->addText(text.c_str());
+    }
+
+    if (dirty) {
+        setRefreshFlag();
+    }
 }
\ No newline at end of file
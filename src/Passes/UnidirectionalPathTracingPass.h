@@ -1,23 +1,174 @@
 #pragma once
+#include <chrono>
 #include <random>
 #include "Falcor.h"
 #include "../SharedUtils/RenderPass.h"
 #include "../SharedUtils/RayLaunch.h"
+#include "../Utils/EnvironmentMapLoader.h"
+#include "../Utils/RenderScale.h"
+#include "../Utils/SampleBudget.h"
+#include "../Utils/ShadowCascades.h"
 
 class UnidirectionalPathTracingPass : public ::RenderPass, inherit_shared_from_this<::RenderPass, UnidirectionalPathTracingPass> {
+public:
+	// Must match the ROULETTE_* defines of Integrators/Path.hlsli.
+	enum class RouletteMode : uint32_t {
+		// Classic Russian roulette on the green channel of the throughput.
+		Throughput = 0,
+		// Roulette driven by the expected contribution of the path, plus extra light samples where it
+		// contributes a lot. Not full splitting: only next event estimation is multiplied (see
+		// PathIntegrator).
+		Efficiency
+	};
+
+	// BxDFs the BSDF of the path tracing kernel is compiled with; one shader permutation each (see
+	// BSDF_COMPONENTS in BSDF.hlsli).
+	enum class BsdfConfiguration : uint32_t {
+		// Ashikhmin-Shirley only.
+		Glossy = 0,
+		Diffuse,
+		DiffuseSpecular,
+		All,
+		Count
+	};
+
 protected:
+	// Must match RADIANCE_CACHE_WIDTH and RADIANCE_CACHE_HEIGHT in RadianceCache.hlsli.
+	static const uint32_t kRadianceCacheWidth = 1024;
+	static const uint32_t kRadianceCacheHeight = 512;
+
+	// Must match OPACITY_STATES_WIDTH and OPACITY_STATES_HEIGHT in AlphaTesting.hlsli.
+	static const uint32_t kOpacityStatesWidth = 2048;
+	static const uint32_t kOpacityStatesHeight = 1024;
+
+	// Frames between efficiency measurements.
+	static const uint32_t kBenchmarkFrames = 64;
+
+	// Frames between alpha test and shadow map statistics readbacks.
+	static const uint32_t kOpacityStatsFrames = 32;
+	static const uint32_t kShadowStatsFrames = 32;
+
+	// The ray tracing program of each BsdfConfiguration, compiled the first time it's selected, and
+	// the selected one.
+	RayLaunch::SharedPtr mpRayTracers[uint32_t(BsdfConfiguration::Count)];
 	RayLaunch::SharedPtr mpRayTracer;
+	uint32_t mBsdfConfiguration = uint32_t(BsdfConfiguration::Glossy);
+	EnvironmentMapLoader::SharedPtr mpEnvMapLoader;
     RtScene::SharedPtr mpScene;
 	std::string mOutputBuffer;
 
+	// Storage format of the output buffer. It holds radiance, which needs a floating-point format,
+	// but not necessarily a 16-byte one.
+	ResourceFormat mOutputFormat;
+
+	// Internal render resolution, shared with the G-Buffer pass; nullptr renders at the screen size.
+	RenderScale::SharedPtr mpRenderScale;
+
+	// Samples per pixel of every frame, fixed or adapted to a GPU time budget; nullptr takes 1.
+	SampleBudget::SharedPtr mpSampleBudget;
+
 	bool mDoCosSampling = true;
 
-	uint32_t mFrameCount = 0x1337u;
+	// Index of the first sample of the next frame; a frame takes the samples from there on.
+	uint32_t mSampleCount = 0x1337u;
 	uint32_t mMaxBounces = 8;
 	uint32_t mMinBouncesBeforeRussianRoulette = 3;
 
-	UnidirectionalPathTracingPass(const std::string &outputBuffer) : ::RenderPass("UnidirectionalPathTracing", "UnidirectionalPathTracing Settings") {
+	uint32_t mRouletteMode = uint32_t(RouletteMode::Throughput);
+	// Ratio of the upper to the lower bound of the weight window.
+	float mWeightWindowSize = 5.0f;
+	// Most light samples a path above the weight window takes at its next vertex.
+	int32_t mMaxLightSamples = 4;
+	// World-space size of the cells of the radiance cache.
+	float mCacheCellSize = 0.25f;
+	// The pixel estimate averages up to this many of the latest samples.
+	uint32_t mMaxPixelEstimateSamples = 256;
+
+	// Hash grid of outgoing radiance; see RadianceCache.hlsli.
+	Texture::SharedPtr mpRadianceCache;
+
+	// Delta light visibility from primary hits can be cached per pixel (VisibilityCache.hlsli) and
+	// reused while the camera and scene stay put, across subpixel jitter. Off by default: a penumbra
+	// the first shadow rays of a pixel miss stays biased.
+	bool mUseVisibilityCache = false;
+	// How far a primary hit may be from the first hit cached for the pixel, in pixel footprints, and
+	// still reuse its visibility. Jittered hits of a pixel are within sqrt(2) footprints of each other.
+	float mVisibilityCacheTolerance = 1.5f;
+	bool mResetVisibilityCache = true;
+
+	// The radiance cache and pixel estimates describe a view or scene that no longer exists.
+	bool mResetEstimates = true;
+	// View matrix of the last frame; the pixel estimates are also reset when it changes.
+	glm::mat4 mLastCameraMatrix;
+
+	// Per-triangle opacity states of alpha-masked geometry (see AlphaTesting.hlsli), baked by the
+	// any-hit shaders on first use and kept until the scene changes.
+	bool mUseOpacityStates = true;
+	Texture::SharedPtr mpOpacityStateKeys;
+	Texture::SharedPtr mpOpacityStates;
+	bool mResetOpacityStates = true;
+
+	// Candidate hits on masked geometry resolved from their triangle's opacity state and alpha
+	// tests run, counted over one frame every kOpacityStatsFrames frames and read back on the next.
+	Texture::SharedPtr mpOpacityStats;
+	uint32_t mOpacityStatsFrameCount = 0;
+	bool mOpacityStatsPending = false;
+	uint32_t mResolvedAlphaHits = 0;
+	uint32_t mAlphaTests = 0;
+
+	// Visibility of the scene's directional light: shadow rays, cascaded shadow maps, or maps with
+	// rays in their penumbrae. See ShadowMaps.hlsli.
+	ShadowCascades::SharedPtr mpShadowCascades;
+	uint32_t mShadowMode = uint32_t(ShadowCascades::Mode::Rays);
+
+	// GPU time of the shadow maps and the path tracing dispatch, per ShadowCascades::Mode; a running
+	// average, or negative until measured.
+	GpuTimer::SharedPtr mpFrameTimer;
+	bool mFrameTimerPending = false;
+	uint32_t mTimedShadowMode = 0;
+	float mShadowModeMs[3] = { -1.0f, -1.0f, -1.0f };
+	// The same, per BsdfConfiguration.
+	uint32_t mTimedBsdfConfiguration = 0;
+	float mBsdfConfigurationMs[uint32_t(BsdfConfiguration::Count)] = { -1.0f, -1.0f, -1.0f, -1.0f };
+	// Samples per pixel and RouletteMode of the timed frame.
+	uint32_t mTimedSamplesPerPixel = 1;
+	uint32_t mTimedRouletteMode = 0;
+	// Both tables are fed by the same frame time, so each only compares its own setting with the
+	// others held fixed: these are the settings it was measured with, and it's cleared when the
+	// timed frame's differ.
+	uint32_t mShadowModeTimingBsdfConfiguration = 0;
+	uint32_t mShadowModeTimingRouletteMode = 0;
+	uint32_t mBsdfConfigurationTimingShadowMode = 0;
+	uint32_t mBsdfConfigurationTimingRouletteMode = 0;
+
+	// Directional light lookups resolved by the shadow maps and traced, and the mean absolute
+	// difference between the maps' visibility and a shadow ray's, over one frame every
+	// kShadowStatsFrames frames and read back on the next.
+	Texture::SharedPtr mpShadowMapStats;
+	uint32_t mShadowStatsFrameCount = 0;
+	bool mShadowStatsPending = false;
+	uint32_t mShadowMapLookups = 0;
+	uint32_t mShadowRayFallbacks = 0;
+	float mShadowMapError = -1.0f;
+
+	// Efficiency, 1 / (variance x time), of each RouletteMode, measured every kBenchmarkFrames frames
+	// while mBenchmarkEfficiency is on. The variance is that of the luminance of a single sample,
+	// averaged over the pixels. Negative until measured. A measurement reads back the whole
+	// PixelEstimate texture and stalls until the GPU catches up, so it's off by default.
+	bool mBenchmarkEfficiency = false;
+	uint32_t mBenchmarkFrameCount = 0;
+	// Samples per pixel taken over the benchmark frames; efficiency is measured per sample.
+	uint32_t mBenchmarkSampleCount = 0;
+	std::chrono::high_resolution_clock::time_point mBenchmarkStart;
+	float mSampleVariance[2] = { -1.0f, -1.0f };
+	float mMsPerFrame[2] = { -1.0f, -1.0f };
+	float mEfficiency[2] = { -1.0f, -1.0f };
+
+	UnidirectionalPathTracingPass(const std::string &outputBuffer, ResourceFormat outputFormat, RenderScale::SharedPtr pRenderScale, SampleBudget::SharedPtr pSampleBudget) : ::RenderPass("UnidirectionalPathTracing", "UnidirectionalPathTracing Settings") {
 		mOutputBuffer = outputBuffer;
+		mOutputFormat = outputFormat;
+		mpRenderScale = pRenderScale;
+		mpSampleBudget = pSampleBudget;
 	}
 
     bool initialize(RenderContext* pRenderContext, ResourceManager::SharedPtr pResManager) override;
@@ -26,6 +177,22 @@ protected:
 
     void execute(RenderContext* pRenderContext) override;
 
+    void renderGui(Gui* pGui) override;
+
+    void stateRefreshed() override;
+
+    // Creates and compiles the ray tracing program specialized for a BsdfConfiguration.
+    RayLaunch::SharedPtr createRayTracer(BsdfConfiguration configuration);
+
+    // Reads back the opacity statistics collected on the previous frame.
+    void readOpacityStats(RenderContext* pRenderContext);
+
+    // Reads back the shadow map statistics collected on the previous frame.
+    void readShadowStats(RenderContext* pRenderContext);
+
+    // Reads back the pixel estimates and updates the efficiency of the current RouletteMode.
+    void measureEfficiency(RenderContext* pRenderContext);
+
 	bool requiresScene() override { 
 		return true;
 	}
@@ -43,7 +210,9 @@ public:
 
     using SharedConstPtr = std::shared_ptr<const UnidirectionalPathTracingPass>;
 
-    static SharedPtr create(const std::string &outputBuffer) { return SharedPtr(new UnidirectionalPathTracingPass(outputBuffer)); }
+    static SharedPtr create(const std::string &outputBuffer, ResourceFormat outputFormat = ResourceFormat::RGBA32Float, RenderScale::SharedPtr pRenderScale = nullptr, SampleBudget::SharedPtr pSampleBudget = nullptr) {
+        return SharedPtr(new UnidirectionalPathTracingPass(outputBuffer, outputFormat, pRenderScale, pSampleBudget));
+    }
 
     virtual ~UnidirectionalPathTracingPass() = default;
 };
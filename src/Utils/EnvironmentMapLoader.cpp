@@ -0,0 +1,90 @@
+#include "EnvironmentMapLoader.h"
+
+namespace {
+    // Color of the placeholder environment; the same as the default background color of the
+    // G-Buffer passes.
+    const vec4 kPlaceholderColor = vec4(0.5f, 0.5f, 1.0f, 1.0f);
+};
+
+std::map<std::string, EnvironmentMapLoader::SharedPtr> EnvironmentMapLoader::sLoaders;
+
+EnvironmentMapLoader::SharedPtr EnvironmentMapLoader::get(const std::string &filename) {
+    auto it = sLoaders.find(filename);
+    if (it != sLoaders.end()) {
+        return it->second;
+    }
+
+    SharedPtr pLoader = SharedPtr(new EnvironmentMapLoader(filename));
+    sLoaders[filename] = pLoader;
+    return pLoader;
+}
+
+EnvironmentMapLoader::EnvironmentMapLoader(const std::string &filename) : mFilename(filename) {
+    mStartTime = std::chrono::high_resolution_clock::now();
+
+    // Mapping the sidecar (or decoding the RGBE file and building it) is CPU work only; the texture
+    // is created on the render thread.
+    mPendingSidecar = std::async(std::launch::async, [filename]() -> EnvironmentMapSidecar::SharedPtr {
+        std::string fullPath;
+        if (!findFileInDataDirectories(filename, fullPath)) {
+            logError("Environment map " + filename + " not found.");
+            return nullptr;
+        }
+
+        EnvironmentMapSidecar::SharedPtr pSidecar = EnvironmentMapSidecar::open(fullPath);
+        if (pSidecar) {
+            return pSidecar;
+        }
+
+        logInfo("Building " + EnvironmentMapSidecar::getSidecarPath(fullPath) + ".");
+        Bitmap::UniqueConstPtr pBitmap = Bitmap::createFromFile(fullPath, true);
+        return EnvironmentMapSidecar::build(fullPath, pBitmap.get());
+    });
+}
+
+bool EnvironmentMapLoader::update(ResourceManager::SharedPtr pResManager) {
+    bool swappedIn = false;
+
+    if (!mpEnvMap && mPendingSidecar.valid()
+        && mPendingSidecar.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        mpSidecar = mPendingSidecar.get();
+        if (mpSidecar) {
+            // The full mip chain comes precomputed; no generateMips() on the GPU.
+            mpEnvMap = Texture::create2D(
+                mpSidecar->getWidth(), mpSidecar->getHeight(), mpSidecar->getFormat(), 1, mpSidecar->getMipCount(),
+                mpSidecar->getMipData(), Resource::BindFlags::ShaderResource
+            );
+            mpPrefilteredEnvMap = Texture::create2D(
+                EnvironmentMapSidecar::kPrefilteredWidth, EnvironmentMapSidecar::kPrefilteredWidth / 2, ResourceFormat::RGBA16Float, 1,
+                EnvironmentMapSidecar::kPrefilteredLevels, mpSidecar->getPrefilteredData(), Resource::BindFlags::ShaderResource
+            );
+            mpBRDFLut = Texture::create2D(
+                EnvironmentMapSidecar::kBRDFLutSize, EnvironmentMapSidecar::kBRDFLutSize, ResourceFormat::RG32Float, 1, 1,
+                mpSidecar->getBRDFLut(), Resource::BindFlags::ShaderResource
+            );
+            mTimeToFullyLoaded = millisecondsSinceStart();
+            logInfo("Environment map " + mFilename + " loaded in " + std::to_string(mTimeToFullyLoaded) + " ms.");
+            swappedIn = true;
+        }
+    }
+
+    if (!mpPlaceholder) {
+        mpPlaceholder = Texture::create2D(1, 1, ResourceFormat::RGBA32Float, 1, 1, &kPlaceholderColor, Resource::BindFlags::ShaderResource);
+    }
+
+    if (mTimeToFirstFrame < 0.0f) {
+        mTimeToFirstFrame = millisecondsSinceStart();
+    }
+
+    Texture::SharedPtr pCurrent = mpEnvMap ? mpEnvMap : mpPlaceholder;
+    if (pResManager && pResManager->getTexture(ResourceManager::kEnvironmentMap) != pCurrent) {
+        pResManager->manageTextureResource(ResourceManager::kEnvironmentMap, pCurrent);
+    }
+
+    return swappedIn;
+}
+
+float EnvironmentMapLoader::millisecondsSinceStart() const {
+    auto elapsed = std::chrono::high_resolution_clock::now() - mStartTime;
+    return std::chrono::duration<float, std::milli>(elapsed).count();
+}
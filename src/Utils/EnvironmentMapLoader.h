@@ -0,0 +1,89 @@
+#pragma once
+#include <chrono>
+#include <future>
+#include <map>
+#include "Falcor.h"
+#include "../SharedUtils/ResourceManager.h"
+#include "EnvironmentMapSidecar.h"
+
+// Loads an HDR environment map without stalling the first frame. The file is decoded on a worker
+// thread while rendering starts with a placeholder; the decoded map replaces the placeholder in the
+// ResourceManager as soon as it's ready.
+//
+// Passes that use the same environment map file share a single loader, so the file is decoded once
+// instead of once per pass (ResourceManager::updateEnvironmentMap decodes it every time it's called).
+//
+// The decoded map comes from its EnvironmentMapSidecar, which is memory-mapped when it's up to date
+// and built (and written) from the HDR file otherwise.
+class EnvironmentMapLoader {
+public:
+    using SharedPtr = std::shared_ptr<EnvironmentMapLoader>;
+
+    // Gets the loader of the environment map file, creating it and starting the decode if this is
+    // the first request for that file.
+    static SharedPtr get(const std::string &filename);
+
+    // To be called by every pass that uses the environment map at the start of its execute(), on
+    // the render thread. Makes the placeholder or, once decoded, the environment map available
+    // through ResourceManager::kEnvironmentMap. Returns true on the frame the decoded map replaces
+    // the placeholder, so that passes can restart accumulation.
+    bool update(ResourceManager::SharedPtr pResManager);
+
+    bool isLoaded() const {
+        return mpEnvMap != nullptr;
+    }
+
+    // Milliseconds from the start of the decode to the first frame rendered (with the placeholder),
+    // and to the frame the decoded map was swapped in. Negative until they happen.
+    float getTimeToFirstFrame() const {
+        return mTimeToFirstFrame;
+    }
+
+    float getTimeToFullyLoaded() const {
+        return mTimeToFullyLoaded;
+    }
+
+    const std::string &getFilename() const {
+        return mFilename;
+    }
+
+    // The mip chain and split-sum tables of the map. nullptr until loaded.
+    EnvironmentMapSidecar::SharedPtr getSidecar() const {
+        return mpSidecar;
+    }
+
+    // The split-sum GGX prefiltered map and BRDF table (see EnvironmentMapSidecar). nullptr until
+    // loaded.
+    Texture::SharedPtr getPrefilteredEnvMap() const {
+        return mpPrefilteredEnvMap;
+    }
+
+    Texture::SharedPtr getBRDFLut() const {
+        return mpBRDFLut;
+    }
+
+private:
+    EnvironmentMapLoader(const std::string &filename);
+
+    float millisecondsSinceStart() const;
+
+    std::string mFilename;
+
+    // Loaded on a worker thread. Only the render thread creates GPU resources.
+    std::future<EnvironmentMapSidecar::SharedPtr> mPendingSidecar;
+
+    EnvironmentMapSidecar::SharedPtr mpSidecar;
+
+    // A constant environment used until the decoded map is ready.
+    Texture::SharedPtr mpPlaceholder;
+
+    Texture::SharedPtr mpEnvMap;
+    Texture::SharedPtr mpPrefilteredEnvMap;
+    Texture::SharedPtr mpBRDFLut;
+
+    std::chrono::high_resolution_clock::time_point mStartTime;
+    float mTimeToFirstFrame = -1.0f;
+    float mTimeToFullyLoaded = -1.0f;
+
+    static std::map<std::string, SharedPtr> sLoaders;
+};
@@ -0,0 +1,414 @@
+#include <fstream>
+#include "glm/gtc/packing.hpp"
+#include "EnvironmentMapSidecar.h"
+#include "TileScheduler.h"
+
+namespace {
+    const char kMagic[8] = { 'C', 'D', 'X', 'R', 'E', 'N', 'V', '\0' };
+    const uint32_t kVersion = 3;
+
+    // GGX samples per texel of the prefiltered map, and per entry of the BRDF table.
+    const uint32_t kPrefilterSampleCount = 256;
+    const uint32_t kBRDFLutSampleCount = 512;
+
+    size_t alignUp(size_t offset, size_t alignment) {
+        return (offset + alignment - 1) / alignment * alignment;
+    }
+
+    // A float copy of one mip level. The chain is built in float and only stored as half.
+    struct MipLevel {
+        uint32_t width;
+        uint32_t height;
+        std::vector<vec4> texels;
+
+        const vec4 &at(uint32_t x, uint32_t y) const {
+            return texels[size_t(y) * width + x];
+        }
+    };
+
+    // 2x2 box filter. Odd dimensions clamp to the last row/column.
+    MipLevel downsample(const MipLevel &src) {
+        MipLevel dst;
+        dst.width = std::max(1u, src.width / 2);
+        dst.height = std::max(1u, src.height / 2);
+        dst.texels.resize(size_t(dst.width) * dst.height);
+
+        for (uint32_t y = 0; y < dst.height; y++) {
+            uint32_t y0 = std::min(2 * y, src.height - 1);
+            uint32_t y1 = std::min(2 * y + 1, src.height - 1);
+            for (uint32_t x = 0; x < dst.width; x++) {
+                uint32_t x0 = std::min(2 * x, src.width - 1);
+                uint32_t x1 = std::min(2 * x + 1, src.width - 1);
+                dst.texels[size_t(y) * dst.width + x] = 0.25f * (src.at(x0, y0) + src.at(x1, y0) + src.at(x0, y1) + src.at(x1, y1));
+            }
+        }
+
+        return dst;
+    }
+
+    // Inverse of WorldToLatitudeLongitude (Sampling.hlsli): u = (1 + atan2(x, -z)/pi)/2 and
+    // v = acos(y)/pi.
+    vec3 latitudeLongitudeToWorld(float u, float v) {
+        float phi = glm::pi<float>() * (2.0f * u - 1.0f);
+        float theta = glm::pi<float>() * v;
+        return vec3(std::sin(theta) * std::sin(phi), std::cos(theta), -std::sin(theta) * std::cos(phi));
+    }
+
+    // Inverse of latitudeLongitudeToWorld; WorldToLatitudeLongitude in Sampling.hlsli.
+    vec2 worldToLatitudeLongitude(const vec3 &d) {
+        float u = 0.5f * (1.0f + std::atan2(d.x, -d.z) / glm::pi<float>());
+        float v = std::acos(glm::clamp(d.y, -1.0f, 1.0f)) / glm::pi<float>();
+        return vec2(u, v);
+    }
+
+    // Texel of the level that contains the direction.
+    const vec4 &fetch(const MipLevel &level, const vec3 &d) {
+        vec2 uv = worldToLatitudeLongitude(d);
+        uint32_t x = std::min(uint32_t(uv.x * level.width), level.width - 1);
+        uint32_t y = std::min(uint32_t(uv.y * level.height), level.height - 1);
+        return level.at(x, y);
+    }
+
+    vec2 hammersley(uint32_t i, uint32_t n) {
+        uint32_t bits = i;
+        bits = (bits << 16u) | (bits >> 16u);
+        bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+        bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+        bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+        bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+        return vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10f);
+    }
+
+    // GGX half vector around n; the same distribution as getGGXMicrofacet (Microfacet.hlsli), whose
+    // roughness parameter is alpha.
+    vec3 sampleGGX(const vec2 &xi, float alpha, const vec3 &n) {
+        float a2 = alpha * alpha;
+        float cosTheta = std::sqrt(std::max(0.0f, (1.0f - xi.x) / ((a2 - 1.0f) * xi.x + 1.0f)));
+        float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        float phi = 2.0f * glm::pi<float>() * xi.y;
+
+        vec3 t = glm::normalize(glm::cross(std::abs(n.y) < 0.999f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f), n));
+        vec3 b = glm::cross(n, t);
+        return t * (sinTheta * std::cos(phi)) + b * (sinTheta * std::sin(phi)) + n * cosTheta;
+    }
+
+    // ggxNormalDistribution (Microfacet.hlsli).
+    float ggxD(float NdotH, float alpha) {
+        float a2 = alpha * alpha;
+        float d = (NdotH * a2 - NdotH) * NdotH + 1.0f;
+        return a2 / std::max(0.001f, d * d * glm::pi<float>());
+    }
+
+    // One level of the prefiltered map: radiance reflected toward the normal by a GGX lobe of the
+    // given alpha, assuming the view direction is the normal. Samples come from the mip level whose
+    // texels cover about the solid angle of the sample (filtered importance sampling), which keeps
+    // bright texels from turning into fireflies.
+    MipLevel prefilter(const std::vector<MipLevel> &mips, uint32_t width, float alpha, TileScheduler &scheduler) {
+        MipLevel dst;
+        dst.width = width;
+        dst.height = std::max(1u, width / 2);
+        dst.texels.resize(size_t(dst.width) * dst.height);
+
+        // With V = N, the samples are the same for every texel in the tangent frame of its normal; the
+        // level builds their table once and every tile reads it.
+        struct LobeSample {
+            vec3 l;
+            uint32_t lod;
+        };
+
+        float texelSolidAngle = 4.0f * glm::pi<float>() / float(mips[0].width * mips[0].height);
+        std::vector<LobeSample> samples;
+        samples.reserve(kPrefilterSampleCount);
+        for (uint32_t i = 0; i < kPrefilterSampleCount; i++) {
+            vec3 h = sampleGGX(hammersley(i, kPrefilterSampleCount), alpha, vec3(0.0f, 0.0f, 1.0f));
+            vec3 l = 2.0f * h.z * h - vec3(0.0f, 0.0f, 1.0f);
+            if (l.z <= 0.0f) {
+                continue;
+            }
+
+            // The pdf of l is D / 4.
+            float sampleSolidAngle = 4.0f / (float(kPrefilterSampleCount) * ggxD(h.z, alpha) + 1e-4f);
+            float lod = glm::clamp(0.5f * std::log2(sampleSolidAngle / texelSolidAngle) + 1.0f, 0.0f, float(mips.size() - 1));
+            samples.push_back({ l, uint32_t(lod) });
+        }
+
+        scheduler.parallelFor(dst.width, dst.height, 16, [&](const TileScheduler::Tile &tile, TileScheduler::Arena &arena) {
+            for (uint32_t y = tile.y0; y < tile.y1; y++) {
+                for (uint32_t x = tile.x0; x < tile.x1; x++) {
+                    vec3 n = latitudeLongitudeToWorld((x + 0.5f) / float(dst.width), (y + 0.5f) / float(dst.height));
+                    // The frame of sampleGGX.
+                    vec3 t = glm::normalize(glm::cross(std::abs(n.y) < 0.999f ? vec3(0.0f, 1.0f, 0.0f) : vec3(1.0f, 0.0f, 0.0f), n));
+                    vec3 b = glm::cross(n, t);
+
+                    vec3 sum = vec3(0.0f);
+                    float weightSum = 0.0f;
+                    for (const LobeSample &sample : samples) {
+                        vec3 l = t * sample.l.x + b * sample.l.y + n * sample.l.z;
+                        sum += vec3(fetch(mips[sample.lod], l)) * sample.l.z;
+                        weightSum += sample.l.z;
+                    }
+                    dst.texels[size_t(y) * dst.width + x] = vec4(weightSum > 0.0f ? sum / weightSum : vec3(0.0f), 1.0f);
+                }
+            }
+        });
+
+        return dst;
+    }
+
+    // Scale and bias to F0 of the directional albedo of the GGX BRDF with Schlick's Fresnel, as
+    // evaluated by ggxIndirect (GGXGI.rt.hlsl).
+    vec2 integrateBRDF(float NdotV, float alpha) {
+        vec3 v = vec3(std::sqrt(1.0f - NdotV * NdotV), 0.0f, NdotV);
+        vec3 n = vec3(0.0f, 0.0f, 1.0f);
+        // ggxSchlickMaskingTerm's k.
+        float k = alpha * alpha / 2.0f;
+
+        vec2 result = vec2(0.0f);
+        for (uint32_t i = 0; i < kBRDFLutSampleCount; i++) {
+            vec3 h = sampleGGX(hammersley(i, kBRDFLutSampleCount), alpha, n);
+            float VdotH = glm::dot(v, h);
+            vec3 l = 2.0f * VdotH * h - v;
+            float NdotL = l.z;
+            float NdotH = h.z;
+            if (NdotL <= 0.0f || VdotH <= 0.0f) {
+                continue;
+            }
+
+            float G = (NdotV / (NdotV * (1.0f - k) + k)) * (NdotL / (NdotL * (1.0f - k) + k));
+            // BRDF * NdotL / pdf, without the Fresnel term.
+            float visibility = G * VdotH / (NdotH * NdotV);
+            float fresnel = std::pow(1.0f - VdotH, 5.0f);
+            result += vec2((1.0f - fresnel) * visibility, fresnel * visibility);
+        }
+
+        return result / float(kBRDFLutSampleCount);
+    }
+};
+
+std::atomic<bool> EnvironmentMapSidecar::sLogPrefilterScaling(false);
+
+bool EnvironmentMapSidecar::getSourceFileInfo(const std::string &hdrPath, uint64_t &size, uint64_t &writeTime) {
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(hdrPath.c_str(), GetFileExInfoStandard, &attributes)) {
+        return false;
+    }
+
+    size = (uint64_t(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    writeTime = (uint64_t(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+uint64_t EnvironmentMapSidecar::getMipsSize(uint32_t width, uint32_t height, uint32_t mipCount) {
+    uint64_t size = 0;
+    for (uint32_t level = 0; level < mipCount; level++) {
+        size += uint64_t(std::max(1u, width >> level)) * std::max(1u, height >> level) * sizeof(uint64_t);
+    }
+    return size;
+}
+
+uint64_t EnvironmentMapSidecar::getPrefilteredSize() {
+    uint64_t size = 0;
+    for (uint32_t level = 0; level < kPrefilteredLevels; level++) {
+        uint32_t width = std::max(1u, kPrefilteredWidth >> level);
+        size += uint64_t(width) * std::max(1u, width / 2) * sizeof(uint64_t);
+    }
+    return size;
+}
+
+uint64_t EnvironmentMapSidecar::getBRDFLutSize() {
+    return uint64_t(kBRDFLutSize) * kBRDFLutSize * sizeof(vec2);
+}
+
+EnvironmentMapSidecar::SharedPtr EnvironmentMapSidecar::open(const std::string &hdrPath) {
+    uint64_t sourceSize, sourceWriteTime;
+    if (!getSourceFileInfo(hdrPath, sourceSize, sourceWriteTime)) {
+        return nullptr;
+    }
+
+    std::string sidecarPath = getSidecarPath(hdrPath);
+    HANDLE file = CreateFileA(sidecarPath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize) || uint64_t(fileSize.QuadPart) < sizeof(Header)) {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    const uint8_t *pView = static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!pView) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return nullptr;
+    }
+
+    SharedPtr pSidecar = SharedPtr(new EnvironmentMapSidecar());
+    pSidecar->mFile = file;
+    pSidecar->mMapping = mapping;
+    pSidecar->mpBase = pView;
+
+    // Every block has to lie after the header and within the file; a truncated or corrupt sidecar is
+    // rebuilt rather than read out of bounds. The mip chain has to be the full one build() writes,
+    // down to 1x1.
+    const Header &h = pSidecar->header();
+    uint64_t size = uint64_t(fileSize.QuadPart);
+    auto fits = [size](uint64_t offset, uint64_t blockSize) {
+        return offset >= sizeof(Header) && offset <= size && blockSize <= size - offset;
+    };
+    uint32_t fullMipCount = 1;
+    while (fullMipCount < 32 && (std::max(h.width, h.height) >> fullMipCount) > 0) {
+        fullMipCount++;
+    }
+    bool valid = std::memcmp(h.magic, kMagic, sizeof(kMagic)) == 0
+        && h.version == kVersion
+        && h.sourceFileSize == sourceSize
+        && h.sourceWriteTime == sourceWriteTime
+        && h.width > 0 && h.height > 0
+        && h.mipCount == fullMipCount
+        && fits(h.mipsOffset, getMipsSize(h.width, h.height, h.mipCount))
+        && fits(h.prefilteredOffset, getPrefilteredSize())
+        && fits(h.brdfLutOffset, getBRDFLutSize());
+
+    // The destructor unmaps the file.
+    return valid ? pSidecar : nullptr;
+}
+
+EnvironmentMapSidecar::SharedPtr EnvironmentMapSidecar::build(const std::string &hdrPath, const Bitmap *pBitmap) {
+    if (!pBitmap) {
+        return nullptr;
+    }
+
+    uint32_t channelCount;
+    if (pBitmap->getFormat() == ResourceFormat::RGBA32Float) {
+        channelCount = 4;
+    } else if (pBitmap->getFormat() == ResourceFormat::RGB32Float) {
+        channelCount = 3;
+    } else {
+        logError("Environment map " + hdrPath + " isn't a floating-point image; no sidecar built.");
+        return nullptr;
+    }
+
+    // Level 0, in float.
+    std::vector<MipLevel> mips(1);
+    mips[0].width = pBitmap->getWidth();
+    mips[0].height = pBitmap->getHeight();
+    mips[0].texels.resize(size_t(mips[0].width) * mips[0].height);
+    const float *pSrc = reinterpret_cast<const float*>(pBitmap->getData());
+    for (size_t i = 0; i < mips[0].texels.size(); i++) {
+        const float *t = pSrc + i * channelCount;
+        mips[0].texels[i] = vec4(t[0], t[1], t[2], 1.0f);
+    }
+
+    while (mips.back().width > 1 || mips.back().height > 1) {
+        mips.push_back(downsample(mips.back()));
+    }
+
+    // Lay out the file.
+    size_t mipsOffset = alignUp(sizeof(Header), 16);
+    size_t prefilteredOffset = alignUp(mipsOffset + size_t(getMipsSize(mips[0].width, mips[0].height, uint32_t(mips.size()))), 16);
+    size_t brdfLutOffset = alignUp(prefilteredOffset + size_t(getPrefilteredSize()), 16);
+    size_t totalSize = brdfLutOffset + size_t(getBRDFLutSize());
+
+    SharedPtr pSidecar = SharedPtr(new EnvironmentMapSidecar());
+    pSidecar->mBlob.resize(totalSize, 0);
+    uint8_t *pBase = pSidecar->mBlob.data();
+    pSidecar->mpBase = pBase;
+
+    Header &h = *reinterpret_cast<Header*>(pBase);
+    std::memcpy(h.magic, kMagic, sizeof(kMagic));
+    h.version = kVersion;
+    h.width = mips[0].width;
+    h.height = mips[0].height;
+    h.mipCount = uint32_t(mips.size());
+    getSourceFileInfo(hdrPath, h.sourceFileSize, h.sourceWriteTime);
+    h.mipsOffset = mipsOffset;
+    h.prefilteredOffset = prefilteredOffset;
+    h.brdfLutOffset = brdfLutOffset;
+
+    // Mip chain in half precision.
+    uint64_t *pHalf = reinterpret_cast<uint64_t*>(pBase + mipsOffset);
+    for (const MipLevel &level : mips) {
+        for (const vec4 &t : level.texels) {
+            *pHalf++ = glm::packHalf4x16(t);
+        }
+    }
+
+    // Prefiltered map and BRDF table, on the workers shared by every build.
+    TileScheduler::SharedPtr pScheduler = TileScheduler::get();
+    if (sLogPrefilterScaling) {
+        TileScheduler::logScaling("Prefiltering " + hdrPath, [&](TileScheduler &scheduler) {
+            for (uint32_t level = 1; level < kPrefilteredLevels; level++) {
+                float roughness = float(level) / float(kPrefilteredLevels - 1);
+                prefilter(mips, std::max(1u, kPrefilteredWidth >> level), roughness * roughness, scheduler);
+            }
+        });
+    }
+
+    // Prefiltered map. The mirror level is the source resampled, from the first mip at least as
+    // wide.
+    uint64_t *pPrefiltered = reinterpret_cast<uint64_t*>(pBase + prefilteredOffset);
+    for (uint32_t level = 0; level < kPrefilteredLevels; level++) {
+        uint32_t width = std::max(1u, kPrefilteredWidth >> level);
+        float roughness = float(level) / float(kPrefilteredLevels - 1);
+        MipLevel prefiltered;
+        if (level == 0) {
+            const MipLevel *pSource = &mips[0];
+            for (const MipLevel &mip : mips) {
+                if (mip.width >= width) {
+                    pSource = &mip;
+                }
+            }
+            prefiltered.width = width;
+            prefiltered.height = std::max(1u, width / 2);
+            for (uint32_t y = 0; y < prefiltered.height; y++) {
+                for (uint32_t x = 0; x < prefiltered.width; x++) {
+                    prefiltered.texels.push_back(fetch(*pSource, latitudeLongitudeToWorld((x + 0.5f) / float(prefiltered.width), (y + 0.5f) / float(prefiltered.height))));
+                }
+            }
+        } else {
+            prefiltered = prefilter(mips, width, roughness * roughness, *pScheduler);
+        }
+        for (const vec4 &t : prefiltered.texels) {
+            *pPrefiltered++ = glm::packHalf4x16(t);
+        }
+    }
+
+    vec2 *pBRDFLut = reinterpret_cast<vec2*>(pBase + brdfLutOffset);
+    pScheduler->parallelFor(kBRDFLutSize, kBRDFLutSize, 8, [&](const TileScheduler::Tile &tile, TileScheduler::Arena &) {
+        for (uint32_t y = tile.y0; y < tile.y1; y++) {
+            float roughness = (y + 0.5f) / float(kBRDFLutSize);
+            for (uint32_t x = tile.x0; x < tile.x1; x++) {
+                float NdotV = (x + 0.5f) / float(kBRDFLutSize);
+                pBRDFLut[y * kBRDFLutSize + x] = integrateBRDF(NdotV, roughness * roughness);
+            }
+        }
+    });
+
+    std::ofstream file(getSidecarPath(hdrPath), std::ios::binary | std::ios::trunc);
+    if (file) {
+        file.write(reinterpret_cast<const char*>(pBase), totalSize);
+    }
+    if (!file) {
+        logWarning("Couldn't write " + getSidecarPath(hdrPath) + "; the environment map will be preprocessed again next time.");
+    }
+
+    return pSidecar;
+}
+
+EnvironmentMapSidecar::~EnvironmentMapSidecar() {
+    if (mMapping) {
+        UnmapViewOfFile(mpBase);
+        CloseHandle(mMapping);
+    }
+    if (mFile != INVALID_HANDLE_VALUE) {
+        CloseHandle(mFile);
+    }
+}
@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "Falcor.h"
+
+// Everything precomputed from an HDR environment map, stored in a binary file next to it
+// (<file>.envcache) so that it can be memory-mapped at startup instead of recomputed:
+//
+// - The full mip chain, in RGBA16Float, laid out as the texture's subresources (mip 0 first).
+// - The split-sum approximation of GGX reflection of the map (Karis, "Real Shading in Unreal
+//   Engine 4"): the map convolved with the GGX lobe for kPrefilteredLevels roughnesses, as the mips
+//   of a kPrefilteredWidth-wide RGBA16Float texture (mip i has perceptual roughness
+//   i / (kPrefilteredLevels - 1), i.e. GGX alpha its square), and a kBRDFLutSize^2 RG32Float table
+//   of the scale and bias applied to F0 by the integral of the BRDF, indexed by (NdotV, perceptual
+//   roughness).
+//
+// The sidecar records the size and last write time of the HDR file it was built from; it's rebuilt
+// when they don't match, or when any of its blocks doesn't fit in the file.
+//
+// Importance sampling CDFs and irradiance SH of the map aren't stored: nothing in the renderer
+// samples the environment or lights with SH, so they'd only be read to be thrown away.
+class EnvironmentMapSidecar {
+public:
+    using SharedPtr = std::shared_ptr<EnvironmentMapSidecar>;
+
+    static const uint32_t kPrefilteredWidth = 128;
+    static const uint32_t kPrefilteredLevels = 6;
+    static const uint32_t kBRDFLutSize = 32;
+
+    // Maps the sidecar of the HDR file at hdrPath. Returns nullptr if it doesn't exist or is stale.
+    static SharedPtr open(const std::string &hdrPath);
+
+    // Builds the sidecar from the decoded HDR file and writes it next to hdrPath. If it can't be
+    // written, the returned sidecar still holds the precomputed data in memory.
+    static SharedPtr build(const std::string &hdrPath, const Bitmap *pBitmap);
+
+    // When set, build() also logs how the prefiltering scales from 1 to all hardware threads
+    // (TileScheduler::logScaling). Off by default: it prefilters the map once per thread count.
+    static void setLogPrefilterScaling(bool logScaling) {
+        sLogPrefilterScaling = logScaling;
+    }
+
+    static std::string getSidecarPath(const std::string &hdrPath) {
+        return hdrPath + ".envcache";
+    }
+
+    ~EnvironmentMapSidecar();
+
+    uint32_t getWidth() const { return header().width; }
+    uint32_t getHeight() const { return header().height; }
+    uint32_t getMipCount() const { return header().mipCount; }
+    ResourceFormat getFormat() const { return ResourceFormat::RGBA16Float; }
+
+    // All mip levels, contiguous, as expected by Texture::create2D.
+    const void *getMipData() const { return mpBase + header().mipsOffset; }
+
+    // kPrefilteredLevels mips of a kPrefilteredWidth x kPrefilteredWidth/2 texture, contiguous, as
+    // expected by Texture::create2D.
+    const void *getPrefilteredData() const { return mpBase + header().prefilteredOffset; }
+
+    // kBRDFLutSize rows (roughness) of kBRDFLutSize vec2 (NdotV).
+    const vec2 *getBRDFLut() const {
+        return reinterpret_cast<const vec2*>(mpBase + header().brdfLutOffset);
+    }
+
+private:
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t width;
+        uint32_t height;
+        uint32_t mipCount;
+        uint32_t reserved;
+        uint64_t sourceFileSize;
+        uint64_t sourceWriteTime;
+        uint64_t mipsOffset;
+        uint64_t prefilteredOffset;
+        uint64_t brdfLutOffset;
+    };
+
+    EnvironmentMapSidecar() = default;
+
+    const Header &header() const {
+        return *reinterpret_cast<const Header*>(mpBase);
+    }
+
+    static bool getSourceFileInfo(const std::string &hdrPath, uint64_t &size, uint64_t &writeTime);
+
+    // Bytes of each block, as laid out by build().
+    static uint64_t getMipsSize(uint32_t width, uint32_t height, uint32_t mipCount);
+    static uint64_t getPrefilteredSize();
+    static uint64_t getBRDFLutSize();
+
+    static std::atomic<bool> sLogPrefilterScaling;
+
+    // Either a view of the mapped file or mBlob.
+    const uint8_t *mpBase = nullptr;
+
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+
+    std::vector<uint8_t> mBlob;
+};
@@ -0,0 +1,46 @@
+#include "MultiViewLayout.h"
+
+std::vector<CameraData> MultiViewLayout::getViews(const Scene::SharedPtr &pScene) const {
+    std::vector<CameraData> views;
+    if (!pScene || !pScene->getActiveCamera()) {
+        return views;
+    }
+
+    if (mLayout == uint32_t(Layout::AllCameras)) {
+        for (uint32_t i = 0; i < std::min(pScene->getCameraCount(), kMaxViews); i++) {
+            views.push_back(pScene->getCamera(i)->getData());
+        }
+    } else if (mLayout == uint32_t(Layout::Stereo)) {
+        // Parallel eyes, offset along the camera's right vector.
+        const CameraData &center = pScene->getActiveCamera()->getData();
+        vec3 eyeOffset = glm::normalize(center.cameraU) * (0.5f * mStereoSeparation);
+        views.push_back(center);
+        views.back().posW = center.posW - eyeOffset;
+        views.push_back(center);
+        views.back().posW = center.posW + eyeOffset;
+    }
+    return views;
+}
+
+uvec2 MultiViewLayout::getGrid(uint32_t viewCount) {
+    uvec2 grid = uvec2(1);
+    if (viewCount > 1) {
+        grid.x = uint32_t(std::ceil(std::sqrt(float(viewCount))));
+        grid.y = (viewCount + grid.x - 1) / grid.x;
+    }
+    return grid;
+}
+
+bool MultiViewLayout::renderGui(Gui *pGui) {
+    bool dirty = false;
+
+    Gui::DropdownList layouts;
+    layouts.push_back({ int32_t(Layout::Single), "Active camera" });
+    layouts.push_back({ int32_t(Layout::AllCameras), "All cameras, tiled" });
+    layouts.push_back({ int32_t(Layout::Stereo), "Stereo pair" });
+    dirty |= pGui->addDropdown("Views", layouts, mLayout);
+    if (mLayout == uint32_t(Layout::Stereo)) {
+        dirty |= pGui->addFloatVar("Eye separation", mStereoSeparation, 0.0f, FLT_MAX, 0.001f);
+    }
+    return dirty;
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+#pragma once
+#include "Falcor.h"
+
+// Several views rendered in a single frame, each into its own tile of the screen: every camera of
+// the scene, or a stereo pair around the active camera. All views share the scene's acceleration
+// structure, textures and lights, and are traced in the same dispatch (see MAX_VIEWS and the view
+// constants of ThinLensGBuffer.rt.hlsl).
+class MultiViewLayout {
+public:
+    using SharedPtr = std::shared_ptr<MultiViewLayout>;
+
+    enum class Layout : uint32_t {
+        // The active camera only.
+        Single = 0,
+        // Every camera of the scene, up to kMaxViews.
+        AllCameras,
+        // The active camera from two eyes, side by side.
+        Stereo
+    };
+
+    // Must match MAX_VIEWS in ThinLensGBuffer.rt.hlsl.
+    static const uint32_t kMaxViews = 8;
+
+    static SharedPtr create() { return SharedPtr(new MultiViewLayout()); }
+
+    // The views of the frame; empty for Layout::Single, which renders the active camera alone.
+    std::vector<CameraData> getViews(const Scene::SharedPtr &pScene) const;
+
+    // As square a grid of tiles as the view count allows.
+    static uvec2 getGrid(uint32_t viewCount);
+
+    // Sets the views of the frame in RayGenCB of the ray generation shader and returns how many
+    // there are, at least 1.
+    template<typename VarsType>
+    uint32_t setShaderData(VarsType &rayGenVars, const Scene::SharedPtr &pScene) const {
+        std::vector<CameraData> views = getViews(pScene);
+        uint32_t viewCount = uint32_t(views.size());
+
+        rayGenVars["RayGenCB"]["gViewCount"] = viewCount;
+        rayGenVars["RayGenCB"]["gViewGrid"] = getGrid(viewCount);
+        for (uint32_t i = 0; i < viewCount; i++) {
+            std::string index = "[" + std::to_string(i) + "]";
+            rayGenVars["RayGenCB"]["gViewPos" + index] = vec4(views[i].posW, 1.0f);
+            rayGenVars["RayGenCB"]["gViewU" + index] = vec4(views[i].cameraU, 0.0f);
+            rayGenVars["RayGenCB"]["gViewV" + index] = vec4(views[i].cameraV, 0.0f);
+            rayGenVars["RayGenCB"]["gViewW" + index] = vec4(views[i].cameraW, 0.0f);
+        }
+        return std::max(viewCount, 1u);
+    }
+
+    // Returns whether the layout changed.
+    bool renderGui(Gui *pGui);
+
+private:
+    MultiViewLayout() = default;
+
+    uint32_t mLayout = uint32_t(Layout::Single);
+    // Distance between the eyes of the stereo pair, in scene units.
+    float mStereoSeparation = 0.065f;
+};
\ No newline at end of file
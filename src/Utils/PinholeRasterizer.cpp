@@ -0,0 +1,96 @@
+#include "PinholeRasterizer.h"
+
+namespace {
+    const char *kRasterShaderFile = "Shaders\\PinholeGBuffer.ps.hlsl";
+    const char *kBackgroundShaderFile = "Shaders\\PinholeBackground.ps.hlsl";
+};
+
+PinholeRasterizer::SharedPtr PinholeRasterizer::create(ResourceManager::SharedPtr pResManager) {
+    return SharedPtr(new PinholeRasterizer(pResManager));
+}
+
+PinholeRasterizer::PinholeRasterizer(ResourceManager::SharedPtr pResManager) : mpResManager(pResManager) {
+    mpResManager->requestTextureResource("Z-Buffer", ResourceFormat::D24UnormS8, ResourceManager::kDepthBufferFlags);
+
+    mpBackgroundShader = FullscreenLaunch::create(kBackgroundShaderFile);
+    mpBackgroundState = GraphicsState::create();
+
+    Program::DefineList depthPrepassDefines;
+    depthPrepassDefines.add("DEPTH_PREPASS");
+    mpDepthPrepassProgram = GraphicsProgram::createFromFile(kRasterShaderFile, "", "main", depthPrepassDefines);
+    mpDepthPrepassVars = GraphicsVars::create(mpDepthPrepassProgram->getReflector());
+    mpGBufferProgram = GraphicsProgram::createFromFile(kRasterShaderFile, "", "main");
+    mpGBufferVars = GraphicsVars::create(mpGBufferProgram->getReflector());
+    mpRasterState = GraphicsState::create();
+
+    DepthStencilState::Desc depthPrepassDesc;
+    depthPrepassDesc.setDepthTest(true).setDepthFunc(DepthStencilState::Func::Less).setDepthWriteMask(true);
+    mpDepthPrepassDepthState = DepthStencilState::create(depthPrepassDesc);
+
+    DepthStencilState::Desc gBufferDesc;
+    gBufferDesc.setDepthTest(true).setDepthFunc(DepthStencilState::Func::Equal).setDepthWriteMask(false);
+    mpGBufferDepthState = DepthStencilState::create(gBufferDesc);
+}
+
+void PinholeRasterizer::setScene(const Scene::SharedPtr &pScene) {
+    mpScene = pScene;
+    mpSceneRenderer = mpScene ? SceneRenderer::create(mpScene) : nullptr;
+}
+
+bool PinholeRasterizer::canRender() const {
+    return mpSceneRenderer && mpScene->getActiveCamera();
+}
+
+void PinholeRasterizer::execute(RenderContext *pRenderContext, uvec2 renderSize, vec2 pixelJitter, const vec3 &bgColor, bool useEnvMap, bool useTextureLOD) {
+    GraphicsState::Viewport viewport(0.0f, 0.0f, float(renderSize.x), float(renderSize.y), 0.0f, 1.0f);
+    const CameraData &cameraData = mpScene->getActiveCamera()->getData();
+
+    // Primary rays for every pixel, and the background for those no geometry covers.
+    Fbo::SharedPtr backgroundFbo = mpResManager->createManagedFbo({ "PrimaryRayOriginOnLens", "PrimaryRayDirection", "MaterialDiffuse" });
+    mpBackgroundState->setFbo(backgroundFbo);
+    mpBackgroundState->setViewport(0, viewport);
+
+    auto backgroundVars = mpBackgroundShader->getVars();
+    backgroundVars["BackgroundCB"]["gCameraPos"] = cameraData.posW;
+    backgroundVars["BackgroundCB"]["gCameraU"] = cameraData.cameraU;
+    backgroundVars["BackgroundCB"]["gCameraV"] = cameraData.cameraV;
+    backgroundVars["BackgroundCB"]["gCameraW"] = cameraData.cameraW;
+    backgroundVars["BackgroundCB"]["gPixelJitter"] = pixelJitter;
+    backgroundVars["BackgroundCB"]["gRenderSize"] = renderSize;
+    backgroundVars["BackgroundCB"]["gBgColor"] = bgColor;
+    backgroundVars["BackgroundCB"]["gUseEnvMap"] = useEnvMap;
+    backgroundVars["gEnvMap"] = mpResManager->getTexture(ResourceManager::kEnvironmentMap);
+    mpBackgroundShader->execute(pRenderContext, mpBackgroundState);
+
+    // Depth prepass: only the visible surface of each pixel survives.
+    Fbo::SharedPtr depthFbo = mpResManager->createManagedFbo({}, "Z-Buffer");
+    pRenderContext->clearDsv(depthFbo->getDepthStencilView().get(), 1.0f, 0);
+    mpRasterState->setFbo(depthFbo);
+    mpRasterState->setViewport(0, viewport);
+    mpRasterState->setProgram(mpDepthPrepassProgram);
+    mpRasterState->setDepthStencilState(mpDepthPrepassDepthState);
+    pRenderContext->pushGraphicsState(mpRasterState);
+    pRenderContext->pushGraphicsVars(mpDepthPrepassVars);
+    mpSceneRenderer->renderScene(pRenderContext);
+    pRenderContext->popGraphicsVars();
+    pRenderContext->popGraphicsState();
+
+    // G-Buffer: materials are evaluated once per pixel, for the surface the prepass kept.
+    Fbo::SharedPtr gBufferFbo = mpResManager->createManagedFbo({
+        "WorldPosition", "WorldNormal", "WorldShadingNormal", "MaterialDiffuse", "MaterialSpecRough",
+        "MaterialExtraParams", "MaterialEmissive", "RayCone"
+    }, "Z-Buffer");
+    mpRasterState->setFbo(gBufferFbo);
+    mpRasterState->setViewport(0, viewport);
+    mpRasterState->setProgram(mpGBufferProgram);
+    mpRasterState->setDepthStencilState(mpGBufferDepthState);
+
+    // Textures are filtered for the output resolution, as in the ray traced G-Buffer.
+    mpGBufferVars["GBufferCB"]["gUseTextureLOD"] = useTextureLOD;
+    mpGBufferVars["GBufferCB"]["gTextureLODHeight"] = mpResManager->getScreenSize().y;
+    pRenderContext->pushGraphicsState(mpRasterState);
+    pRenderContext->pushGraphicsVars(mpGBufferVars);
+    mpSceneRenderer->renderScene(pRenderContext);
+    pRenderContext->popGraphicsVars();
+    pRenderContext->popGraphicsState();
+}
\ No newline at end of file
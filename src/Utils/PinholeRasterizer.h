@@ -0,0 +1,46 @@
+#pragma once
+#include "Falcor.h"
+#include "../SharedUtils/ResourceManager.h"
+#include "../SharedUtils/FullscreenLaunch.h"
+
+// Fills the G-Buffer of a pinhole camera by rasterization instead of ray tracing. Pinhole primary
+// rays share their origin, so the rasterizer can resolve them instead of a BVH traversal per pixel.
+//
+// A fullscreen pass writes the primary rays of every pixel and the background for those no geometry
+// covers (PinholeBackground.ps.hlsl), then a depth prepass and a G-Buffer pass over the scene
+// evaluate the materials once per pixel, for the visible surface only (PinholeGBuffer.ps.hlsl). The
+// channels written are the same as ThinLensGBuffer.rt.hlsl's.
+class PinholeRasterizer {
+public:
+    using SharedPtr = std::shared_ptr<PinholeRasterizer>;
+
+    // Requests the Z-Buffer channel from pResManager.
+    static SharedPtr create(ResourceManager::SharedPtr pResManager);
+
+    void setScene(const Scene::SharedPtr &pScene);
+
+    // Whether there's a scene with an active camera to rasterize.
+    bool canRender() const;
+
+    // Renders the active camera into the top-left renderSize region of the G-Buffer channels.
+    // pixelJitter is the subpixel offset already applied to the camera, in pixels.
+    void execute(RenderContext *pRenderContext, uvec2 renderSize, vec2 pixelJitter, const vec3 &bgColor, bool useEnvMap, bool useTextureLOD);
+
+private:
+    PinholeRasterizer(ResourceManager::SharedPtr pResManager);
+
+    ResourceManager::SharedPtr mpResManager;
+
+    Scene::SharedPtr mpScene;
+    SceneRenderer::SharedPtr mpSceneRenderer;
+
+    FullscreenLaunch::SharedPtr mpBackgroundShader;
+    GraphicsState::SharedPtr mpBackgroundState;
+    GraphicsProgram::SharedPtr mpDepthPrepassProgram;
+    GraphicsVars::SharedPtr mpDepthPrepassVars;
+    GraphicsProgram::SharedPtr mpGBufferProgram;
+    GraphicsVars::SharedPtr mpGBufferVars;
+    GraphicsState::SharedPtr mpRasterState;
+    DepthStencilState::SharedPtr mpDepthPrepassDepthState;
+    DepthStencilState::SharedPtr mpGBufferDepthState;
+};
\ No newline at end of file
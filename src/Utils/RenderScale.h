@@ -0,0 +1,80 @@
+#pragma once
+#include "Falcor.h"
+
+// The internal render resolution, as a fraction of the screen size, shared by the passes that render
+// at it (the G-Buffer and the integrator) and the TemporalUpscalingPass that brings their output back
+// to the screen size. Textures stay screen-sized; passes at the internal resolution only dispatch
+// over (and write) the top-left getRenderSize() region.
+//
+// Also carries the subpixel jitter of the current frame from the G-Buffer pass, which generates it,
+// to the upscaling pass, which needs to know where in each pixel the samples landed.
+class RenderScale {
+public:
+    using SharedPtr = std::shared_ptr<RenderScale>;
+
+    static SharedPtr create(float scale = 1.0f) {
+        return SharedPtr(new RenderScale(scale));
+    }
+
+    float getScale() const {
+        return mScale;
+    }
+
+    void setScale(float scale) {
+        mScale = glm::clamp(scale, 0.25f, 1.0f);
+    }
+
+    uvec2 getRenderSize(uvec2 screenSize) const {
+        return glm::max(uvec2(vec2(screenSize) * mScale + 0.5f), uvec2(1));
+    }
+
+    // Number of Halton points before the sequence repeats. Every output pixel should receive about 8
+    // samples over a cycle, so the cycle grows with the upscaling ratio.
+    uint32_t getJitterPhaseCount() const {
+        return uint32_t(glm::ceil(8.0f / (mScale * mScale)));
+    }
+
+    // Jitter of the given frame, in [-0.5,0.5]^2 render pixels, from the (2,3) Halton sequence.
+    vec2 getHaltonJitter(uint32_t frame) const {
+        uint32_t index = (frame % getJitterPhaseCount()) + 1;
+        return vec2(halton(index, 2), halton(index, 3)) - 0.5f;
+    }
+
+    const vec2 &getJitter() const {
+        return mJitter;
+    }
+
+    void setJitter(const vec2 &jitter) {
+        mJitter = jitter;
+    }
+
+    // Whether the G-Buffer pass tiled several views into the frame. Their pixels can't be
+    // reprojected with the active camera.
+    bool isMultiView() const {
+        return mMultiView;
+    }
+
+    void setMultiView(bool multiView) {
+        mMultiView = multiView;
+    }
+
+private:
+    RenderScale(float scale) {
+        setScale(scale);
+    }
+
+    static float halton(uint32_t index, uint32_t base) {
+        float f = 1.0f;
+        float result = 0.0f;
+        while (index > 0) {
+            f /= float(base);
+            result += f * float(index % base);
+            index /= base;
+        }
+        return result;
+    }
+
+    float mScale = 1.0f;
+    vec2 mJitter = vec2(0.0f);
+    bool mMultiView = false;
+};
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+#include "Falcor.h"
+
+// Samples per pixel of the integrator's frames, shared by the integrator, which takes them in one
+// dispatch, and the TemporalAccumulationPass, which weights every frame by its sample count.
+//
+// With a frame-time budget, the count adapts to the GPU time of the integrator: its cost per sample
+// is tracked as a running average of its measured frames, and every frame takes as many samples as
+// fit in the budget (at least 1). Without one, the count is fixed.
+class SampleBudget {
+public:
+    using SharedPtr = std::shared_ptr<SampleBudget>;
+
+    static const uint32_t kMaxSamplesPerPixel = 64;
+
+    static SharedPtr create(float budgetMs = 16.0f) {
+        return SharedPtr(new SampleBudget(budgetMs));
+    }
+
+    bool isAdaptive() const {
+        return mAdaptive;
+    }
+
+    void setAdaptive(bool adaptive) {
+        mAdaptive = adaptive;
+    }
+
+    // GPU time of the integrator's frames, not of the whole frame.
+    float getBudgetMs() const {
+        return mBudgetMs;
+    }
+
+    void setBudgetMs(float budgetMs) {
+        mBudgetMs = glm::max(budgetMs, 0.1f);
+    }
+
+    uint32_t getFixedSamplesPerPixel() const {
+        return mFixedSamplesPerPixel;
+    }
+
+    void setFixedSamplesPerPixel(uint32_t samplesPerPixel) {
+        mFixedSamplesPerPixel = glm::clamp(samplesPerPixel, 1u, kMaxSamplesPerPixel);
+    }
+
+    // Called by the integrator with the GPU time of a frame it rendered with the given count.
+    void addMeasurement(float ms, uint32_t samplesPerPixel) {
+        float msPerSample = ms / float(glm::max(samplesPerPixel, 1u));
+        mMsPerSample = mMsPerSample < 0.0f ? msPerSample : glm::mix(mMsPerSample, msPerSample, 0.1f);
+    }
+
+    // Called by the integrator at the start of a frame; chooses its sample count.
+    uint32_t beginFrame() {
+        if (!mAdaptive) {
+            mSamplesPerPixel = mFixedSamplesPerPixel;
+        } else if (mMsPerSample > 0.0f) {
+            mSamplesPerPixel = glm::clamp(uint32_t(mBudgetMs / mMsPerSample), 1u, kMaxSamplesPerPixel);
+        } else {
+            // Not measured yet.
+            mSamplesPerPixel = 1;
+        }
+        return mSamplesPerPixel;
+    }
+
+    // Sample count of the current frame.
+    uint32_t getSamplesPerPixel() const {
+        return mSamplesPerPixel;
+    }
+
+    // Running average of the integrator's GPU time per sample per pixel; negative until measured.
+    float getMsPerSample() const {
+        return mMsPerSample;
+    }
+
+private:
+    SampleBudget(float budgetMs) {
+        setBudgetMs(budgetMs);
+    }
+
+    bool mAdaptive = false;
+    float mBudgetMs = 16.0f;
+    uint32_t mFixedSamplesPerPixel = 1;
+    uint32_t mSamplesPerPixel = 1;
+    float mMsPerSample = -1.0f;
+};
\ No newline at end of file
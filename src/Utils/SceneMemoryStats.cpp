@@ -0,0 +1,103 @@
+#include <dxgi1_4.h>
+#include "SceneMemoryStats.h"
+
+SceneMemoryStats::~SceneMemoryStats() {
+    if (mpAdapter) {
+        mpAdapter->Release();
+    }
+}
+
+void SceneMemoryStats::setScene(const Scene::SharedPtr &pScene) {
+    mModelCount = 0;
+    mModelInstanceCount = 0;
+    mStoredTriangleCount = 0;
+    mInstancedTriangleCount = 0;
+    mStoredVertexCount = 0;
+    mGeometryBytes = 0;
+    mLargestModelBytes = 0;
+    mLargestModelName.clear();
+
+    if (!pScene) {
+        return;
+    }
+
+    mModelCount = pScene->getModelCount();
+    for (uint32_t modelId = 0; modelId < mModelCount; modelId++) {
+        const Model::SharedPtr &pModel = pScene->getModel(modelId);
+        uint32_t instanceCount = pScene->getModelInstanceCount(modelId);
+
+        // A model's geometry is stored once, no matter how many times it's instanced.
+        mModelInstanceCount += instanceCount;
+        mStoredTriangleCount += pModel->getPrimitiveCount();
+        mStoredVertexCount += pModel->getVertexCount();
+        mInstancedTriangleCount += uint64_t(pModel->getPrimitiveCount()) * instanceCount;
+
+        uint64_t modelBytes = 0;
+        for (uint32_t meshId = 0; meshId < pModel->getMeshCount(); meshId++) {
+            const Vao::SharedPtr &pVao = pModel->getMesh(meshId)->getVao();
+            for (uint32_t bufferId = 0; bufferId < pVao->getVertexBuffersCount(); bufferId++) {
+                modelBytes += pVao->getVertexBuffer(bufferId)->getSize();
+            }
+            if (pVao->getIndexBuffer()) {
+                modelBytes += pVao->getIndexBuffer()->getSize();
+            }
+        }
+        mGeometryBytes += modelBytes;
+        if (modelBytes > mLargestModelBytes) {
+            mLargestModelBytes = modelBytes;
+            mLargestModelName = pModel->getName();
+        }
+    }
+}
+
+void SceneMemoryStats::updateVideoMemory() {
+    if (++mFramesSinceVideoMemoryQuery < kVideoMemoryQueryInterval) {
+        return;
+    }
+    mFramesSinceVideoMemoryQuery = 0;
+
+    // Only try to find the device's adapter once; if that fails, nothing is reported.
+    if (!mAdapterLookedUp) {
+        mAdapterLookedUp = true;
+        IDXGIFactory4 *pFactory = nullptr;
+        if (FAILED(CreateDXGIFactory1(IID_PPV_ARGS(&pFactory)))) {
+            return;
+        }
+        if (FAILED(pFactory->EnumAdapterByLuid(gpDevice->getApiHandle()->GetAdapterLuid(), IID_PPV_ARGS(&mpAdapter)))) {
+            mpAdapter = nullptr;
+        }
+        pFactory->Release();
+    }
+    if (!mpAdapter) {
+        return;
+    }
+
+    DXGI_QUERY_VIDEO_MEMORY_INFO info;
+    mHasVideoMemory = SUCCEEDED(mpAdapter->QueryVideoMemoryInfo(0, DXGI_MEMORY_SEGMENT_GROUP_LOCAL, &info));
+    if (mHasVideoMemory) {
+        mVideoMemoryUsage = info.CurrentUsage;
+        mVideoMemoryBudget = info.Budget;
+    }
+}
+
+void SceneMemoryStats::renderGui(Gui *pGui) {
+    // Geometry is stored per model; instances only add entries to the top-level acceleration
+    // structure.
+    pGui->addText((std::string("Models: ") + std::to_string(mModelCount)).c_str());
+    pGui->addText((std::string("Model instances: ") + std::to_string(mModelInstanceCount)).c_str());
+    pGui->addText((std::string("Stored triangles: ") + std::to_string(mStoredTriangleCount)).c_str());
+    pGui->addText((std::string("Stored vertices: ") + std::to_string(mStoredVertexCount)).c_str());
+    pGui->addText((std::string("Instanced triangles: ") + std::to_string(mInstancedTriangleCount)).c_str());
+    pGui->addText("     ");
+
+    const uint64_t kMB = 1024 * 1024;
+    pGui->addText((std::string("Geometry (MB): ") + std::to_string(mGeometryBytes / kMB)).c_str());
+    if (!mLargestModelName.empty()) {
+        pGui->addText((std::string("Largest model: ") + mLargestModelName + " (" + std::to_string(mLargestModelBytes / kMB) + " MB)").c_str());
+    }
+
+    updateVideoMemory();
+    if (mHasVideoMemory) {
+        pGui->addText((std::string("Video memory (MB): ") + std::to_string(mVideoMemoryUsage / kMB) + " of " + std::to_string(mVideoMemoryBudget / kMB)).c_str());
+    }
+}
\ No newline at end of file
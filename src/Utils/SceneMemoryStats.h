@@ -0,0 +1,52 @@
+#pragma once
+#include "Falcor.h"
+
+struct IDXGIAdapter3;
+
+// Geometry and video memory statistics of a scene, for the GUI.
+//
+// Falcor's RtScene builds one bottom-level acceleration structure per model and a top-level one
+// over the model instances of the .fscene file, so geometry memory is proportional to the triangles
+// stored, not to the triangles instanced. The vertex and index buffers all stay resident: the
+// acceleration structures reference them for as long as the scene is loaded. Nothing here streams
+// or evicts geometry; it only reports.
+class SceneMemoryStats {
+public:
+    using SharedPtr = std::shared_ptr<SceneMemoryStats>;
+
+    static SharedPtr create() { return SharedPtr(new SceneMemoryStats()); }
+
+    ~SceneMemoryStats();
+
+    // Recomputes the geometry statistics; nullptr clears them.
+    void setScene(const Scene::SharedPtr &pScene);
+
+    // Shows the statistics, and the process's local video memory usage and the budget the OS grants
+    // it, re-queried every kVideoMemoryQueryInterval calls.
+    void renderGui(Gui *pGui);
+
+private:
+    SceneMemoryStats() = default;
+
+    void updateVideoMemory();
+
+    uint32_t mModelCount = 0;
+    uint32_t mModelInstanceCount = 0;
+    uint64_t mStoredTriangleCount = 0;
+    uint64_t mInstancedTriangleCount = 0;
+    uint64_t mStoredVertexCount = 0;
+
+    // Bytes of vertex and index buffers, in total and of the largest model.
+    uint64_t mGeometryBytes = 0;
+    uint64_t mLargestModelBytes = 0;
+    std::string mLargestModelName;
+
+    // The adapter is looked up once.
+    static const uint32_t kVideoMemoryQueryInterval = 30;
+    IDXGIAdapter3 *mpAdapter = nullptr;
+    bool mAdapterLookedUp = false;
+    uint32_t mFramesSinceVideoMemoryQuery = kVideoMemoryQueryInterval;
+    bool mHasVideoMemory = false;
+    uint64_t mVideoMemoryUsage = 0;
+    uint64_t mVideoMemoryBudget = 0;
+};
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "ShadowCascades.h"
+
+namespace {
+    // Alpha-tested depth only; the same program as the depth prepass of the pinhole G-Buffer.
+    const char *kDepthShaderFile = "Shaders\\PinholeGBuffer.ps.hlsl";
+
+    // Depth bias applied while rasterizing, in depth buffer units and per unit of slope. Receivers
+    // add a normal offset in the shader (see ShadowMaps.hlsli).
+    const int32_t kDepthBias = 100;
+    const float kSlopeScaledDepthBias = 2.0f;
+};
+
+ShadowCascades::SharedPtr ShadowCascades::create(uint32_t resolution, uint32_t cascadeCount) {
+    return SharedPtr(new ShadowCascades(resolution, glm::clamp(cascadeCount, 1u, kMaxCascades)));
+}
+
+ShadowCascades::ShadowCascades(uint32_t resolution, uint32_t cascadeCount) : mResolution(resolution), mCascadeCount(cascadeCount) {
+    mpShadowMap = Texture::create2D(
+        mResolution, mResolution, ResourceFormat::D32Float, mCascadeCount, 1, nullptr,
+        Resource::BindFlags::DepthStencil | Resource::BindFlags::ShaderResource
+    );
+    for (uint32_t cascade = 0; cascade < mCascadeCount; cascade++) {
+        mpCascadeFbos[cascade] = Fbo::create();
+        mpCascadeFbos[cascade]->attachDepthStencilTarget(mpShadowMap, 0, cascade, 1);
+        mpCascadeCameras[cascade] = Camera::create();
+        mCascadeViewProj[cascade] = mat4(1.0f);
+    }
+
+    // Bilinear comparisons: each tap returns the fraction of its 2x2 footprint that is lit.
+    Sampler::Desc samplerDesc;
+    samplerDesc.setFilterMode(Sampler::Filter::Linear, Sampler::Filter::Linear, Sampler::Filter::Point);
+    samplerDesc.setAddressingMode(Sampler::AddressMode::Clamp, Sampler::AddressMode::Clamp, Sampler::AddressMode::Clamp);
+    samplerDesc.setComparisonMode(Sampler::ComparisonMode::LessEqual);
+    mpSampler = Sampler::create(samplerDesc);
+
+    Program::DefineList defines;
+    defines.add("DEPTH_PREPASS");
+    mpDepthProgram = GraphicsProgram::createFromFile(kDepthShaderFile, "", "main", defines);
+    mpDepthVars = GraphicsVars::create(mpDepthProgram->getReflector());
+    mpDepthState = GraphicsState::create();
+    mpDepthState->setProgram(mpDepthProgram);
+
+    DepthStencilState::Desc depthDesc;
+    depthDesc.setDepthTest(true).setDepthFunc(DepthStencilState::Func::Less).setDepthWriteMask(true);
+    mpDepthState->setDepthStencilState(DepthStencilState::create(depthDesc));
+
+    // Foliage and other thin geometry has no back faces to render.
+    RasterizerState::Desc rasterizerDesc;
+    rasterizerDesc.setCullMode(RasterizerState::CullMode::None).setDepthBias(kDepthBias, kSlopeScaledDepthBias);
+    mpDepthState->setRasterizerState(RasterizerState::create(rasterizerDesc));
+}
+
+void ShadowCascades::setScene(const Scene::SharedPtr &pScene) {
+    mpScene = pScene;
+    mpSceneRenderer = mpScene ? SceneRenderer::create(mpScene) : nullptr;
+
+    mLightIndex = -1;
+    if (mpScene) {
+        for (uint32_t i = 0; i < mpScene->getLightCount(); i++) {
+            if (mpScene->getLight(i)->getType() == LightDirectional) {
+                mLightIndex = int32_t(i);
+                break;
+            }
+        }
+    }
+}
+
+bool ShadowCascades::update(RenderContext *pRenderContext) {
+    if (mLightIndex < 0 || !mpSceneRenderer || !mpScene->getActiveCamera()) {
+        return false;
+    }
+
+    auto pLight = std::dynamic_pointer_cast<DirectionalLight>(mpScene->getLight(uint32_t(mLightIndex)));
+    vec3 lightDirection = glm::normalize(pLight->getWorldDirection());
+
+    const Camera::SharedPtr &pCamera = mpScene->getActiveCamera();
+    float nearDistance = pCamera->getNearPlane();
+    float farDistance = glm::max(glm::min(pCamera->getFarPlane(), mMaxShadowDistance), nearDistance * 2.0f);
+
+    GraphicsState::Viewport viewport(0.0f, 0.0f, float(mResolution), float(mResolution), 0.0f, 1.0f);
+    mpDepthState->setViewport(0, viewport);
+
+    float sliceNear = nearDistance;
+    for (uint32_t cascade = 0; cascade < mCascadeCount; cascade++) {
+        float t = float(cascade + 1) / float(mCascadeCount);
+        float logSplit = nearDistance * std::pow(farDistance / nearDistance, t);
+        float uniformSplit = nearDistance + (farDistance - nearDistance) * t;
+        float sliceFar = mSplitBlend * logSplit + (1.0f - mSplitBlend) * uniformSplit;
+
+        fitCascade(cascade, lightDirection, sliceNear, sliceFar);
+        sliceNear = sliceFar;
+
+        pRenderContext->clearDsv(mpCascadeFbos[cascade]->getDepthStencilView().get(), 1.0f, 0);
+        mpDepthState->setFbo(mpCascadeFbos[cascade]);
+        pRenderContext->pushGraphicsState(mpDepthState);
+        pRenderContext->pushGraphicsVars(mpDepthVars);
+        mpSceneRenderer->renderScene(pRenderContext, mpCascadeCameras[cascade].get());
+        pRenderContext->popGraphicsVars();
+        pRenderContext->popGraphicsState();
+    }
+
+    return true;
+}
+
+void ShadowCascades::fitCascade(uint32_t cascade, const vec3 &lightDirection, float nearDistance, float farDistance) {
+    const CameraData &cameraData = mpScene->getActiveCamera()->getData();
+    float focalDistance = glm::length(cameraData.cameraW);
+
+    // Bounding sphere of the corners of the slice. Its radius doesn't change with the camera's
+    // orientation, so neither does the size of a texel in world space.
+    vec3 corners[8];
+    vec3 center = vec3(0.0f);
+    for (uint32_t i = 0; i < 8; i++) {
+        float distance = (i & 4) ? farDistance : nearDistance;
+        float u = (i & 1) ? 1.0f : -1.0f;
+        float v = (i & 2) ? 1.0f : -1.0f;
+        corners[i] = cameraData.posW + (distance / focalDistance) * (cameraData.cameraW + u * cameraData.cameraU + v * cameraData.cameraV);
+        center += corners[i] / 8.0f;
+    }
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < 8; i++) {
+        radius = glm::max(radius, glm::distance(center, corners[i]));
+    }
+    radius = std::ceil(radius * 16.0f) / 16.0f;
+    float texelSize = 2.0f * radius / float(mResolution);
+
+    vec3 up = std::abs(lightDirection.y) > 0.99f ? vec3(1.0f, 0.0f, 0.0f) : vec3(0.0f, 1.0f, 0.0f);
+
+    // Move the center in whole texels in the plane of the map.
+    mat4 lightRotation = glm::lookAt(vec3(0.0f), lightDirection, up);
+    vec3 centerL = vec3(lightRotation * vec4(center, 1.0f));
+    centerL.x = std::floor(centerL.x / texelSize) * texelSize;
+    centerL.y = std::floor(centerL.y / texelSize) * texelSize;
+    center = vec3(glm::inverse(lightRotation) * vec4(centerL, 1.0f));
+
+    // Casters may be anywhere in the scene between the light and the slice.
+    float sceneExtent = glm::dot(center - mpScene->getCenter(), lightDirection) + mpScene->getRadius();
+    float backDistance = glm::max(sceneExtent, radius);
+    float depthRange = backDistance + radius;
+    vec3 eye = center - lightDirection * backDistance;
+
+    // Right-handed orthographic projection onto [0,1] depth.
+    mat4 projection = mat4(1.0f);
+    projection[0][0] = 1.0f / radius;
+    projection[1][1] = 1.0f / radius;
+    projection[2][2] = -1.0f / depthRange;
+
+    const Camera::SharedPtr &pCascadeCamera = mpCascadeCameras[cascade];
+    pCascadeCamera->setPosition(eye);
+    pCascadeCamera->setTarget(center);
+    pCascadeCamera->setUpVector(up);
+    pCascadeCamera->setProjectionMatrix(projection);
+    pCascadeCamera->togglePersistentProjectionMatrix(true);
+
+    mCascadeViewProj[cascade] = projection * glm::lookAt(eye, center, up);
+    mCascadeTexelSize[cascade] = texelSize;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#pragma once
+#include "Falcor.h"
+
+// Cascaded shadow maps for the first directional light of the scene, an alternative to tracing a
+// shadow ray toward it from every shaded point (see ShadowMaps.hlsli).
+//
+// The view frustum, up to kMaxShadowDistance, is split into cascades at distances that blend
+// uniform and logarithmic splits. Each cascade is a square orthographic view along the light that
+// bounds a slice of the frustum; its center is snapped to the texel grid so that the map doesn't
+// shimmer as the camera moves. The cascades are layers of a single depth texture array, rasterized
+// with the alpha-tested depth prepass of PinholeGBuffer.ps.hlsl.
+class ShadowCascades {
+public:
+    using SharedPtr = std::shared_ptr<ShadowCascades>;
+
+    // Must match the SHADOW_MODE_* defines of ShadowMaps.hlsli.
+    enum class Mode : uint32_t {
+        // A shadow ray from every shaded point.
+        Rays = 0,
+        // PCF-filtered shadow maps; rays only outside the cascades.
+        Map,
+        // Shadow maps where all PCF taps agree; rays in penumbrae and outside the cascades.
+        Hybrid
+    };
+
+    // Must match SHADOW_MAP_MAX_CASCADES in ShadowMaps.hlsli.
+    static const uint32_t kMaxCascades = 4;
+
+    static SharedPtr create(uint32_t resolution = 2048, uint32_t cascadeCount = kMaxCascades);
+
+    void setScene(const Scene::SharedPtr &pScene);
+
+    // Renders the cascades for the active camera. Returns false if the scene has no directional
+    // light, in which case the cascades are left as they were.
+    bool update(RenderContext *pRenderContext);
+
+    // Index of the light in the scene's light list (and gLights), or -1.
+    int32_t getLightIndex() const { return mLightIndex; }
+
+    uint32_t getCascadeCount() const { return mCascadeCount; }
+    uint32_t getResolution() const { return mResolution; }
+    const Texture::SharedPtr &getShadowMap() const { return mpShadowMap; }
+    const Sampler::SharedPtr &getSampler() const { return mpSampler; }
+    const mat4 &getCascadeViewProj(uint32_t cascade) const { return mCascadeViewProj[cascade]; }
+    // World-space size of a texel of the cascade, which the shader scales its normal offset by.
+    float getCascadeTexelSize(uint32_t cascade) const { return mCascadeTexelSize[cascade]; }
+
+    // Sets ShadowMapCB, gShadowMap and gShadowMapSampler on shader vars that include ShadowMaps.hlsli.
+    template<typename VarsType>
+    void setShaderData(VarsType &vars, Mode mode) const {
+        for (uint32_t cascade = 0; cascade < kMaxCascades; cascade++) {
+            vars["ShadowMapCB"]["gCascadeViewProj[" + std::to_string(cascade) + "]"] = mCascadeViewProj[glm::min(cascade, mCascadeCount - 1)];
+        }
+        vars["ShadowMapCB"]["gCascadeTexelSize"] = vec4(mCascadeTexelSize[0], mCascadeTexelSize[1], mCascadeTexelSize[2], mCascadeTexelSize[3]);
+        vars["ShadowMapCB"]["gShadowMode"] = mLightIndex < 0 ? uint32_t(Mode::Rays) : uint32_t(mode);
+        vars["ShadowMapCB"]["gCascadeCount"] = mCascadeCount;
+        vars["ShadowMapCB"]["gShadowMapLight"] = mLightIndex;
+        vars["ShadowMapCB"]["gShadowMapResolution"] = float(mResolution);
+        vars["gShadowMap"] = mpShadowMap;
+        vars["gShadowMapSampler"] = mpSampler;
+    }
+
+    float getMaxShadowDistance() const { return mMaxShadowDistance; }
+    void setMaxShadowDistance(float distance) { mMaxShadowDistance = distance; }
+
+private:
+    ShadowCascades(uint32_t resolution, uint32_t cascadeCount);
+
+    // Light-space view and projection bounding the slice [nearDistance, farDistance] of the view
+    // frustum of the active camera.
+    void fitCascade(uint32_t cascade, const vec3 &lightDirection, float nearDistance, float farDistance);
+
+    uint32_t mResolution;
+    uint32_t mCascadeCount;
+    float mMaxShadowDistance = 50.0f;
+    // 0: uniform splits; 1: logarithmic splits.
+    float mSplitBlend = 0.75f;
+
+    Scene::SharedPtr mpScene;
+    SceneRenderer::SharedPtr mpSceneRenderer;
+    int32_t mLightIndex = -1;
+
+    Texture::SharedPtr mpShadowMap;
+    Fbo::SharedPtr mpCascadeFbos[kMaxCascades];
+    Camera::SharedPtr mpCascadeCameras[kMaxCascades];
+    mat4 mCascadeViewProj[kMaxCascades];
+    float mCascadeTexelSize[kMaxCascades] = {};
+
+    Sampler::SharedPtr mpSampler;
+    GraphicsProgram::SharedPtr mpDepthProgram;
+    GraphicsVars::SharedPtr mpDepthVars;
+    GraphicsState::SharedPtr mpDepthState;
+};
\ No newline at end of file
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include "TileScheduler.h"
+
+namespace {
+    using GetNumaNodeProcessorMask2Function = BOOL(WINAPI*)(USHORT node, PGROUP_AFFINITY affinities, USHORT count, PUSHORT requiredCount);
+
+    // The processors of a NUMA node, one entry per processor group it spans. Only
+    // GetNumaNodeProcessorMask2 (Windows 10 20H1 and later) returns them all; before it, a node's
+    // processors are reported in a single group.
+    std::vector<GROUP_AFFINITY> getNumaNodeAffinities(USHORT node) {
+        static const GetNumaNodeProcessorMask2Function getMask2 = reinterpret_cast<GetNumaNodeProcessorMask2Function>(
+            GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetNumaNodeProcessorMask2"));
+
+        std::vector<GROUP_AFFINITY> affinities;
+        if (getMask2 != nullptr) {
+            USHORT count = 0;
+            getMask2(node, nullptr, 0, &count);
+            affinities.resize(count);
+            if (count == 0 || !getMask2(node, affinities.data(), count, &count)) {
+                affinities.clear();
+            }
+            affinities.resize(std::min<size_t>(affinities.size(), count));
+        } else {
+            GROUP_AFFINITY affinity = {};
+            if (GetNumaNodeProcessorMaskEx(node, &affinity)) {
+                affinities.push_back(affinity);
+            }
+        }
+
+        affinities.erase(std::remove_if(affinities.begin(), affinities.end(),
+            [](const GROUP_AFFINITY &affinity) { return affinity.Mask == 0; }), affinities.end());
+        return affinities;
+    }
+
+    // The group holding the index-th processor of affinities, wrapping around, so that consecutive
+    // workers of a node fill its groups in proportion to their processors.
+    GROUP_AFFINITY pickAffinity(const std::vector<GROUP_AFFINITY> &affinities, uint32_t index) {
+        size_t processorCount = 0;
+        for (const GROUP_AFFINITY &affinity : affinities) {
+            processorCount += std::bitset<8 * sizeof(KAFFINITY)>(affinity.Mask).count();
+        }
+
+        size_t processor = index % processorCount;
+        for (const GROUP_AFFINITY &affinity : affinities) {
+            size_t groupProcessors = std::bitset<8 * sizeof(KAFFINITY)>(affinity.Mask).count();
+            if (processor < groupProcessors) {
+                return affinity;
+            }
+            processor -= groupProcessors;
+        }
+        return affinities.back();
+    }
+}
+
+void *TileScheduler::Arena::allocate(size_t size, size_t alignment) {
+    while (mCurrentBlock < mBlocks.size()) {
+        uintptr_t base = reinterpret_cast<uintptr_t>(mBlocks[mCurrentBlock].get());
+        uintptr_t aligned = (base + mOffset + alignment - 1) / alignment * alignment;
+        if (aligned + size <= base + mBlockSizes[mCurrentBlock]) {
+            mOffset = aligned + size - base;
+            return reinterpret_cast<void*>(aligned);
+        }
+        mCurrentBlock++;
+        mOffset = 0;
+    }
+
+    // Not zeroed: the block is first touched by the thread that writes it.
+    size_t blockSize = std::max(kBlockSize, size + alignment);
+    mBlocks.emplace_back(new uint8_t[blockSize]);
+    mBlockSizes.push_back(blockSize);
+    mCurrentBlock = mBlocks.size() - 1;
+    mOffset = 0;
+    return allocate(size, alignment);
+}
+
+void TileScheduler::Arena::reset() {
+    mCurrentBlock = 0;
+    mOffset = 0;
+}
+
+TileScheduler::SharedPtr TileScheduler::create(uint32_t threadCount) {
+    return SharedPtr(new TileScheduler(threadCount));
+}
+
+TileScheduler::SharedPtr TileScheduler::get() {
+    static SharedPtr sScheduler = create();
+    return sScheduler;
+}
+
+TileScheduler::TileScheduler(uint32_t threadCount) {
+    // hardware_concurrency only counts the processor group of the calling thread, which is at most
+    // 64 processors.
+    uint32_t hardwareThreads = std::max(1u, uint32_t(GetActiveProcessorCount(ALL_PROCESSOR_GROUPS)));
+    if (threadCount == 0) {
+        threadCount = hardwareThreads;
+    }
+
+    ULONG highestNode = 0;
+    if (GetNumaHighestNodeNumber(&highestNode)) {
+        mNumaNodeCount = uint32_t(highestNode) + 1;
+    }
+
+    std::vector<std::vector<GROUP_AFFINITY>> nodeAffinities(mNumaNodeCount);
+    for (uint32_t node = 0; node < mNumaNodeCount; node++) {
+        nodeAffinities[node] = getNumaNodeAffinities(USHORT(node));
+    }
+
+    WORD groupCount = std::max<WORD>(1, GetActiveProcessorGroupCount());
+    uint32_t nodeFirstWorker = 0;
+    for (uint32_t i = 0; i < threadCount; i++) {
+        mWorkers.emplace_back(new Worker());
+        Worker &worker = *mWorkers.back();
+        worker.numaNode = i * mNumaNodeCount / threadCount;
+        if (i == 0 || worker.numaNode != mWorkers[i - 1]->numaNode) {
+            nodeFirstWorker = i;
+        }
+
+        const std::vector<GROUP_AFFINITY> &affinities = nodeAffinities[worker.numaNode];
+        if (!affinities.empty()) {
+            worker.affinity = pickAffinity(affinities, i - nodeFirstWorker);
+            continue;
+        }
+        // No topology (a node without processors): round-robin over the groups.
+        worker.affinity = {};
+        worker.affinity.Group = WORD(i % groupCount);
+        DWORD groupProcessors = GetActiveProcessorCount(worker.affinity.Group);
+        worker.affinity.Mask = groupProcessors >= 8 * sizeof(KAFFINITY) ? ~KAFFINITY(0) : (KAFFINITY(1) << groupProcessors) - 1;
+    }
+
+    if (threadCount > 1) {
+        for (uint32_t i = 0; i < threadCount; i++) {
+            mWorkers[i]->thread = std::thread([this, i]() { workerLoop(i); });
+        }
+    }
+}
+
+TileScheduler::~TileScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mStateMutex);
+        mStopping = true;
+    }
+    mWorkReady.notify_all();
+    for (std::unique_ptr<Worker> &pWorker : mWorkers) {
+        if (pWorker->thread.joinable()) {
+            pWorker->thread.join();
+        }
+    }
+}
+
+void TileScheduler::workerLoop(uint32_t index) {
+    if (mWorkers[index]->affinity.Mask != 0) {
+        SetThreadGroupAffinity(GetCurrentThread(), &mWorkers[index]->affinity, nullptr);
+    }
+
+    uint64_t generation = 0;
+    std::unique_lock<std::mutex> lock(mStateMutex);
+    while (true) {
+        mWorkReady.wait(lock, [&]() { return mStopping || mGeneration != generation; });
+        if (mStopping) {
+            return;
+        }
+        generation = mGeneration;
+        const TileFunction &fn = *mpJob;
+
+        lock.unlock();
+        runWorker(index, fn);
+        lock.lock();
+
+        if (--mBusyWorkers == 0) {
+            mWorkDone.notify_one();
+        }
+    }
+}
+
+void TileScheduler::parallelFor(uint32_t width, uint32_t height, uint32_t tileSize, const TileFunction &fn) {
+    std::lock_guard<std::mutex> jobLock(mJobMutex);
+
+    uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    uint32_t tilesY = (height + tileSize - 1) / tileSize;
+    uint32_t tileCount = tilesX * tilesY;
+    uint32_t workerCount = getThreadCount();
+
+    // Worker w starts with the w-th contiguous band of tiles, in row-major order.
+    for (uint32_t w = 0; w < workerCount; w++) {
+        Worker &worker = *mWorkers[w];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        uint32_t begin = uint32_t(uint64_t(tileCount) * w / workerCount);
+        uint32_t end = uint32_t(uint64_t(tileCount) * (w + 1) / workerCount);
+        for (uint32_t t = begin; t < end; t++) {
+            Tile tile;
+            tile.x0 = (t % tilesX) * tileSize;
+            tile.y0 = (t / tilesX) * tileSize;
+            tile.x1 = std::min(tile.x0 + tileSize, width);
+            tile.y1 = std::min(tile.y0 + tileSize, height);
+            worker.tiles.push_back(tile);
+        }
+    }
+
+    if (workerCount == 1) {
+        runWorker(0, fn);
+        return;
+    }
+
+    // The calling thread only waits; it isn't pinned.
+    std::unique_lock<std::mutex> lock(mStateMutex);
+    mpJob = &fn;
+    mBusyWorkers = workerCount;
+    mGeneration++;
+    mWorkReady.notify_all();
+    mWorkDone.wait(lock, [this]() { return mBusyWorkers == 0; });
+    mpJob = nullptr;
+}
+
+void TileScheduler::runWorker(uint32_t index, const TileFunction &fn) {
+    Worker &worker = *mWorkers[index];
+
+    // No tiles are added while the workers run, so once every deque is empty there's nothing left.
+    Tile tile;
+    while (popTile(worker, tile) || stealTile(index, tile)) {
+        fn(tile, worker.arena);
+        worker.arena.reset();
+    }
+}
+
+bool TileScheduler::popTile(Worker &worker, Tile &tile) {
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if (worker.tiles.empty()) {
+        return false;
+    }
+    tile = worker.tiles.back();
+    worker.tiles.pop_back();
+    return true;
+}
+
+bool TileScheduler::stealTile(uint32_t thief, Tile &tile) {
+    uint32_t workerCount = getThreadCount();
+    uint32_t node = mWorkers[thief]->numaNode;
+
+    // Victims on the thief's node first, nearest first, then the rest.
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t i = 1; i < workerCount; i++) {
+            Worker &victim = *mWorkers[(thief + i) % workerCount];
+            if ((victim.numaNode == node) != (pass == 0)) {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.tiles.empty()) {
+                tile = victim.tiles.front();
+                victim.tiles.pop_front();
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+void TileScheduler::logScaling(const std::string &name, const std::function<void(TileScheduler &scheduler)> &work) {
+    uint32_t hardwareThreads = std::max(1u, uint32_t(GetActiveProcessorCount(ALL_PROCESSOR_GROUPS)));
+
+    float singleThreadMs = -1.0f;
+    for (uint32_t threads = 1; ; threads = std::min(2 * threads, hardwareThreads)) {
+        SharedPtr pScheduler = create(threads);
+        auto start = std::chrono::high_resolution_clock::now();
+        work(*pScheduler);
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        if (singleThreadMs < 0.0f) {
+            singleThreadMs = ms;
+        }
+
+        char buffer[256];
+        snprintf(buffer, sizeof(buffer), "%s: %u threads on %u NUMA nodes, %.1f ms, speedup %.2f", name.c_str(), threads,
+            pScheduler->getNumaNodeCount(), ms, ms > 0.0f ? singleThreadMs / ms : 0.0f);
+        logInfo(buffer);
+
+        if (threads == hardwareThreads) {
+            break;
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,116 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "Falcor.h"
+
+// Runs a function over the tiles of a 2D domain on a set of worker threads, for the CPU-side
+// preprocessing whose cost per tile is uneven (e.g. EnvironmentMapSidecar).
+//
+// The worker threads are created once, pinned, and then wait for work; every parallelFor() reuses
+// them. Each worker owns a deque of tiles, seeded with a contiguous band of the domain. It takes
+// tiles from the back of its own deque and, once that's empty, steals from the front of the
+// others', those of workers on its own NUMA node first. Workers are pinned, in contiguous groups, to
+// the processors of the NUMA nodes, so that neighbouring bands (and the memory they first touch)
+// stay on the same node. A node can span several processor groups of at most 64 processors each;
+// its workers are spread over all of them, in proportion to their processors, since a new thread
+// would otherwise stay in its process's group.
+//
+// Every worker has a bump Arena for the transient data of a tile; it's reset after every tile, so
+// the tile loop never goes to the heap once the arena has grown to its working size. Its blocks are
+// allocated by the pinned worker, hence first touched on its node.
+class TileScheduler {
+public:
+    using SharedPtr = std::shared_ptr<TileScheduler>;
+
+    struct Tile {
+        uint32_t x0, y0;
+        // Exclusive.
+        uint32_t x1, y1;
+    };
+
+    class Arena {
+    public:
+        void *allocate(size_t size, size_t alignment = 16);
+
+        template<typename T>
+        T *allocate(size_t count) {
+            return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        }
+
+        // Frees everything allocated since the last reset, keeping the memory.
+        void reset();
+
+    private:
+        static const size_t kBlockSize = 256 * 1024;
+
+        std::vector<std::unique_ptr<uint8_t[]>> mBlocks;
+        std::vector<size_t> mBlockSizes;
+        size_t mCurrentBlock = 0;
+        size_t mOffset = 0;
+    };
+
+    using TileFunction = std::function<void(const Tile &tile, Arena &arena)>;
+
+    // threadCount 0 uses every hardware thread.
+    static SharedPtr create(uint32_t threadCount = 0);
+
+    // The scheduler shared by the whole process, over every hardware thread; created on first use.
+    static SharedPtr get();
+
+    ~TileScheduler();
+
+    // Calls fn for every tileSize x tileSize tile of [0, width) x [0, height) and returns when all
+    // tiles are done. fn is called concurrently and must only write data of its own tile. Calls from
+    // several threads are serialized.
+    void parallelFor(uint32_t width, uint32_t height, uint32_t tileSize, const TileFunction &fn);
+
+    uint32_t getThreadCount() const { return uint32_t(mWorkers.size()); }
+
+    uint32_t getNumaNodeCount() const { return mNumaNodeCount; }
+
+    // Runs work with 1, 2, 4, ... threads up to the hardware thread count and logs the time and
+    // speedup of each, as a scaling curve.
+    static void logScaling(const std::string &name, const std::function<void(TileScheduler &scheduler)> &work);
+
+private:
+    struct Worker {
+        uint32_t numaNode = 0;
+        // Processor group and processors the worker's thread runs on.
+        GROUP_AFFINITY affinity = {};
+        std::mutex mutex;
+        std::deque<Tile> tiles;
+        Arena arena;
+        // Not started for a single worker, which runs on the calling thread.
+        std::thread thread;
+    };
+
+    TileScheduler(uint32_t threadCount);
+
+    // Pins the worker, then runs every job it's woken up for until the scheduler is destroyed.
+    void workerLoop(uint32_t index);
+
+    void runWorker(uint32_t index, const TileFunction &fn);
+
+    bool popTile(Worker &worker, Tile &tile);
+    bool stealTile(uint32_t thief, Tile &tile);
+
+    std::vector<std::unique_ptr<Worker>> mWorkers;
+    uint32_t mNumaNodeCount = 1;
+
+    // One parallelFor() at a time.
+    std::mutex mJobMutex;
+
+    // The job of the workers, guarded by mStateMutex. mGeneration is bumped for every job; a worker
+    // runs it once, then decrements mBusyWorkers.
+    std::mutex mStateMutex;
+    std::condition_variable mWorkReady;
+    std::condition_variable mWorkDone;
+    const TileFunction *mpJob = nullptr;
+    uint64_t mGeneration = 0;
+    uint32_t mBusyWorkers = 0;
+    bool mStopping = false;
+};
\ No newline at end of file
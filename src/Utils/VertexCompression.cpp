@@ -0,0 +1,169 @@
+#include "glm/gtc/packing.hpp"
+#include "VertexCompression.h"
+#include "HostDeviceSharedMacros.h"
+
+namespace {
+    // Bytes per vertex of each attribute in the compressed format.
+    const uint32_t kCompressedPositionSize = 8;
+    const uint32_t kCompressedDirectionSize = 4;
+    const uint32_t kCompressedTexCoordSize = 4;
+
+    // Queues a copy of a GPU buffer to a CPU-readable one. The copy is only complete after the
+    // render context has been flushed.
+    Buffer::SharedPtr stageBuffer(RenderContext *pRenderContext, const Buffer::SharedPtr &pBuffer) {
+        Buffer::SharedPtr pStaging = Buffer::create(pBuffer->getSize(), Resource::BindFlags::None, Buffer::CpuAccess::Read);
+        pRenderContext->copyResource(pStaging.get(), pBuffer.get());
+        return pStaging;
+    }
+
+    float angleBetween(const vec3 &a, const vec3 &b) {
+        return glm::degrees(std::acos(glm::clamp(glm::dot(a, b), -1.0f, 1.0f)));
+    }
+};
+
+uint16_t VertexCompression::quantizeUnorm16(float value, float minValue, float extent) {
+    float normalized = extent > 0.0f ? (value - minValue) / extent : 0.0f;
+    return uint16_t(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f + 0.5f);
+}
+
+float VertexCompression::dequantizeUnorm16(uint16_t value, float minValue, float extent) {
+    return minValue + extent * (float(value) / 65535.0f);
+}
+
+vec2 VertexCompression::octahedralEncode(const vec3 &n) {
+    // Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower hemisphere over the
+    // upper one's diagonals.
+    vec3 p = n / (std::abs(n.x) + std::abs(n.y) + std::abs(n.z));
+    if (p.z < 0.0f) {
+        return (1.0f - abs(vec2(p.y, p.x))) * vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+    }
+    return vec2(p.x, p.y);
+}
+
+vec3 VertexCompression::octahedralDecode(const vec2 &e) {
+    vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    float t = glm::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+vec2 VertexCompression::quantizeSnorm16(const vec2 &v) {
+    return glm::unpackSnorm2x16(glm::packSnorm2x16(v));
+}
+
+VertexCompression::Report VertexCompression::validate(RenderContext *pRenderContext, const Scene::SharedPtr &pScene) {
+    Report report;
+    if (!pScene) {
+        return report;
+    }
+
+    // Copy every vertex buffer first and wait for all of the copies at once, rather than stalling
+    // on each buffer. The staging buffers are in the order the loop below visits the buffers.
+    std::vector<Buffer::SharedPtr> stagingBuffers;
+    for (uint32_t modelId = 0; modelId < pScene->getModelCount(); modelId++) {
+        const Model::SharedPtr &pModel = pScene->getModel(modelId);
+        for (uint32_t meshId = 0; meshId < pModel->getMeshCount(); meshId++) {
+            const Vao::SharedPtr &pVao = pModel->getMesh(meshId)->getVao();
+            for (uint32_t bufferId = 0; bufferId < pVao->getVertexBuffersCount(); bufferId++) {
+                stagingBuffers.push_back(stageBuffer(pRenderContext, pVao->getVertexBuffer(bufferId)));
+            }
+        }
+    }
+    pRenderContext->flush(true);
+
+    uint32_t stagingIndex = 0;
+    for (uint32_t modelId = 0; modelId < pScene->getModelCount(); modelId++) {
+        const Model::SharedPtr &pModel = pScene->getModel(modelId);
+
+        for (uint32_t meshId = 0; meshId < pModel->getMeshCount(); meshId++) {
+            const Vao::SharedPtr &pVao = pModel->getMesh(meshId)->getVao();
+            const VertexLayout::SharedConstPtr &pLayout = pVao->getVertexLayout();
+            uint32_t vertexCount = pModel->getMesh(meshId)->getVertexCount();
+
+            report.meshCount++;
+            report.vertexCount += vertexCount;
+            if (pVao->getIndexBuffer()) {
+                report.originalBytes += pVao->getIndexBuffer()->getSize();
+                report.compressedBytes += pVao->getIndexBuffer()->getSize();
+            }
+
+            for (uint32_t bufferId = 0; bufferId < pVao->getVertexBuffersCount(); bufferId++) {
+                const Buffer::SharedPtr &pBuffer = pVao->getVertexBuffer(bufferId);
+                const VertexBufferLayout::SharedConstPtr &pBufferLayout = pLayout->getBufferLayout(bufferId);
+                report.originalBytes += pBuffer->getSize();
+
+                const Buffer::SharedPtr &pStaging = stagingBuffers[stagingIndex++];
+                const uint8_t *pData = static_cast<const uint8_t*>(pStaging->map(Buffer::MapType::Read));
+                uint32_t stride = pBufferLayout->getStride();
+
+                for (uint32_t element = 0; element < pBufferLayout->getElementCount(); element++) {
+                    const std::string &name = pBufferLayout->getElementName(element);
+                    uint32_t offset = pBufferLayout->getElementOffset(element);
+                    ResourceFormat format = pBufferLayout->getElementFormat(element);
+                    uint32_t size = getFormatBytesPerBlock(format);
+                    const uint8_t *pFirst = pData + offset;
+
+                    // Only full-float attributes of exactly the expected width are compressed; a
+                    // float4 normal, say, is counted as it is.
+                    bool isFloat3 = format == ResourceFormat::RGB32Float;
+                    bool isFloat2 = format == ResourceFormat::RG32Float;
+
+                    if (name == VERTEX_POSITION_NAME && isFloat3) {
+                        report.compressedBytes += uint64_t(vertexCount) * kCompressedPositionSize;
+
+                        vec3 minPosition(FLT_MAX);
+                        vec3 maxPosition(-FLT_MAX);
+                        for (uint32_t v = 0; v < vertexCount; v++) {
+                            const vec3 &p = *reinterpret_cast<const vec3*>(pFirst + size_t(v) * stride);
+                            minPosition = glm::min(minPosition, p);
+                            maxPosition = glm::max(maxPosition, p);
+                        }
+                        vec3 extent = maxPosition - minPosition;
+                        float maxExtent = glm::max(extent.x, glm::max(extent.y, extent.z));
+
+                        for (uint32_t v = 0; v < vertexCount; v++) {
+                            const vec3 &p = *reinterpret_cast<const vec3*>(pFirst + size_t(v) * stride);
+                            vec3 decoded;
+                            for (int c = 0; c < 3; c++) {
+                                decoded[c] = dequantizeUnorm16(quantizeUnorm16(p[c], minPosition[c], extent[c]), minPosition[c], extent[c]);
+                            }
+                            float error = glm::length(decoded - p);
+                            report.maxPositionError = glm::max(report.maxPositionError, error);
+                            if (maxExtent > 0.0f) {
+                                report.maxRelativePositionError = glm::max(report.maxRelativePositionError, error / maxExtent);
+                            }
+                        }
+                    } else if ((name == VERTEX_NORMAL_NAME || name == VERTEX_BITANGENT_NAME) && isFloat3) {
+                        report.compressedBytes += uint64_t(vertexCount) * kCompressedDirectionSize;
+
+                        float &maxError = (name == VERTEX_NORMAL_NAME) ? report.maxNormalError : report.maxBitangentError;
+                        for (uint32_t v = 0; v < vertexCount; v++) {
+                            vec3 d = *reinterpret_cast<const vec3*>(pFirst + size_t(v) * stride);
+                            if (glm::dot(d, d) == 0.0f) {
+                                continue;
+                            }
+                            d = glm::normalize(d);
+                            vec3 decoded = octahedralDecode(quantizeSnorm16(octahedralEncode(d)));
+                            maxError = glm::max(maxError, angleBetween(d, decoded));
+                        }
+                    } else if (name == VERTEX_TEXCOORD_NAME && isFloat2) {
+                        report.compressedBytes += uint64_t(vertexCount) * kCompressedTexCoordSize;
+
+                        for (uint32_t v = 0; v < vertexCount; v++) {
+                            const vec2 &uv = *reinterpret_cast<const vec2*>(pFirst + size_t(v) * stride);
+                            vec2 decoded = glm::unpackHalf2x16(glm::packHalf2x16(uv));
+                            vec2 error = abs(decoded - uv);
+                            report.maxTexCoordError = glm::max(report.maxTexCoordError, glm::max(error.x, error.y));
+                        }
+                    } else {
+                        report.compressedBytes += uint64_t(vertexCount) * size;
+                    }
+                }
+                pStaging->unmap();
+            }
+        }
+    }
+
+    return report;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#include "Falcor.h"
+
+// Measures what a compressed vertex format would cost the scene's meshes in precision and what it
+// would save in memory:
+//
+// - Positions: 16 bits per component, quantized over the mesh's bounding box (8 bytes with padding,
+//   instead of 12).
+// - Normals and bitangents: octahedral mapping of the unit sphere onto [-1,1]^2, 16-bit snorm per
+//   component (4 bytes, instead of 12).
+// - Texture coordinates: half floats (4 bytes, instead of 8).
+//
+// Other vertex attributes and the index buffers are counted as they are. The vertex buffers live in
+// GPU memory, so they're copied to readback buffers first.
+//
+// This only validates the format. The scene keeps Falcor's full-float vertex buffers, and the hit
+// shaders decode those; nothing here changes what is stored or rendered.
+class VertexCompression {
+public:
+    struct Report {
+        uint32_t meshCount = 0;
+        uint64_t vertexCount = 0;
+        uint64_t originalBytes = 0;
+        uint64_t compressedBytes = 0;
+        // In object space, and relative to the extent of the mesh's bounding box.
+        float maxPositionError = 0.0f;
+        float maxRelativePositionError = 0.0f;
+        // In degrees.
+        float maxNormalError = 0.0f;
+        float maxBitangentError = 0.0f;
+        float maxTexCoordError = 0.0f;
+    };
+
+    static Report validate(RenderContext *pRenderContext, const Scene::SharedPtr &pScene);
+
+    // The encodings themselves; a shader decoding the compressed format inverts these.
+    static uint16_t quantizeUnorm16(float value, float minValue, float extent);
+    static float dequantizeUnorm16(uint16_t value, float minValue, float extent);
+    static vec2 octahedralEncode(const vec3 &n);
+    static vec3 octahedralDecode(const vec2 &e);
+    static vec2 quantizeSnorm16(const vec2 &v);
+};
\ No newline at end of file
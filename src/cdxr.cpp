@@ -4,22 +4,52 @@
 #include "../SharedUtils/ResourceManager.h"
 #include "Passes/ThinLensGBufferPass.h"
 #include "Passes/TemporalAccumulationPass.h"
+#include "Passes/TemporalUpscalingPass.h"
 #include "Passes/DiffuseGIPass.h"
 #include "Passes/GGXGIPass.h"
 #include "Passes/UnidirectionalPathTracingPass.h"
+#include "Passes/BidirectionalPathTracingPass.h"
 #include "Passes/ToneMappingPass.h"
 #include "Passes/LightProbeGBufferPass.h"
+#include "Passes/SceneStatisticsPass.h"
+#include "Utils/EnvironmentMapSidecar.h"
+
+// Storage format of the HDR radiance channel shared by the integrator, temporal accumulation and
+// tone mapping passes. RGBA32Float keeps the full precision of the baseline; RGBA16Float and
+// R11G11B10Float trade precision for bandwidth, see TemporalAccumulationPass's GUI for each.
+const ResourceFormat kHDRFormat = ResourceFormat::RGBA32Float;
 
 int WINAPI WinMain(_In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPSTR lpCmdLine, _In_ int nShowCmd) {
+    // -logPrefilterScaling logs the scaling curve of the prefiltering of every environment map
+    // sidecar that's built (delete the .envcache files to rebuild them).
+    if (lpCmdLine != nullptr && strstr(lpCmdLine, "-logPrefilterScaling") != nullptr) {
+        EnvironmentMapSidecar::setLogPrefilterScaling(true);
+    }
+
     RenderingPipeline pipeline;
 
-    pipeline.setPass(0, ThinLensGBufferPass::create());
+    // The G-Buffer and path tracing passes render at this fraction of the screen size; the
+    // temporal upscaling pass brings their output back to the screen size.
+    RenderScale::SharedPtr renderScale = RenderScale::create(1.0f);
+
+    // Samples per pixel of the path tracing pass, fixed or within a GPU time budget; the temporal
+    // accumulation pass weights its frames by them.
+    SampleBudget::SharedPtr sampleBudget = SampleBudget::create(16.0f);
+
+    pipeline.setPass(0, ThinLensGBufferPass::create(renderScale));
     // pipeline.setPass(0, LightProbeGBufferPass::create());
     // pipeline.setPass(1, DiffuseGIPass::create("HDROutput"));
-    pipeline.setPass(1, UnidirectionalPathTracingPass::create("HDROutput"));
+    // The integrator is picked at runtime from the pipeline's dropdown for this pass; the
+    // unidirectional path tracer, first, is the default.
+    pipeline.setPassOptions(1, {
+        UnidirectionalPathTracingPass::create("HDROutput", kHDRFormat, renderScale, sampleBudget),
+        BidirectionalPathTracingPass::create("HDROutput", kHDRFormat, renderScale, sampleBudget)
+    });
     // pipeline.setPass(1, GGXGIPass::create("HDROutput"));
-    pipeline.setPass(2, TemporalAccumulationPass::create("HDROutput"));
-    pipeline.setPass(3, ToneMappingPass::create("HDROutput", ResourceManager::kOutputChannel));
+    pipeline.setPass(2, TemporalUpscalingPass::create("HDROutput", "HDRUpscaled", renderScale, kHDRFormat));
+    pipeline.setPass(3, TemporalAccumulationPass::create("HDRUpscaled", kHDRFormat, sampleBudget));
+    pipeline.setPass(4, ToneMappingPass::create("HDRUpscaled", ResourceManager::kOutputChannel, kHDRFormat));
+    pipeline.setPass(5, SceneStatisticsPass::create());
 
     SampleConfig config;
     config.windowDesc.title = "Diffuse GI and tone mapping";